@@ -5,12 +5,38 @@
 
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
+#include "device_caps.h"
+#include "mr_profiler.h"
+
 namespace adverbs {
 
+namespace detail {
+
+/**
+ * Adopt a verbs object into a shared_ptr which releases it with Release.
+ * Returns an empty shared_ptr (and never calls Release) for nullptr.
+ */
+template <auto Release, typename T>
+std::shared_ptr<T> adopt(T *ptr) {
+  if (!ptr) return {};
+  return std::shared_ptr<T>(ptr, [](T *p) { Release(p); });
+}
+
+/**
+ * A context's capabilities, queried once and shared by copies of its handle.
+ */
+struct caps_cache {
+  std::once_flag once;
+  device_caps caps;
+};
+
+}  // namespace detail
+
 /**
  * RAII wrapper for ibv_get_device_list and ibv_free_device_list
  *
@@ -194,10 +220,36 @@ class scoped_device_list {
  */
 class context_handle {
  public:
+  /**
+   * Open a device context.
+   * Calls ibv_open_device.
+   *
+   * @param device The device to open.
+   * @throws std::runtime_error if ibv_open_device fails.
+   */
   explicit context_handle(const struct ibv_device *device)
-      : _context(
-            ibv_open_device(const_cast<struct ibv_device *>(device)),
-            ibv_close_device) {}
+      : _context(detail::adopt<ibv_close_device>(
+            ibv_open_device(const_cast<struct ibv_device *>(device)))) {
+    if (!_context) {
+      throw std::runtime_error("ibv_open_device failed");
+    }
+  }
+
+  /**
+   * Import a device context shared by another process.
+   * Calls ibv_import_device.
+   *
+   * @param cmd_fd The exporting context's cmd_fd, e.g. received over a Unix
+   * socket.
+   * @throws std::runtime_error if ibv_import_device fails.
+   */
+  static context_handle import(int cmd_fd) {
+    auto context = detail::adopt<ibv_close_device>(ibv_import_device(cmd_fd));
+    if (!context) {
+      throw std::runtime_error("ibv_import_device failed");
+    }
+    return context_handle(std::move(context));
+  }
 
   struct ibv_context *get() { return _context.get(); }
 
@@ -217,6 +269,38 @@ class context_handle {
     return attr;
   }
 
+  /**
+   * Query the extended device attributes.
+   * Calls ibv_query_device_ex.
+   *
+   * @return struct ibv_device_attr_ex containing the device attributes.
+   * @throws std::runtime_error if ibv_query_device_ex fails.
+   */
+  [[nodiscard]]
+  struct ibv_device_attr_ex query_device_attr_ex() const {
+    struct ibv_device_attr_ex attr = {};
+    if (ibv_query_device_ex(_context.get(), nullptr, &attr)) {
+      throw std::runtime_error("ibv_query_device_ex failed");
+    }
+    return attr;
+  }
+
+  /**
+   * The device's capabilities.
+   * Calls ibv_query_device_ex on first use; copies of this handle share the
+   * result.
+   *
+   * @return The capabilities.
+   * @throws std::runtime_error if ibv_query_device_ex fails.
+   */
+  [[nodiscard]]
+  const device_caps &caps() const {
+    std::call_once(_caps->once, [this]() {
+      _caps->caps = device_caps::from(query_device_attr_ex());
+    });
+    return _caps->caps;
+  }
+
   /**
    * Query the port attributes.
    * Calls ibv_query_port for each port.
@@ -256,7 +340,366 @@ class context_handle {
   }
 
  private:
+  explicit context_handle(std::shared_ptr<struct ibv_context> context)
+      : _context(std::move(context)) {}
+
   std::shared_ptr<struct ibv_context> _context;
+  std::shared_ptr<detail::caps_cache> _caps =
+      std::make_shared<detail::caps_cache>();
+};
+
+/**
+ * RAII wrapper for ibv_alloc_pd and ibv_dealloc_pd
+ *
+ * Holds a reference to the owning context, so the context outlives the PD.
+ *
+ * Example usage:
+ *
+ *     adverbs::context_handle context(device_list[0]);
+ *     adverbs::protection_domain_handle pd(context);
+ */
+class protection_domain_handle {
+ public:
+  /**
+   * Allocate a protection domain.
+   * Calls ibv_alloc_pd.
+   *
+   * @param context The context to allocate the protection domain on.
+   * @throws std::runtime_error if ibv_alloc_pd fails.
+   */
+  explicit protection_domain_handle(context_handle &context)
+      : _context(context),
+        _pd(detail::adopt<ibv_dealloc_pd>(ibv_alloc_pd(context.get()))) {
+    if (!_pd) {
+      throw std::runtime_error("ibv_alloc_pd failed");
+    }
+  }
+
+  /**
+   * Import a protection domain shared by another process.
+   * Calls ibv_import_pd.
+   *
+   * The importer takes ownership: the PD is deallocated when the last
+   * handle goes away, so the exporter must not deallocate it.
+   *
+   * @param context The imported context the PD belongs to.
+   * @param pd_handle The exporting PD's handle.
+   * @throws std::runtime_error if ibv_import_pd fails.
+   */
+  static protection_domain_handle import(
+      context_handle &context,
+      uint32_t pd_handle) {
+    auto pd = detail::adopt<ibv_dealloc_pd>(
+        ibv_import_pd(context.get(), pd_handle));
+    if (!pd) {
+      throw std::runtime_error("ibv_import_pd failed");
+    }
+    return protection_domain_handle(context, std::move(pd));
+  }
+
+  struct ibv_pd *get() { return _pd.get(); }
+
+  context_handle &context() { return _context; }
+
+ private:
+  protection_domain_handle(
+      context_handle &context,
+      std::shared_ptr<struct ibv_pd> pd)
+      : _context(context), _pd(std::move(pd)) {}
+
+  context_handle _context;
+  std::shared_ptr<struct ibv_pd> _pd;
+};
+
+/**
+ * RAII wrapper for ibv_create_comp_channel and ibv_destroy_comp_channel
+ *
+ * Example usage:
+ *
+ *     adverbs::completion_channel_handle channel(context);
+ *     adverbs::completion_queue_handle cq(context, 4096, channel);
+ */
+class completion_channel_handle {
+ public:
+  /**
+   * Create a completion channel.
+   * Calls ibv_create_comp_channel.
+   *
+   * @param context The context to create the channel on.
+   * @throws std::runtime_error if ibv_create_comp_channel fails.
+   */
+  explicit completion_channel_handle(context_handle &context)
+      : _context(context),
+        _channel(detail::adopt<ibv_destroy_comp_channel>(
+            ibv_create_comp_channel(context.get()))) {
+    if (!_channel) {
+      throw std::runtime_error("ibv_create_comp_channel failed");
+    }
+  }
+
+  struct ibv_comp_channel *get() { return _channel.get(); }
+
+  /**
+   * The channel's file descriptor, readable when an event is pending.
+   */
+  [[nodiscard]]
+  int fd() const {
+    return _channel->fd;
+  }
+
+ private:
+  friend class completion_queue_handle;
+
+  context_handle _context;
+  std::shared_ptr<struct ibv_comp_channel> _channel;
+};
+
+/**
+ * RAII wrapper for ibv_create_cq and ibv_destroy_cq
+ *
+ * Example usage:
+ *
+ *     adverbs::context_handle context(device_list[0]);
+ *     adverbs::completion_queue_handle cq(context, 4096);
+ *     struct ibv_wc wc[16];
+ *     int n = ibv_poll_cq(cq.get(), 16, wc);
+ */
+class completion_queue_handle {
+ public:
+  /**
+   * Create a completion queue.
+   * Calls ibv_create_cq.
+   *
+   * @param context The context to create the completion queue on.
+   * @param cqe The minimum number of entries the queue must hold.
+   * @param channel An optional completion channel for event notification.
+   * @param comp_vector The completion vector to signal events on.
+   * @throws std::runtime_error if ibv_create_cq fails.
+   */
+  completion_queue_handle(
+      context_handle &context,
+      int cqe,
+      struct ibv_comp_channel *channel = nullptr,
+      int comp_vector = 0)
+      : _context(context),
+        _cq(detail::adopt<ibv_destroy_cq>(ibv_create_cq(
+            context.get(),
+            cqe,
+            nullptr,
+            channel,
+            comp_vector))) {
+    if (!_cq) {
+      throw std::runtime_error("ibv_create_cq failed");
+    }
+  }
+
+  /**
+   * Create a completion queue delivering events to a channel, which is
+   * kept alive for as long as the queue.
+   * Calls ibv_create_cq.
+   *
+   * @param context The context to create the completion queue on.
+   * @param cqe The minimum number of entries the queue must hold.
+   * @param channel The completion channel for event notification.
+   * @param comp_vector The completion vector to signal events on.
+   * @throws std::runtime_error if ibv_create_cq fails.
+   */
+  completion_queue_handle(
+      context_handle &context,
+      int cqe,
+      completion_channel_handle &channel,
+      int comp_vector = 0)
+      : completion_queue_handle(context, cqe, channel.get(), comp_vector) {
+    _channel = channel._channel;
+  }
+
+  struct ibv_cq *get() { return _cq.get(); }
+
+  context_handle &context() { return _context; }
+
+  /**
+   * Arm the queue to raise one event on its channel.
+   * Calls ibv_req_notify_cq.
+   *
+   * @param solicited_only Raise the event only for a completion of a
+   * receive whose sender set IBV_SEND_SOLICITED (or of an error), rather
+   * than for any completion.
+   * @throws std::runtime_error if ibv_req_notify_cq fails.
+   */
+  void req_notify(bool solicited_only = false) {
+    if (ibv_req_notify_cq(_cq.get(), solicited_only)) {
+      throw std::runtime_error("ibv_req_notify_cq failed");
+    }
+  }
+
+ private:
+  context_handle _context;
+  // Declared before _cq, so the queue is destroyed first.
+  std::shared_ptr<struct ibv_comp_channel> _channel;
+  std::shared_ptr<struct ibv_cq> _cq;
+};
+
+/**
+ * RAII wrapper for ibv_create_qp and ibv_destroy_qp
+ *
+ * Holds references to the PD and CQs the QP was created with, so they
+ * outlive it. State transitions are left to ibv_modify_qp on get().
+ *
+ * Example usage:
+ *
+ *     struct ibv_qp_init_attr init_attr = {};
+ *     init_attr.qp_type = IBV_QPT_RC;
+ *     init_attr.cap.max_send_wr = 128;
+ *     init_attr.cap.max_recv_wr = 128;
+ *     init_attr.cap.max_send_sge = 1;
+ *     init_attr.cap.max_recv_sge = 1;
+ *     adverbs::queue_pair_handle qp(pd, cq, cq, init_attr);
+ */
+class queue_pair_handle {
+ public:
+  /**
+   * Create a queue pair.
+   * Calls ibv_create_qp.
+   *
+   * @param pd The protection domain to create the queue pair in.
+   * @param send_cq The completion queue for send work requests.
+   * @param recv_cq The completion queue for receive work requests.
+   * @param init_attr The queue pair attributes; the CQ fields are overridden.
+   * @throws std::runtime_error if ibv_create_qp fails.
+   */
+  queue_pair_handle(
+      protection_domain_handle &pd,
+      completion_queue_handle &send_cq,
+      completion_queue_handle &recv_cq,
+      struct ibv_qp_init_attr init_attr)
+      : _pd(pd), _send_cq(send_cq), _recv_cq(recv_cq) {
+    init_attr.send_cq = send_cq.get();
+    init_attr.recv_cq = recv_cq.get();
+    _qp = detail::adopt<ibv_destroy_qp>(ibv_create_qp(pd.get(), &init_attr));
+    if (!_qp) {
+      throw std::runtime_error("ibv_create_qp failed");
+    }
+  }
+
+  struct ibv_qp *get() { return _qp.get(); }
+
+  [[nodiscard]]
+  uint32_t qp_num() const {
+    return _qp->qp_num;
+  }
+
+  protection_domain_handle &pd() { return _pd; }
+
+ private:
+  protection_domain_handle _pd;
+  completion_queue_handle _send_cq;
+  completion_queue_handle _recv_cq;
+  std::shared_ptr<struct ibv_qp> _qp;
+};
+
+/**
+ * RAII wrapper for ibv_reg_mr and ibv_dereg_mr
+ *
+ * Registrations are reported to mr_profiler while it is enabled.
+ *
+ * Example usage:
+ *
+ *     std::vector<char> buffer(1 << 20);
+ *     adverbs::memory_region_handle mr(
+ *         pd,
+ *         buffer.data(),
+ *         buffer.size(),
+ *         IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE);
+ *     sge.lkey = mr.lkey();
+ */
+class memory_region_handle {
+ public:
+  /**
+   * Register a memory region.
+   * Calls ibv_reg_mr.
+   *
+   * @param pd The protection domain to register the memory in.
+   * @param addr The start of the memory to register.
+   * @param length The length of the memory to register.
+   * @param access The ibv_access_flags to register with.
+   * @throws std::runtime_error if ibv_reg_mr fails.
+   */
+  memory_region_handle(
+      protection_domain_handle &pd,
+      void *addr,
+      size_t length,
+      int access)
+      : _pd(pd) {
+    struct ibv_mr *mr = ibv_reg_mr(pd.get(), addr, length, access);
+    if (!mr) {
+      throw std::runtime_error("ibv_reg_mr failed");
+    }
+    adopt(mr, access);
+  }
+
+  /**
+   * Import a memory region shared by another process.
+   * Calls ibv_import_mr.
+   *
+   * The importer takes ownership, as for protection_domain_handle::import.
+   * The region's memory must be mapped at the same address in this process.
+   *
+   * @param pd The imported protection domain the MR belongs to.
+   * @param mr_handle The exporting MR's handle.
+   * @throws std::runtime_error if ibv_import_mr fails.
+   */
+  static memory_region_handle import(
+      protection_domain_handle &pd,
+      uint32_t mr_handle) {
+    struct ibv_mr *mr = ibv_import_mr(pd.get(), mr_handle);
+    if (!mr) {
+      throw std::runtime_error("ibv_import_mr failed");
+    }
+    return memory_region_handle(pd, mr);
+  }
+
+  struct ibv_mr *get() { return _mr.get(); }
+
+  [[nodiscard]]
+  void *addr() const {
+    return _mr->addr;
+  }
+
+  [[nodiscard]]
+  size_t length() const {
+    return _mr->length;
+  }
+
+  [[nodiscard]]
+  uint32_t lkey() const {
+    return _mr->lkey;
+  }
+
+  [[nodiscard]]
+  uint32_t rkey() const {
+    return _mr->rkey;
+  }
+
+  protection_domain_handle &pd() { return _pd; }
+
+ private:
+  memory_region_handle(protection_domain_handle &pd, struct ibv_mr *mr)
+      : _pd(pd) {
+    // ibv_import_mr doesn't report the exporter's access flags.
+    adopt(mr, -1);
+  }
+
+  void adopt(struct ibv_mr *mr, int access) {
+    mr_profiler::track(
+        mr->context, mr->addr, mr->length, access, mr->lkey, mr->rkey);
+    _mr = std::shared_ptr<struct ibv_mr>(mr, [](struct ibv_mr *mr) {
+      mr_profiler::untrack(mr->context, mr->lkey);
+      ibv_dereg_mr(mr);
+    });
+  }
+
+  protection_domain_handle _pd;
+  std::shared_ptr<struct ibv_mr> _mr;
 };
 
 }  // namespace adverbs
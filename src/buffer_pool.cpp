@@ -0,0 +1,260 @@
+#include "buffer_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace adverbs {
+
+buffer_arena::buffer_arena(void* base, size_t length, uint32_t lkey)
+    : _lkey(lkey) {
+  auto addr = reinterpret_cast<uintptr_t>(base);
+  auto aligned = (addr + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  size_t skew = aligned - addr;
+  _base = reinterpret_cast<std::byte*>(aligned);
+  if (length > skew) {
+    _free_bytes = (length - skew) & ~(alignment - 1);
+    if (_free_bytes) _free[0] = _free_bytes;
+  }
+}
+
+std::byte* buffer_arena::allocate(size_t length) {
+  length = round_up(length ? length : 1);
+  for (auto it = _free.begin(); it != _free.end(); ++it) {
+    auto [offset, extent] = *it;
+    if (extent < length) continue;
+    _free.erase(it);
+    if (extent > length) _free[offset + length] = extent - length;
+    _free_bytes -= length;
+    return _base + offset;
+  }
+  return nullptr;
+}
+
+void buffer_arena::deallocate(std::byte* data, size_t length) {
+  length = round_up(length ? length : 1);
+  size_t offset = data - _base;
+  _free_bytes += length;
+
+  auto next = _free.lower_bound(offset);
+  if (next != _free.end() && offset + length == next->first) {
+    length += next->second;
+    next = _free.erase(next);
+  }
+  if (next != _free.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      prev->second += length;
+      return;
+    }
+  }
+  _free[offset] = length;
+}
+
+buffer_pool::buffer_pool(buffer_arena& arena, buffer_pool_options options)
+    : _arena(arena), _options(options) {
+  if (options.min_size == 0 || options.max_size < options.min_size) {
+    throw std::invalid_argument("buffer_pool needs 0 < min_size <= max_size");
+  }
+  if (options.max_classes == 0 || options.retune_interval == 0 ||
+      options.sample_every == 0) {
+    throw std::invalid_argument(
+        "buffer_pool max_classes, retune_interval and sample_every must be "
+        "non-zero");
+  }
+  std::vector<size_t> capacities;
+  size_t capacity = buffer_arena::round_up(options.min_size);
+  while (capacity < options.max_size) {
+    capacities.push_back(capacity);
+    capacity <<= 1;
+  }
+  capacities.push_back(buffer_arena::round_up(options.max_size));
+  set_classes(capacities);
+}
+
+buffer_pool::~buffer_pool() {
+  for (auto& [capacity, cls] : _classes) {
+    for (std::byte* data : cls.free) _arena.deallocate(data, capacity);
+  }
+}
+
+std::optional<pool_buffer> buffer_pool::allocate(size_t size) {
+  if (size > _options.max_size) {
+    throw std::invalid_argument("buffer_pool request exceeds max_size");
+  }
+  size_t rounded = buffer_arena::round_up(size ? size : 1);
+  if (_options.mode == size_class_mode::adaptive &&
+      ++_allocations % _options.sample_every == 0) {
+    _samples[rounded]++;
+  }
+
+  std::optional<pool_buffer> result;
+  auto it = _classes.lower_bound(size ? size : 1);
+  if (it == _classes.end()) {
+    // No class is large enough; serve the exact size from the arena.
+    std::byte* data = _arena.allocate(rounded);
+    if (data) result = pool_buffer{data, size, rounded, _arena.lkey()};
+  } else {
+    auto& [capacity, cls] = *it;
+    std::byte* data = nullptr;
+    if (!cls.free.empty()) {
+      data = cls.free.back();
+      cls.free.pop_back();
+    } else {
+      data = _arena.allocate(capacity);
+    }
+    if (data) {
+      cls.in_use++;
+      cls.peak_in_use = std::max(cls.peak_in_use, cls.in_use);
+      result = pool_buffer{data, size, capacity, _arena.lkey()};
+    }
+  }
+  if (result) _wasted_bytes += result->capacity - result->size;
+
+  if (_options.mode == size_class_mode::adaptive &&
+      _allocations % _options.retune_interval == 0) {
+    retune();
+  }
+  return result;
+}
+
+void buffer_pool::deallocate(const pool_buffer& buffer) {
+  _wasted_bytes -= buffer.capacity - buffer.size;
+  auto it = _classes.find(buffer.capacity);
+  if (it == _classes.end()) {
+    _arena.deallocate(buffer.data, buffer.capacity);
+    return;
+  }
+  auto& cls = it->second;
+  if (cls.in_use) cls.in_use--;
+  if (cls.free.size() < cls.reserve) {
+    cls.free.push_back(buffer.data);
+  } else {
+    _arena.deallocate(buffer.data, buffer.capacity);
+  }
+}
+
+void buffer_pool::retune() {
+  if (_samples.empty()) return;
+  std::vector<size_t> measured = classes();
+  set_classes(fit_classes(_samples, _options.max_classes));
+
+  // Classes created just now keep an unbounded reserve until an interval
+  // has measured their demand.
+  for (auto& [capacity, cls] : _classes) {
+    if (!std::binary_search(measured.begin(), measured.end(), capacity)) {
+      continue;
+    }
+    cls.reserve = (size_t)std::ceil(
+        (double)cls.peak_in_use * (1.0 + _options.reserve_headroom));
+    cls.peak_in_use = cls.in_use;
+    trim(capacity, cls);
+  }
+
+  // Decay old samples so the classes follow shifts in the traffic.
+  for (auto it = _samples.begin(); it != _samples.end();) {
+    it->second /= 2;
+    it = it->second ? std::next(it) : _samples.erase(it);
+  }
+}
+
+std::vector<size_t> buffer_pool::classes() const {
+  std::vector<size_t> out;
+  for (const auto& [capacity, cls] : _classes) out.push_back(capacity);
+  return out;
+}
+
+size_t buffer_pool::reserve(size_t capacity) const {
+  auto it = _classes.find(capacity);
+  return it == _classes.end() ? 0 : it->second.reserve;
+}
+
+std::vector<size_t> buffer_pool::fit_classes(
+    const std::map<size_t, uint64_t>& histogram,
+    size_t max_classes) {
+  std::map<size_t, uint64_t> rounded;
+  for (const auto& [size, count] : histogram) {
+    if (count) rounded[buffer_arena::round_up(size ? size : 1)] += count;
+  }
+  std::vector<size_t> sizes;
+  std::vector<uint64_t> counts;
+  for (const auto& [size, count] : rounded) {
+    sizes.push_back(size);
+    counts.push_back(count);
+  }
+  size_t n = sizes.size();
+  if (n <= max_classes) return sizes;
+
+  // prefix sums: count[0, i) and count*size[0, i)
+  std::vector<uint64_t> c(n + 1, 0), cs(n + 1, 0);
+  for (size_t i = 0; i < n; ++i) {
+    c[i + 1] = c[i] + counts[i];
+    cs[i + 1] = cs[i] + counts[i] * sizes[i];
+  }
+  // Waste of serving sizes [i, j] from a class of sizes[j].
+  auto waste = [&](size_t i, size_t j) {
+    return sizes[j] * (c[j + 1] - c[i]) - (cs[j + 1] - cs[i]);
+  };
+
+  // best[k][j]: least waste covering sizes [0, j] with k + 1 classes, the
+  // last being sizes[j]; from[k][j] is where that last class starts.
+  constexpr uint64_t inf = std::numeric_limits<uint64_t>::max();
+  std::vector<std::vector<uint64_t>> best(
+      max_classes,
+      std::vector<uint64_t>(n, inf));
+  std::vector<std::vector<size_t>> from(max_classes, std::vector<size_t>(n));
+  for (size_t j = 0; j < n; ++j) best[0][j] = waste(0, j);
+  for (size_t k = 1; k < max_classes; ++k) {
+    for (size_t j = k; j < n; ++j) {
+      for (size_t i = k; i <= j; ++i) {
+        if (best[k - 1][i - 1] == inf) continue;
+        uint64_t cost = best[k - 1][i - 1] + waste(i, j);
+        if (cost < best[k][j]) {
+          best[k][j] = cost;
+          from[k][j] = i;
+        }
+      }
+    }
+  }
+
+  std::vector<size_t> classes;
+  size_t j = n - 1;
+  for (size_t k = max_classes; k-- > 0;) {
+    classes.push_back(sizes[j]);
+    if (k == 0) break;
+    size_t i = from[k][j];
+    if (i == 0) break;
+    j = i - 1;
+  }
+  std::reverse(classes.begin(), classes.end());
+  return classes;
+}
+
+void buffer_pool::set_classes(const std::vector<size_t>& capacities) {
+  std::map<size_t, size_class> next;
+  for (size_t capacity : capacities) {
+    auto it = _classes.find(capacity);
+    if (it != _classes.end()) {
+      next[capacity] = std::move(it->second);
+      _classes.erase(it);
+    } else {
+      next[capacity].reserve = std::numeric_limits<size_t>::max();
+    }
+  }
+  // Retired classes give their free buffers back to the arena; buffers
+  // still in use follow when they are deallocated.
+  for (auto& [capacity, cls] : _classes) {
+    for (std::byte* data : cls.free) _arena.deallocate(data, capacity);
+  }
+  _classes = std::move(next);
+}
+
+void buffer_pool::trim(size_t capacity, size_class& cls) {
+  while (cls.free.size() > cls.reserve) {
+    _arena.deallocate(cls.free.back(), capacity);
+    cls.free.pop_back();
+  }
+}
+
+}  // namespace adverbs
@@ -0,0 +1,216 @@
+#ifndef ADVERBS_BUFFER_POOL_H
+#define ADVERBS_BUFFER_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include "adverbs.h"
+
+namespace adverbs {
+
+/**
+ * A first-fit range allocator over one registered region.
+ *
+ * Extents are 64-byte aligned and adjacent free extents are coalesced, so
+ * memory given back by one size class can be carved up by another.
+ */
+class buffer_arena {
+ public:
+  static constexpr size_t alignment = 64;
+
+  /**
+   * @param base The start of the region.
+   * @param length The length of the region.
+   * @param lkey The lkey of the registration covering the region.
+   */
+  buffer_arena(void* base, size_t length, uint32_t lkey);
+
+  explicit buffer_arena(memory_region_handle& mr)
+      : buffer_arena(mr.addr(), mr.length(), mr.lkey()) {}
+
+  /**
+   * Carve an extent of at least length bytes.
+   *
+   * @return The extent's address, or nullptr if the arena is exhausted.
+   */
+  std::byte* allocate(size_t length);
+
+  /**
+   * Return an extent obtained from allocate().
+   */
+  void deallocate(std::byte* data, size_t length);
+
+  [[nodiscard]]
+  size_t free_bytes() const {
+    return _free_bytes;
+  }
+
+  [[nodiscard]]
+  uint32_t lkey() const {
+    return _lkey;
+  }
+
+  [[nodiscard]]
+  static size_t round_up(size_t length) {
+    return (length + alignment - 1) & ~(alignment - 1);
+  }
+
+ private:
+  std::byte* _base;
+  uint32_t _lkey;
+  size_t _free_bytes = 0;
+  // offset -> length
+  std::map<size_t, size_t> _free;
+};
+
+/**
+ * A buffer handed out by a buffer_pool.
+ */
+struct pool_buffer {
+  std::byte* data = nullptr;
+  // The requested size.
+  size_t size = 0;
+  // The size class the buffer was carved for.
+  size_t capacity = 0;
+  uint32_t lkey = 0;
+};
+
+enum class size_class_mode {
+  // Size classes are the powers of two from min_size to max_size.
+  power_of_two,
+  // Size classes follow the sampled request-size distribution.
+  adaptive,
+};
+
+struct buffer_pool_options {
+  size_class_mode mode = size_class_mode::power_of_two;
+  size_t min_size = 64;
+  size_t max_size = 64 * 1024;
+  // adaptive: the most size classes to fit to the distribution.
+  size_t max_classes = 8;
+  // adaptive: allocations between re-tunes.
+  size_t retune_interval = 4096;
+  // adaptive: sample one in every sample_every request sizes.
+  size_t sample_every = 1;
+  // adaptive: each class keeps up to peak_in_use * (1 + reserve_headroom)
+  // free buffers, where peak_in_use is measured since the last re-tune.
+  double reserve_headroom = 0.25;
+};
+
+/**
+ * A pool of registered buffers grouped into size classes.
+ *
+ * In power_of_two mode the classes are fixed. In adaptive mode the pool
+ * samples the request sizes seen on its channel and, every
+ * retune_interval allocations, re-fits its classes to minimize internal
+ * fragmentation over the sample, re-sizes each class's reserve to its
+ * recent peak in-use count, and returns free buffers of classes that went
+ * cold (or no longer exist) to the arena.
+ *
+ * A pool is owned by one channel (or core) and is not thread-safe.
+ *
+ * Example usage:
+ *
+ *     adverbs::buffer_arena arena(mr);
+ *     adverbs::buffer_pool pool(
+ *         arena, {.mode = adverbs::size_class_mode::adaptive});
+ *     auto buf = pool.allocate(300);
+ *     ...
+ *     pool.deallocate(*buf);
+ */
+class buffer_pool {
+ public:
+  /**
+   * @throws std::invalid_argument if the options are inconsistent.
+   */
+  buffer_pool(buffer_arena& arena, buffer_pool_options options = {});
+
+  ~buffer_pool();
+
+  buffer_pool(const buffer_pool&) = delete;
+  buffer_pool& operator=(const buffer_pool&) = delete;
+
+  /**
+   * Allocate a buffer of at least size bytes.
+   *
+   * Uses the smallest size class that fits. Sizes larger than every current
+   * class (possible between adaptive re-tunes) are carved from the arena
+   * exactly and go back to it when deallocated.
+   *
+   * @return The buffer, or std::nullopt if the arena is exhausted.
+   * @throws std::invalid_argument if size exceeds max_size.
+   */
+  std::optional<pool_buffer> allocate(size_t size);
+
+  /**
+   * Return a buffer to its size class, or to the arena if the class has
+   * been retired or its reserve is full.
+   */
+  void deallocate(const pool_buffer& buffer);
+
+  /**
+   * Re-fit the size classes now; adaptive mode only.
+   */
+  void retune();
+
+  /**
+   * The current size classes, ascending.
+   */
+  [[nodiscard]]
+  std::vector<size_t> classes() const;
+
+  /**
+   * The number of free buffers kept for the class of exactly capacity bytes.
+   */
+  [[nodiscard]]
+  size_t reserve(size_t capacity) const;
+
+  /**
+   * Bytes lost to rounding requests up to their size class, over all
+   * buffers currently allocated.
+   */
+  [[nodiscard]]
+  size_t wasted_bytes() const {
+    return _wasted_bytes;
+  }
+
+  /**
+   * Fit at most max_classes size classes to a histogram of request sizes,
+   * minimizing the bytes lost to rounding up. Sizes are rounded to the
+   * arena alignment first.
+   *
+   * @param histogram Maps a request size to its number of occurrences.
+   * @param max_classes The most classes to return.
+   * @return The chosen classes, ascending; the largest covers every size.
+   */
+  static std::vector<size_t> fit_classes(
+      const std::map<size_t, uint64_t>& histogram,
+      size_t max_classes);
+
+ private:
+  struct size_class {
+    std::vector<std::byte*> free;
+    size_t reserve = 0;
+    size_t in_use = 0;
+    size_t peak_in_use = 0;
+  };
+
+  void set_classes(const std::vector<size_t>& capacities);
+  void trim(size_t capacity, size_class& cls);
+
+  buffer_arena& _arena;
+  buffer_pool_options _options;
+  // capacity -> class
+  std::map<size_t, size_class> _classes;
+  // rounded request size -> decayed sample count
+  std::map<size_t, uint64_t> _samples;
+  size_t _allocations = 0;
+  size_t _wasted_bytes = 0;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_BUFFER_POOL_H
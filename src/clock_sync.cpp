@@ -0,0 +1,121 @@
+#include "clock_sync.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace adverbs {
+
+int64_t realtime_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
+}
+
+bool clock_sync_estimator::add(const clock_sample& sample) {
+  if (sample.delay() < 0) return false;
+  _samples.push_back(sample);
+  while (_samples.size() > std::max<size_t>(1, _options.window)) {
+    _samples.pop_front();
+  }
+  refit();
+  return true;
+}
+
+void clock_sync_estimator::refit() {
+  std::vector<const clock_sample*> by_delay;
+  for (const auto& s : _samples) by_delay.push_back(&s);
+  std::sort(by_delay.begin(), by_delay.end(), [](auto* a, auto* b) {
+    return a->delay() < b->delay();
+  });
+  size_t keep = (size_t)std::ceil(by_delay.size() * _options.keep_fraction);
+  keep = std::clamp(
+      std::max(keep, _options.min_samples),
+      (size_t)1,
+      by_delay.size());
+  int64_t limit = by_delay.front()->delay() + _options.delay_tolerance_ns;
+  while (keep > 2 && by_delay[keep - 1]->delay() > limit) --keep;
+  by_delay.resize(keep);
+
+  clock_estimate e;
+  e.samples = keep;
+  e.min_delay_ns = by_delay.front()->delay();
+  e.error_bound_ns = by_delay.back()->delay() / 2.0;
+  e.reference_ns = (int64_t)_samples.back().midpoint();
+
+  // Least squares of offset against time, relative to the reference to
+  // keep the sums well conditioned.
+  double n = (double)keep, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (const auto* s : by_delay) {
+    double x = s->midpoint() - (double)e.reference_ns;
+    double y = s->offset();
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  double denom = n * sxx - sx * sx;
+  // Too little spread in time to see drift: use the mean offset.
+  if (keep < 2 || denom <= 1e-9 * n * sxx) {
+    e.drift = _estimate.samples ? _estimate.drift : 0;
+    e.offset_ns = sy / n;
+  } else {
+    e.drift = (n * sxy - sx * sy) / denom;
+    e.offset_ns = (sy - e.drift * sx) / n;
+  }
+  _estimate = e;
+}
+
+int64_t clock_sync_estimator::to_remote(int64_t local_ns) const {
+  double dt = (double)(local_ns - _estimate.reference_ns);
+  return local_ns +
+         std::llround(_estimate.offset_ns + _estimate.drift * dt);
+}
+
+int64_t clock_sync_estimator::to_local(int64_t remote_ns) const {
+  // remote = local + offset + drift * (local - ref); solve for local.
+  double local = ((double)(remote_ns - _estimate.reference_ns) -
+                  _estimate.offset_ns) /
+                     (1 + _estimate.drift) +
+                 (double)_estimate.reference_ns;
+  return (int64_t)std::llround(local);
+}
+
+hca_clock::hca_clock(context_handle& context) : _context(context) {
+  uint64_t khz = _context.caps().hca_core_clock;
+  if (khz == 0) {
+    throw std::runtime_error("device reports no HCA core clock");
+  }
+  _ns_per_tick = 1e6 / (double)khz;
+  sample(_anchor_ticks, _anchor_ns);
+}
+
+void hca_clock::sample(uint64_t& ticks, int64_t& ns) {
+  struct ibv_values_ex values = {};
+  values.comp_mask = IBV_VALUES_MASK_RAW_CLOCK;
+  int64_t before = realtime_ns();
+  if (ibv_query_rt_values_ex(_context.get(), &values)) {
+    throw std::runtime_error("ibv_query_rt_values_ex failed");
+  }
+  int64_t after = realtime_ns();
+  ticks = (uint64_t)values.raw_clock.tv_sec * 1'000'000'000 +
+          (uint64_t)values.raw_clock.tv_nsec;
+  ns = before + (after - before) / 2;
+}
+
+void hca_clock::recalibrate() {
+  uint64_t ticks;
+  int64_t ns;
+  sample(ticks, ns);
+  if (ticks != _anchor_ticks && ns > _anchor_ns) {
+    _ns_per_tick =
+        (double)(ns - _anchor_ns) / (double)(ticks - _anchor_ticks);
+  }
+  _anchor_ticks = ticks;
+  _anchor_ns = ns;
+}
+
+}  // namespace adverbs
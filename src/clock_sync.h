@@ -0,0 +1,233 @@
+#ifndef ADVERBS_CLOCK_SYNC_H
+#define ADVERBS_CLOCK_SYNC_H
+
+#include <infiniband/verbs.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+#include "adverbs.h"
+
+namespace adverbs {
+
+/**
+ * One round trip: t1 and t4 on the local clock, t2 and t3 on the remote
+ * clock, all in nanoseconds.
+ */
+struct clock_sample {
+  // The probe left.
+  int64_t t1 = 0;
+  // The probe arrived.
+  int64_t t2 = 0;
+  // The reply left.
+  int64_t t3 = 0;
+  // The reply arrived.
+  int64_t t4 = 0;
+
+  /**
+   * remote - local, exact if the two directions took equally long.
+   */
+  [[nodiscard]]
+  double offset() const {
+    return ((double)(t2 - t1) + (double)(t3 - t4)) / 2;
+  }
+
+  /**
+   * Time on the wire, excluding the remote turnaround.
+   */
+  [[nodiscard]]
+  int64_t delay() const {
+    return (t4 - t1) - (t3 - t2);
+  }
+
+  /**
+   * The local time the offset applies to: the round trip's midpoint.
+   */
+  [[nodiscard]]
+  double midpoint() const {
+    return ((double)t1 + (double)t4) / 2;
+  }
+};
+
+/**
+ * The probe and reply exchanged over the wire; trivially copyable.
+ */
+struct clock_probe {
+  uint64_t seq = 0;
+  int64_t t1 = 0;
+  int64_t t2 = 0;
+  int64_t t3 = 0;
+};
+
+struct clock_estimate {
+  // remote - local at the local time reference_ns.
+  double offset_ns = 0;
+  // d(offset)/d(local time), e.g. 1e-6 for 1 ppm.
+  double drift = 0;
+  int64_t reference_ns = 0;
+  // The smallest round-trip delay in the window.
+  int64_t min_delay_ns = 0;
+  // Half the widest delay among the samples used: offsets are wrong by at
+  // most this much, however the delay splits between the directions.
+  double error_bound_ns = 0;
+  size_t samples = 0;
+};
+
+struct clock_sync_options {
+  // Samples kept.
+  size_t window = 64;
+  // The fraction of the window, lowest delay first, used for the fit.
+  // Queueing delay is what makes the directions asymmetric, so the fastest
+  // round trips give the truest offsets.
+  double keep_fraction = 0.25;
+  // Fit on at least this many samples (or all, if fewer).
+  size_t min_samples = 4;
+  // Of those, drop samples slower than the fastest by more than this, but
+  // keep two so drift can still be fitted.
+  int64_t delay_tolerance_ns = 1000;
+};
+
+/**
+ * Estimates another node's clock offset and drift from round trips.
+ *
+ * Samples are filtered to the lowest-delay fraction of the window, less
+ * any much slower than the fastest, and a line is fitted to their offsets
+ * against local time: its slope is the drift, and its value at the newest
+ * sample the offset.
+ *
+ * Example usage:
+ *
+ *     adverbs::clock_sync_estimator sync;
+ *     // For each reply: t1 stamped in the probe, t2/t3 by the peer
+ *     // (clock_reply), t4 on receipt; ideally all HCA timestamps.
+ *     sync.add({probe.t1, reply.t2, reply.t3, t4});
+ *     int64_t remote_now = sync.to_remote(local_now);
+ */
+class clock_sync_estimator {
+ public:
+  explicit clock_sync_estimator(const clock_sync_options& options = {})
+      : _options(options) {}
+
+  /**
+   * Add a sample; samples with negative delay (a bad timestamp) are dropped.
+   *
+   * @return true if the sample was kept.
+   */
+  bool add(const clock_sample& sample);
+
+  /**
+   * The current estimate; samples == 0 until the first sample.
+   */
+  [[nodiscard]]
+  const clock_estimate& estimate() const {
+    return _estimate;
+  }
+
+  /**
+   * Convert a local time to the remote clock.
+   */
+  [[nodiscard]]
+  int64_t to_remote(int64_t local_ns) const;
+
+  /**
+   * Convert a remote time to the local clock.
+   */
+  [[nodiscard]]
+  int64_t to_local(int64_t remote_ns) const;
+
+  void reset() {
+    _samples.clear();
+    _estimate = {};
+  }
+
+ private:
+  void refit();
+
+  clock_sync_options _options;
+  std::deque<clock_sample> _samples;
+  clock_estimate _estimate;
+};
+
+/**
+ * The peer's side of the exchange: stamps t2 and t3 into a probe.
+ *
+ * @param probe The received probe.
+ * @param t2 When it arrived (its receive completion timestamp, ideally).
+ * @param t3 The time the reply goes out.
+ * @return The reply to send back.
+ */
+inline clock_probe clock_reply(
+    const clock_probe& probe,
+    int64_t t2,
+    int64_t t3) {
+  clock_probe reply = probe;
+  reply.t2 = t2;
+  reply.t3 = t3;
+  return reply;
+}
+
+/**
+ * Converts HCA completion timestamps to nanoseconds of CLOCK_REALTIME.
+ *
+ * The HCA's free-running counter ticks at hca_core_clock kHz. The mapping
+ * is anchored by reading the counter (ibv_query_rt_values_ex) next to the
+ * system clock, and recalibrate() refines the rate from two anchors, which
+ * absorbs the counter's own drift.
+ *
+ * Timestamps come from a CQ created with ibv_create_cq_ex and
+ * IBV_WC_EX_WITH_COMPLETION_TIMESTAMP.
+ */
+class hca_clock {
+ public:
+  /**
+   * @throws std::runtime_error if the device reports no core clock or the
+   *    counter can't be read.
+   */
+  explicit hca_clock(context_handle& context);
+
+  /**
+   * Re-anchor, refining the tick rate from the previous anchor.
+   *
+   * @throws std::runtime_error if the counter can't be read.
+   */
+  void recalibrate();
+
+  [[nodiscard]]
+  int64_t to_ns(uint64_t ticks) const {
+    return _anchor_ns +
+           (int64_t)((double)(int64_t)(ticks - _anchor_ticks) * _ns_per_tick);
+  }
+
+  /**
+   * The current completion's timestamp, inside an
+   * ibv_start_poll/ibv_next_poll loop.
+   */
+  [[nodiscard]]
+  int64_t completion_ns(struct ibv_cq_ex* cq) const {
+    return to_ns(ibv_wc_read_completion_ts(cq));
+  }
+
+  [[nodiscard]]
+  double ns_per_tick() const {
+    return _ns_per_tick;
+  }
+
+ private:
+  // Read the counter and the system clock together.
+  void sample(uint64_t& ticks, int64_t& ns);
+
+  context_handle _context;
+  double _ns_per_tick;
+  uint64_t _anchor_ticks = 0;
+  int64_t _anchor_ns = 0;
+};
+
+/**
+ * CLOCK_REALTIME in nanoseconds, for peers without HCA timestamps.
+ */
+int64_t realtime_ns();
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_CLOCK_SYNC_H
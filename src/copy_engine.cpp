@@ -0,0 +1,218 @@
+#include "copy_engine.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace adverbs {
+
+namespace {
+
+// Copy the unaligned head with memcpy so the streaming loop stores to
+// alignment-byte boundaries; returns the bytes consumed.
+inline size_t align_head(
+    unsigned char*& dst,
+    const unsigned char*& src,
+    size_t n,
+    size_t alignment) {
+  size_t head = (alignment - ((uintptr_t)dst & (alignment - 1))) &
+                (alignment - 1);
+  head = std::min(head, n);
+  std::memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  return head;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2"))) void stream_avx2(
+    void* dst_ptr,
+    const void* src_ptr,
+    size_t n) {
+  auto* dst = static_cast<unsigned char*>(dst_ptr);
+  auto* src = static_cast<const unsigned char*>(src_ptr);
+  n -= align_head(dst, src, n, 32);
+  for (; n >= 128; n -= 128, dst += 128, src += 128) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(src + 0));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src + 32));
+    __m256i c = _mm256_loadu_si256((const __m256i*)(src + 64));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(src + 96));
+    _mm256_stream_si256((__m256i*)(dst + 0), a);
+    _mm256_stream_si256((__m256i*)(dst + 32), b);
+    _mm256_stream_si256((__m256i*)(dst + 64), c);
+    _mm256_stream_si256((__m256i*)(dst + 96), d);
+  }
+  for (; n >= 32; n -= 32, dst += 32, src += 32) {
+    _mm256_stream_si256(
+        (__m256i*)dst, _mm256_loadu_si256((const __m256i*)src));
+  }
+  std::memcpy(dst, src, n);
+  _mm_sfence();
+}
+
+__attribute__((target("avx512f"))) void stream_avx512(
+    void* dst_ptr,
+    const void* src_ptr,
+    size_t n) {
+  auto* dst = static_cast<unsigned char*>(dst_ptr);
+  auto* src = static_cast<const unsigned char*>(src_ptr);
+  n -= align_head(dst, src, n, 64);
+  for (; n >= 256; n -= 256, dst += 256, src += 256) {
+    __m512i a = _mm512_loadu_si512(src + 0);
+    __m512i b = _mm512_loadu_si512(src + 64);
+    __m512i c = _mm512_loadu_si512(src + 128);
+    __m512i d = _mm512_loadu_si512(src + 192);
+    _mm512_stream_si512((__m512i*)(dst + 0), a);
+    _mm512_stream_si512((__m512i*)(dst + 64), b);
+    _mm512_stream_si512((__m512i*)(dst + 128), c);
+    _mm512_stream_si512((__m512i*)(dst + 192), d);
+  }
+  for (; n >= 64; n -= 64, dst += 64, src += 64) {
+    _mm512_stream_si512((__m512i*)dst, _mm512_loadu_si512(src));
+  }
+  std::memcpy(dst, src, n);
+  _mm_sfence();
+}
+
+#endif  // __x86_64__
+
+#if defined(__aarch64__)
+
+void stream_neon(void* dst_ptr, const void* src_ptr, size_t n) {
+  auto* dst = static_cast<unsigned char*>(dst_ptr);
+  auto* src = static_cast<const unsigned char*>(src_ptr);
+  n -= align_head(dst, src, n, 32);
+  for (; n >= 32; n -= 32, dst += 32, src += 32) {
+    // LDP/STNP: a 32-byte load pair and non-temporal store pair.
+    asm volatile(
+        "ldp q0, q1, [%1]\n\t"
+        "stnp q0, q1, [%0]\n\t"
+        :
+        : "r"(dst), "r"(src)
+        : "v0", "v1", "memory");
+  }
+  std::memcpy(dst, src, n);
+  asm volatile("dmb ishst" ::: "memory");
+}
+
+#endif  // __aarch64__
+
+}  // namespace
+
+std::string_view copy_isa_name(copy_isa isa) {
+  switch (isa) {
+    case copy_isa::scalar:
+      return "scalar";
+    case copy_isa::avx2:
+      return "avx2";
+    case copy_isa::avx512:
+      return "avx512";
+    case copy_isa::neon:
+      return "neon";
+  }
+  return "unknown";
+}
+
+bool copy_engine::supported(copy_isa isa) {
+  switch (isa) {
+    case copy_isa::scalar:
+      return true;
+#if defined(__x86_64__)
+    case copy_isa::avx2:
+      return __builtin_cpu_supports("avx2");
+    case copy_isa::avx512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+#if defined(__aarch64__)
+    case copy_isa::neon:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+copy_isa copy_engine::detect() {
+  for (copy_isa isa : {copy_isa::avx512, copy_isa::avx2, copy_isa::neon}) {
+    if (supported(isa)) return isa;
+  }
+  return copy_isa::scalar;
+}
+
+copy_engine::copy_engine(copy_isa isa, const copy_engine_options& options)
+    : _isa(isa), _options(options) {
+  if (!supported(isa)) {
+    throw std::invalid_argument(
+        "copy_engine: " + std::string(copy_isa_name(isa)) +
+        " not supported by this CPU");
+  }
+  if (_options.max_threads == 0) _options.max_threads = 1;
+}
+
+void copy_engine::copy(void* dst, const void* src, size_t n) const {
+  if (n < _options.non_temporal_threshold || _isa == copy_isa::scalar) {
+    std::memcpy(dst, src, n);
+  } else if (n >= _options.parallel_threshold && _options.max_threads > 1) {
+    copy_parallel(dst, src, n);
+  } else {
+    copy_non_temporal(dst, src, n);
+  }
+}
+
+void copy_engine::copy_non_temporal(
+    void* dst,
+    const void* src,
+    size_t n) const {
+  switch (_isa) {
+#if defined(__x86_64__)
+    case copy_isa::avx2:
+      stream_avx2(dst, src, n);
+      return;
+    case copy_isa::avx512:
+      stream_avx512(dst, src, n);
+      return;
+#endif
+#if defined(__aarch64__)
+    case copy_isa::neon:
+      stream_neon(dst, src, n);
+      return;
+#endif
+    default:
+      std::memcpy(dst, src, n);
+      return;
+  }
+}
+
+void copy_engine::copy_parallel(void* dst, const void* src, size_t n) const {
+  // At least half a parallel_threshold per thread, in whole cache lines
+  // so a line-aligned destination is never split between two threads.
+  size_t per_thread = std::max<size_t>(64, _options.parallel_threshold / 2);
+  size_t threads =
+      std::clamp<size_t>(n / per_thread, 1, _options.max_threads);
+  size_t chunk = ((n / threads) + 63) & ~(size_t)63;
+
+  auto* d = static_cast<unsigned char*>(dst);
+  auto* s = static_cast<const unsigned char*>(src);
+  std::vector<std::thread> workers;
+  size_t offset = chunk;
+  for (; offset < n; offset += chunk) {
+    size_t len = std::min(chunk, n - offset);
+    workers.emplace_back([this, d, s, offset, len]() {
+      copy_non_temporal(d + offset, s + offset, len);
+    });
+  }
+  copy_non_temporal(d, s, std::min(chunk, n));
+  // join() orders the workers' fenced stores before our return.
+  for (auto& worker : workers) worker.join();
+}
+
+}  // namespace adverbs
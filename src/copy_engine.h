@@ -0,0 +1,103 @@
+#ifndef ADVERBS_COPY_ENGINE_H
+#define ADVERBS_COPY_ENGINE_H
+
+#include <cstddef>
+#include <string_view>
+
+namespace adverbs {
+
+/**
+ * The instruction set a copy_engine streams with.
+ */
+enum class copy_isa {
+  // memcpy only.
+  scalar,
+  // 32-byte non-temporal stores (x86-64).
+  avx2,
+  // 64-byte non-temporal stores (x86-64).
+  avx512,
+  // 32-byte non-temporal store pairs (aarch64).
+  neon,
+};
+
+std::string_view copy_isa_name(copy_isa isa);
+
+struct copy_engine_options {
+  // Copies at least this long bypass the cache; shorter ones use memcpy,
+  // where the destination will likely still be cached when the NIC reads
+  // it.
+  size_t non_temporal_threshold = 256 * 1024;
+  // Copies at least this long are split across threads.
+  size_t parallel_threshold = 32 * 1024 * 1024;
+  // The most threads (including the caller) one copy uses.
+  size_t max_threads = 4;
+};
+
+/**
+ * Copies data into registered buffers for the NIC to DMA out.
+ *
+ * Staged data (eager sends, packed messages) is read by the device and never
+ * touched by the CPU again, so large copies use non-temporal stores which
+ * don't evict the working set from the LLC. The instruction set is chosen
+ * at runtime from the CPU's features.
+ *
+ * Every copy is complete and ordered (store-fenced) when copy() returns,
+ * so the WR posting it may follow directly.
+ *
+ * Example usage:
+ *
+ *     adverbs::copy_engine engine;
+ *     engine.copy(staging + offset, payload.data(), payload.size());
+ *     ibv_post_send(qp, &wr, &bad_wr);
+ */
+class copy_engine {
+ public:
+  /**
+   * Use the best instruction set the CPU supports.
+   */
+  explicit copy_engine(const copy_engine_options& options = {})
+      : copy_engine(detect(), options) {}
+
+  /**
+   * @throws std::invalid_argument if the CPU doesn't support isa.
+   */
+  copy_engine(copy_isa isa, const copy_engine_options& options = {});
+
+  /**
+   * The best instruction set this CPU supports.
+   */
+  static copy_isa detect();
+
+  static bool supported(copy_isa isa);
+
+  [[nodiscard]]
+  copy_isa isa() const {
+    return _isa;
+  }
+
+  [[nodiscard]]
+  const copy_engine_options& options() const {
+    return _options;
+  }
+
+  /**
+   * Copy n bytes, picking the store kind and thread count by size.
+   */
+  void copy(void* dst, const void* src, size_t n) const;
+
+  /**
+   * Copy n bytes with non-temporal stores on the calling thread, whatever
+   * the size.
+   */
+  void copy_non_temporal(void* dst, const void* src, size_t n) const;
+
+ private:
+  void copy_parallel(void* dst, const void* src, size_t n) const;
+
+  copy_isa _isa;
+  copy_engine_options _options;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_COPY_ENGINE_H
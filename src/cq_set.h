@@ -0,0 +1,197 @@
+#ifndef ADVERBS_CQ_SET_H
+#define ADVERBS_CQ_SET_H
+
+#include <infiniband/verbs.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace adverbs {
+
+enum class cq_priority {
+  // Polled once per round, and skipped for a while when found empty.
+  normal,
+  // Polled every round, and while busy between every normal CQ.
+  latency,
+};
+
+struct cq_set_options {
+  // Completions taken from a CQ per visit, so one busy CQ can't starve the
+  // rest.
+  int budget = 16;
+  int latency_budget = 16;
+  // A normal CQ found empty is skipped for 1, 2, 4, ... rounds, up to this
+  // many; 0 polls every CQ every round.
+  uint32_t max_idle_skip = 8;
+  // Rounds a latency CQ stays boosted after yielding completions.
+  uint32_t boost_rounds = 4;
+};
+
+/**
+ * Polls many CQs from one thread, fairly.
+ *
+ * Each round visits every CQ once, taking at most a budget of completions
+ * from each and starting one CQ further along than the last round, so no
+ * CQ is always served last. A normal CQ that turns up empty is skipped for
+ * an exponentially growing number of rounds (without calling
+ * ibv_poll_cq); wake() ends the skip early, e.g. after posting work that
+ * will complete on it. Latency CQs are never skipped; once one yields
+ * completions it is boosted for boost_rounds rounds, during which it is
+ * polled again after every normal CQ.
+ *
+ * Example usage:
+ *
+ *     adverbs::cq_set cqs;
+ *     cqs.add(control_cq.get(), adverbs::cq_priority::latency);
+ *     for (auto& cq : bulk_cqs) cqs.add(cq.get());
+ *     for (;;) {
+ *       cqs.poll([&](size_t cq, const struct ibv_wc& wc) {
+ *         // ...
+ *       });
+ *     }
+ */
+class cq_set {
+ public:
+  explicit cq_set(const cq_set_options& options = {}) : _options(options) {
+    if (options.budget <= 0 || options.latency_budget <= 0) {
+      throw std::invalid_argument("cq_set budgets must be positive");
+    }
+    _wc.resize(std::max(options.budget, options.latency_budget));
+  }
+
+  /**
+   * Add a CQ.
+   *
+   * @return Its index, passed to the poll() callback.
+   */
+  size_t add(struct ibv_cq* cq, cq_priority priority = cq_priority::normal) {
+    _entries.push_back({cq, priority});
+    return _entries.size() - 1;
+  }
+
+  /**
+   * End a CQ's idle skip, so the next round polls it.
+   */
+  void wake(size_t index) {
+    auto& e = _entries.at(index);
+    e.skip = 0;
+    e.idle_streak = 0;
+  }
+
+  /**
+   * Run one round.
+   *
+   * @param fn Called as fn(size_t index, const struct ibv_wc& wc) for each
+   *    completion.
+   * @return The number of completions delivered.
+   * @throws std::runtime_error if ibv_poll_cq fails.
+   */
+  template <typename F>
+  size_t poll(F&& fn) {
+    size_t delivered = 0;
+    size_t n = _entries.size();
+    bool boosted = false;
+    for (size_t i = 0; i < n; ++i) {
+      if (_entries[i].priority == cq_priority::latency) {
+        delivered += visit(i, fn);
+        boosted |= _entries[i].boost > 0;
+      }
+    }
+    for (size_t k = 0; k < n; ++k) {
+      size_t i = (_start + k) % n;
+      if (_entries[i].priority != cq_priority::normal) continue;
+      delivered += visit(i, fn);
+      if (!boosted) continue;
+      for (size_t j = 0; j < n; ++j) {
+        if (_entries[j].boost) delivered += visit(j, fn);
+      }
+    }
+    for (auto& e : _entries) {
+      if (e.boost) --e.boost;
+    }
+    if (n) _start = (_start + 1) % n;
+    return delivered;
+  }
+
+  [[nodiscard]]
+  size_t size() const {
+    return _entries.size();
+  }
+
+  /**
+   * Whether a CQ is currently being skipped as idle.
+   */
+  [[nodiscard]]
+  bool idle(size_t index) const {
+    return _entries.at(index).skip > 0;
+  }
+
+  /**
+   * Whether a latency CQ is currently boosted.
+   */
+  [[nodiscard]]
+  bool boosted(size_t index) const {
+    return _entries.at(index).boost > 0;
+  }
+
+  /**
+   * The completions delivered from a CQ so far.
+   */
+  [[nodiscard]]
+  uint64_t completions(size_t index) const {
+    return _entries.at(index).completions;
+  }
+
+ private:
+  struct entry {
+    struct ibv_cq* cq;
+    cq_priority priority;
+    // Rounds left to skip, and consecutive empty polls.
+    uint32_t skip = 0;
+    uint32_t idle_streak = 0;
+    // Rounds left boosted.
+    uint32_t boost = 0;
+    uint64_t completions = 0;
+  };
+
+  template <typename F>
+  size_t visit(size_t i, F& fn) {
+    entry& e = _entries[i];
+    if (e.skip) {
+      --e.skip;
+      return 0;
+    }
+    bool latency = e.priority == cq_priority::latency;
+    int budget = latency ? _options.latency_budget : _options.budget;
+    int n = ibv_poll_cq(e.cq, budget, _wc.data());
+    if (n < 0) {
+      throw std::runtime_error("ibv_poll_cq failed");
+    }
+    if (n == 0) {
+      if (!latency && _options.max_idle_skip) {
+        uint32_t skip = 1u << std::min<uint32_t>(e.idle_streak, 31);
+        e.skip = std::min(skip, _options.max_idle_skip);
+        ++e.idle_streak;
+      }
+      return 0;
+    }
+    e.idle_streak = 0;
+    // +1: this round's decrement leaves boost_rounds full rounds.
+    if (latency && _options.boost_rounds) e.boost = _options.boost_rounds + 1;
+    e.completions += n;
+    for (int k = 0; k < n; ++k) fn(i, _wc[k]);
+    return n;
+  }
+
+  cq_set_options _options;
+  std::vector<entry> _entries;
+  std::vector<struct ibv_wc> _wc;
+  size_t _start = 0;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_CQ_SET_H
@@ -0,0 +1,76 @@
+#include "cq_waiter.h"
+
+#include <poll.h>
+
+#include <cerrno>
+#include <stdexcept>
+
+namespace adverbs {
+
+struct ibv_cq* get_cq_event(struct ibv_comp_channel* channel) {
+  struct ibv_cq* cq = nullptr;
+  void* context = nullptr;
+  if (ibv_get_cq_event(channel, &cq, &context)) {
+    throw std::runtime_error("ibv_get_cq_event failed");
+  }
+  return cq;
+}
+
+cq_waiter::~cq_waiter() {
+  if (_unacked) ibv_ack_cq_events(_cq, _unacked);
+}
+
+int cq_waiter::poll(std::span<struct ibv_wc> wc) {
+  int n = ibv_poll_cq(_cq, (int)wc.size(), wc.data());
+  if (n < 0) {
+    throw std::runtime_error("ibv_poll_cq failed");
+  }
+  return n;
+}
+
+bool cq_waiter::next_event(int timeout_ms) {
+  struct pollfd pfd = {_channel->fd, POLLIN, 0};
+  int ready;
+  do {
+    ready = ::poll(&pfd, 1, timeout_ms);
+  } while (ready < 0 && errno == EINTR);
+  if (ready < 0) {
+    throw std::runtime_error("poll on completion channel failed");
+  }
+  if (ready == 0) return false;
+
+  struct ibv_cq* cq = _get_event(_channel);
+  ++_events;
+  if (cq != _cq) {
+    // Not ours; acknowledge it so its CQ can still be destroyed.
+    ibv_ack_cq_events(cq, 1);
+    return true;
+  }
+  if (++_unacked >= _options.ack_batch) {
+    ibv_ack_cq_events(_cq, _unacked);
+    _unacked = 0;
+  }
+  // An event disarms the CQ.
+  _armed = false;
+  return true;
+}
+
+int cq_waiter::wait(std::span<struct ibv_wc> wc, int timeout_ms) {
+  for (;;) {
+    int n = poll(wc);
+    if (n) return n;
+    if (!_armed) {
+      if (ibv_req_notify_cq(_cq, _options.solicited_only)) {
+        throw std::runtime_error("ibv_req_notify_cq failed");
+      }
+      _armed = true;
+      // Completions that landed before arming raise no event.
+      n = poll(wc);
+      if (n) return n;
+    }
+    ++_sleeps;
+    if (!next_event(timeout_ms)) return 0;
+  }
+}
+
+}  // namespace adverbs
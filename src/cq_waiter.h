@@ -0,0 +1,136 @@
+#ifndef ADVERBS_CQ_WAITER_H
+#define ADVERBS_CQ_WAITER_H
+
+#include <infiniband/verbs.h>
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <utility>
+
+namespace adverbs {
+
+struct cq_waiter_options {
+  // Sleep until a solicited completion (a receive whose sender set
+  // IBV_SEND_SOLICITED) rather than until any completion.
+  bool solicited_only = true;
+  // Events are acknowledged in batches of this many; each ack takes the
+  // CQ's lock.
+  unsigned int ack_batch = 64;
+};
+
+/**
+ * Takes the next event off a completion channel and returns its CQ.
+ */
+using cq_event_fn = std::function<struct ibv_cq*(struct ibv_comp_channel*)>;
+
+/**
+ * Calls ibv_get_cq_event.
+ *
+ * @throws std::runtime_error if ibv_get_cq_event fails.
+ */
+struct ibv_cq* get_cq_event(struct ibv_comp_channel* channel);
+
+/**
+ * Event-driven completion polling: returns ready completions at once, and
+ * otherwise sleeps on the CQ's completion channel until an event.
+ *
+ * With solicited_only, the CQ is armed with ibv_req_notify_cq(cq, 1), so
+ * bulk traffic sent without IBV_SEND_SOLICITED completes silently into the
+ * CQ and the receiver sleeps on. Senders mark what the receiver should
+ * wake for, such as control messages and the last message of a batch; the
+ * wakeup then drains the bulk completions that queued up before it. The
+ * CQ must be deep enough to hold them.
+ *
+ * The channel must serve only this CQ. The waiter has to be destroyed
+ * before the CQ, since ibv_destroy_cq waits for every event to be
+ * acknowledged.
+ *
+ * Example usage:
+ *
+ *     adverbs::completion_channel_handle channel(context);
+ *     adverbs::completion_queue_handle cq(context, 4096, channel);
+ *     adverbs::cq_waiter waiter(cq.get(), channel.get());
+ *     struct ibv_wc wc[32];
+ *     for (;;) {
+ *       int n = waiter.wait(wc);
+ *       // ...
+ *     }
+ *
+ *     // Sender: bulk writes unsolicited, the final one solicited.
+ *     batch.post(true);
+ */
+class cq_waiter {
+ public:
+  /**
+   * @param cq The CQ, created with channel.
+   * @param channel Its completion channel.
+   * @param get_event Takes an event off the channel once its fd is
+   *    readable; tests substitute one that needs no device.
+   */
+  cq_waiter(
+      struct ibv_cq* cq,
+      struct ibv_comp_channel* channel,
+      const cq_waiter_options& options = {},
+      cq_event_fn get_event = get_cq_event)
+      : _cq(cq),
+        _channel(channel),
+        _options(options),
+        _get_event(std::move(get_event)) {}
+
+  /**
+   * Acknowledges outstanding events.
+   */
+  ~cq_waiter();
+
+  cq_waiter(const cq_waiter&) = delete;
+  cq_waiter& operator=(const cq_waiter&) = delete;
+
+  /**
+   * Poll up to wc.size() completions, sleeping until an event if none are
+   * ready.
+   *
+   * @param wc Receives the completions.
+   * @param timeout_ms How long each sleep lasts at most; -1 waits
+   *    indefinitely.
+   * @return The number of completions; 0 only on timeout.
+   * @throws std::runtime_error if polling, arming or reading the channel
+   *    fails.
+   */
+  int wait(std::span<struct ibv_wc> wc, int timeout_ms = -1);
+
+  /**
+   * Times wait() had to sleep.
+   */
+  [[nodiscard]]
+  uint64_t sleeps() const {
+    return _sleeps;
+  }
+
+  /**
+   * Events received from the channel.
+   */
+  [[nodiscard]]
+  uint64_t events() const {
+    return _events;
+  }
+
+ private:
+  int poll(std::span<struct ibv_wc> wc);
+
+  // Take one event off the channel, waiting at most timeout_ms.
+  bool next_event(int timeout_ms);
+
+  struct ibv_cq* _cq;
+  struct ibv_comp_channel* _channel;
+  cq_waiter_options _options;
+  cq_event_fn _get_event;
+  bool _armed = false;
+  unsigned int _unacked = 0;
+  uint64_t _sleeps = 0;
+  uint64_t _events = 0;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_CQ_WAITER_H
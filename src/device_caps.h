@@ -0,0 +1,183 @@
+#ifndef ADVERBS_DEVICE_CAPS_H
+#define ADVERBS_DEVICE_CAPS_H
+
+#include <infiniband/verbs.h>
+
+#include <cstdint>
+
+namespace adverbs {
+
+/**
+ * A device's extended capabilities, distilled from ibv_query_device_ex, for
+ * picking fast paths at runtime.
+ *
+ * Fields a device (or an older kernel) doesn't report are zero, which
+ * always reads as "not supported".
+ *
+ * Example usage:
+ *
+ *     const auto& caps = context.caps();
+ *     int access = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE;
+ *     if (caps.odp_supports(IBV_QPT_RC, IBV_ODP_SUPPORT_WRITE)) {
+ *       access |= IBV_ACCESS_ON_DEMAND;
+ *     }
+ */
+struct device_caps {
+  // Limits from the legacy attributes.
+  uint32_t max_qp = 0;
+  uint32_t max_qp_wr = 0;
+  uint32_t max_sge = 0;
+  uint32_t max_cqe = 0;
+  uint64_t max_mr_size = 0;
+  uint32_t max_qp_rd_atom = 0;
+  uint32_t max_qp_init_rd_atom = 0;
+  enum ibv_atomic_cap atomic_cap = IBV_ATOMIC_NONE;
+  uint32_t phys_port_cnt = 0;
+  uint64_t device_cap_flags = 0;
+
+  // On-demand paging: ibv_odp_general_caps and, per transport,
+  // ibv_odp_transport_cap_bits.
+  uint64_t odp_general = 0;
+  uint32_t odp_rc = 0;
+  uint32_t odp_uc = 0;
+  uint32_t odp_ud = 0;
+
+  // Completion timestamps: the valid bits of a timestamp and the rate the
+  // HCA clock runs at, in kHz.
+  uint64_t completion_timestamp_mask = 0;
+  uint64_t hca_core_clock = 0;
+
+  // Per-QP rate limiting, in kbps, and the QP types it applies to (a mask
+  // of 1 << ibv_qp_type).
+  uint32_t rate_limit_min = 0;
+  uint32_t rate_limit_max = 0;
+  uint32_t rate_limit_qpts = 0;
+
+  // TCP segmentation offload on raw packet QPs.
+  uint32_t max_tso = 0;
+  uint32_t tso_qpts = 0;
+
+  // Receive-side scaling.
+  uint32_t rss_qpts = 0;
+  uint32_t max_rwq_indirection_tables = 0;
+  uint32_t max_rwq_indirection_table_size = 0;
+  uint64_t rx_hash_fields_mask = 0;
+
+  // On-device memory for ibv_alloc_dm, in bytes.
+  uint64_t max_dm_size = 0;
+
+  /**
+   * Extract the capabilities from the extended attributes.
+   */
+  static device_caps from(const struct ibv_device_attr_ex& attr) {
+    device_caps caps;
+    const auto& orig = attr.orig_attr;
+    caps.max_qp = orig.max_qp;
+    caps.max_qp_wr = orig.max_qp_wr;
+    caps.max_sge = orig.max_sge;
+    caps.max_cqe = orig.max_cqe;
+    caps.max_mr_size = orig.max_mr_size;
+    caps.max_qp_rd_atom = orig.max_qp_rd_atom;
+    caps.max_qp_init_rd_atom = orig.max_qp_init_rd_atom;
+    caps.atomic_cap = orig.atomic_cap;
+    caps.phys_port_cnt = orig.phys_port_cnt;
+    caps.device_cap_flags = orig.device_cap_flags | attr.device_cap_flags_ex;
+
+    caps.odp_general = attr.odp_caps.general_caps;
+    caps.odp_rc = attr.odp_caps.per_transport_caps.rc_odp_caps;
+    caps.odp_uc = attr.odp_caps.per_transport_caps.uc_odp_caps;
+    caps.odp_ud = attr.odp_caps.per_transport_caps.ud_odp_caps;
+
+    caps.completion_timestamp_mask = attr.completion_timestamp_mask;
+    caps.hca_core_clock = attr.hca_core_clock;
+
+    caps.rate_limit_min = attr.packet_pacing_caps.qp_rate_limit_min;
+    caps.rate_limit_max = attr.packet_pacing_caps.qp_rate_limit_max;
+    caps.rate_limit_qpts = attr.packet_pacing_caps.supported_qpts;
+
+    caps.max_tso = attr.tso_caps.max_tso;
+    caps.tso_qpts = attr.tso_caps.supported_qpts;
+
+    caps.rss_qpts = attr.rss_caps.supported_qpts;
+    caps.max_rwq_indirection_tables = attr.rss_caps.max_rwq_indirection_tables;
+    caps.max_rwq_indirection_table_size =
+        attr.rss_caps.max_rwq_indirection_table_size;
+    caps.rx_hash_fields_mask = attr.rss_caps.rx_hash_fields_mask;
+
+    caps.max_dm_size = attr.max_dm_size;
+    return caps;
+  }
+
+  /**
+   * Whether memory may be registered with IBV_ACCESS_ON_DEMAND at all.
+   */
+  [[nodiscard]]
+  bool odp() const {
+    return odp_general & IBV_ODP_SUPPORT;
+  }
+
+  /**
+   * Whether the whole address space can be registered on demand
+   * (ibv_reg_mr(pd, nullptr, SIZE_MAX, IBV_ACCESS_ON_DEMAND)).
+   */
+  [[nodiscard]]
+  bool odp_implicit() const {
+    return odp_general & IBV_ODP_SUPPORT_IMPLICIT;
+  }
+
+  /**
+   * Whether on-demand paging covers an operation on a transport.
+   *
+   * @param type IBV_QPT_RC, IBV_QPT_UC or IBV_QPT_UD.
+   * @param bits ibv_odp_transport_cap_bits, all of which must be supported.
+   */
+  [[nodiscard]]
+  bool odp_supports(enum ibv_qp_type type, uint32_t bits) const {
+    if (!odp()) return false;
+    uint32_t caps = type == IBV_QPT_RC   ? odp_rc
+                    : type == IBV_QPT_UC ? odp_uc
+                    : type == IBV_QPT_UD ? odp_ud
+                                         : 0;
+    return (caps & bits) == bits;
+  }
+
+  /**
+   * Whether completions can carry HCA timestamps that convert to time.
+   */
+  [[nodiscard]]
+  bool completion_timestamps() const {
+    return completion_timestamp_mask != 0 && hca_core_clock != 0;
+  }
+
+  /**
+   * Whether QPs of a type can be rate limited (IBV_QP_RATE_LIMIT).
+   */
+  [[nodiscard]]
+  bool rate_limit(enum ibv_qp_type type) const {
+    return rate_limit_max != 0 && (rate_limit_qpts >> type & 1);
+  }
+
+  [[nodiscard]]
+  bool tso(enum ibv_qp_type type) const {
+    return max_tso != 0 && (tso_qpts >> type & 1);
+  }
+
+  [[nodiscard]]
+  bool rss(enum ibv_qp_type type) const {
+    return max_rwq_indirection_table_size != 0 && (rss_qpts >> type & 1);
+  }
+
+  [[nodiscard]]
+  bool device_memory() const {
+    return max_dm_size != 0;
+  }
+
+  [[nodiscard]]
+  bool has_flag(uint64_t flag) const {
+    return (device_cap_flags & flag) == flag;
+  }
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_DEVICE_CAPS_H
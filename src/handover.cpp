@@ -0,0 +1,347 @@
+#include "handover.h"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace adverbs {
+
+namespace {
+
+constexpr uint32_t handover_magic = 0x41445648;  // "ADVH"
+constexpr uint32_t handover_version = 1;
+constexpr uint8_t handover_ack = 0x06;
+// Linux's SCM_MAX_FD.
+constexpr size_t max_fds = 253;
+
+struct wire_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t pds;
+  uint32_t mrs;
+  uint32_t regions;
+  uint32_t qps;
+  uint64_t app_state;
+};
+
+struct wire_region {
+  uint64_t addr;
+  uint64_t length;
+};
+
+static_assert(std::is_trivially_copyable_v<handover_mr>);
+static_assert(std::is_trivially_copyable_v<handover_qp>);
+
+// Closes the fds it still holds.
+class owned_fds {
+ public:
+  explicit owned_fds(std::vector<int> fds) : _fds(std::move(fds)) {}
+
+  ~owned_fds() {
+    for (int fd : _fds) {
+      if (fd >= 0) ::close(fd);
+    }
+  }
+
+  owned_fds(const owned_fds&) = delete;
+  owned_fds& operator=(const owned_fds&) = delete;
+
+  int get(size_t i) const { return _fds[i]; }
+
+  // Hand fd i to a new owner.
+  int release(size_t i) { return std::exchange(_fds[i], -1); }
+
+ private:
+  std::vector<int> _fds;
+};
+
+[[noreturn]] void fail(const std::string& what) {
+  throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+void write_all(int fd, const void* data, size_t length) {
+  auto* p = static_cast<const char*>(data);
+  while (length) {
+    ssize_t n = ::send(fd, p, length, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      fail("handover send failed");
+    }
+    p += n;
+    length -= n;
+  }
+}
+
+void read_all(int fd, void* data, size_t length) {
+  auto* p = static_cast<char*>(data);
+  while (length) {
+    ssize_t n = ::recv(fd, p, length, 0);
+    if (n == 0) throw std::runtime_error("handover connection closed");
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      fail("handover recv failed");
+    }
+    p += n;
+    length -= n;
+  }
+}
+
+template <typename T>
+void write_vector(int fd, const std::vector<T>& v) {
+  if (!v.empty()) write_all(fd, v.data(), v.size() * sizeof(T));
+}
+
+template <typename T>
+void read_vector(int fd, std::vector<T>& v, size_t n) {
+  v.resize(n);
+  if (n) read_all(fd, v.data(), n * sizeof(T));
+}
+
+sockaddr_un unix_address(const std::string& path) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw std::invalid_argument("handover socket path too long: " + path);
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return addr;
+}
+
+}  // namespace
+
+mapped_region::mapped_region(const handover_region& region)
+    : _length(region.length), _fd(region.fd) {
+  _data = mmap(
+      reinterpret_cast<void*>((uintptr_t)region.addr),
+      region.length,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_FIXED_NOREPLACE,
+      region.fd,
+      0);
+  if (_data == MAP_FAILED) {
+    ::close(_fd);
+    fail("handover region mmap failed");
+  }
+  if (_data != reinterpret_cast<void*>((uintptr_t)region.addr)) {
+    // Kernels before 4.17 treat MAP_FIXED_NOREPLACE as a hint.
+    munmap(_data, _length);
+    ::close(_fd);
+    throw std::runtime_error("handover region address is taken");
+  }
+}
+
+mapped_region::mapped_region(mapped_region&& other) noexcept
+    : _data(other._data), _length(other._length), _fd(other._fd) {
+  other._data = nullptr;
+  other._fd = -1;
+}
+
+mapped_region::~mapped_region() {
+  if (_data) munmap(_data, _length);
+  if (_fd >= 0) ::close(_fd);
+}
+
+int handover_listen(const std::string& path) {
+  sockaddr_un addr = unix_address(path);
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) fail("handover socket failed");
+  ::unlink(path.c_str());
+  if (::bind(fd, (sockaddr*)&addr, sizeof(addr)) || ::listen(fd, 1)) {
+    int saved = errno;
+    ::close(fd);
+    errno = saved;
+    fail("handover bind failed for " + path);
+  }
+  return fd;
+}
+
+int handover_connect(const std::string& path) {
+  sockaddr_un addr = unix_address(path);
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) fail("handover socket failed");
+  if (::connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+    int saved = errno;
+    ::close(fd);
+    errno = saved;
+    fail("handover connect failed for " + path);
+  }
+  return fd;
+}
+
+void send_handover(int socket, const handover_message& message) {
+  std::vector<int> fds = {message.cmd_fd};
+  for (const auto& region : message.regions) fds.push_back(region.fd);
+  if (fds.size() > max_fds) {
+    throw std::invalid_argument("handover: too many regions");
+  }
+
+  wire_header header = {
+      handover_magic,
+      handover_version,
+      (uint32_t)message.pds.size(),
+      (uint32_t)message.mrs.size(),
+      (uint32_t)message.regions.size(),
+      (uint32_t)message.qps.size(),
+      message.app_state.size()};
+
+  // The header carries the fds; the rest streams after it.
+  std::vector<char> control(CMSG_SPACE(fds.size() * sizeof(int)));
+  iovec iov = {&header, sizeof(header)};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), fds.data(), fds.size() * sizeof(int));
+  ssize_t sent;
+  do {
+    sent = ::sendmsg(socket, &msg, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  if (sent < 0) fail("handover sendmsg failed");
+  if ((size_t)sent < sizeof(header)) {
+    write_all(
+        socket,
+        reinterpret_cast<const char*>(&header) + sent,
+        sizeof(header) - sent);
+  }
+
+  write_vector(socket, message.pds);
+  write_vector(socket, message.mrs);
+  std::vector<wire_region> regions;
+  for (const auto& region : message.regions) {
+    regions.push_back({region.addr, region.length});
+  }
+  write_vector(socket, regions);
+  write_vector(socket, message.qps);
+  write_vector(socket, message.app_state);
+
+  uint8_t ack = 0;
+  read_all(socket, &ack, 1);
+  if (ack != handover_ack) {
+    throw std::runtime_error("handover: bad acknowledgement");
+  }
+}
+
+handover_message receive_handover(int socket) {
+  wire_header header = {};
+  std::vector<char> control(CMSG_SPACE(max_fds * sizeof(int)));
+  iovec iov = {&header, sizeof(header)};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+  ssize_t received;
+  do {
+    received = ::recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+  if (received < 0) fail("handover recvmsg failed");
+  if (received == 0) throw std::runtime_error("handover connection closed");
+
+  std::vector<int> fds;
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+    size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    size_t first = fds.size();
+    fds.resize(first + n);
+    std::memcpy(&fds[first], CMSG_DATA(cmsg), n * sizeof(int));
+  }
+  auto close_fds = [&]() {
+    for (int fd : fds) ::close(fd);
+  };
+
+  try {
+    if ((size_t)received < sizeof(header)) {
+      read_all(
+          socket,
+          reinterpret_cast<char*>(&header) + received,
+          sizeof(header) - received);
+    }
+    if (header.magic != handover_magic ||
+        header.version != handover_version) {
+      throw std::runtime_error("handover: not a handover message");
+    }
+    if (msg.msg_flags & MSG_CTRUNC || fds.size() != header.regions + 1) {
+      throw std::runtime_error("handover: file descriptors lost in transit");
+    }
+
+    handover_message message;
+    message.cmd_fd = fds[0];
+    read_vector(socket, message.pds, header.pds);
+    read_vector(socket, message.mrs, header.mrs);
+    std::vector<wire_region> regions;
+    read_vector(socket, regions, header.regions);
+    for (size_t i = 0; i < regions.size(); ++i) {
+      message.regions.push_back(
+          {fds[i + 1], regions[i].addr, regions[i].length});
+    }
+    read_vector(socket, message.qps, header.qps);
+    read_vector(socket, message.app_state, header.app_state);
+    for (const auto& mr : message.mrs) {
+      if (mr.pd >= message.pds.size()) {
+        throw std::runtime_error("handover: MR refers to an unknown PD");
+      }
+    }
+    return message;
+  } catch (...) {
+    close_fds();
+    throw;
+  }
+}
+
+handover_state import_handover(int socket, const handover_message& message) {
+  // Every received fd is closed if any step fails before its new owner
+  // has it.
+  std::vector<int> received{message.cmd_fd};
+  for (const auto& region : message.regions) received.push_back(region.fd);
+  owned_fds fds(std::move(received));
+
+  // Map the regions first: an imported MR's memory must be where the
+  // exporter registered it.
+  std::vector<mapped_region> regions;
+  regions.reserve(message.regions.size());
+  for (size_t i = 0; i < message.regions.size(); ++i) {
+    handover_region region = message.regions[i];
+    // The mapping owns the fd from here, even if it throws.
+    region.fd = fds.release(i + 1);
+    regions.emplace_back(region);
+  }
+
+  context_handle context = context_handle::import(fds.get(0));
+  fds.release(0);
+  std::vector<protection_domain_handle> pds;
+  for (uint32_t handle : message.pds) {
+    pds.push_back(protection_domain_handle::import(context, handle));
+  }
+  std::vector<memory_region_handle> mrs;
+  for (const auto& mr : message.mrs) {
+    mrs.push_back(memory_region_handle::import(pds[mr.pd], mr.handle));
+  }
+  handover_state state{
+      std::move(context),
+      std::move(pds),
+      std::move(mrs),
+      std::move(regions),
+      message.qps,
+      message.app_state};
+
+  write_all(socket, &handover_ack, 1);
+  return state;
+}
+
+}  // namespace adverbs
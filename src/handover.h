@@ -0,0 +1,196 @@
+#ifndef ADVERBS_HANDOVER_H
+#define ADVERBS_HANDOVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "adverbs.h"
+
+namespace adverbs {
+
+/**
+ * Shared memory backing registered regions: a memfd (or other mappable fd)
+ * mapped at addr in the exporting process.
+ */
+struct handover_region {
+  int fd = -1;
+  uint64_t addr = 0;
+  uint64_t length = 0;
+};
+
+/**
+ * A memory region to re-import, by its PD's index in the message.
+ */
+struct handover_mr {
+  uint32_t pd = 0;
+  uint32_t handle = 0;
+  uint64_t addr = 0;
+  uint64_t length = 0;
+};
+
+/**
+ * What a successor needs to re-establish one connection: the local QP's
+ * numbers and its peer's address. user carries an application tag.
+ */
+struct handover_qp {
+  uint32_t qp_num = 0;
+  uint32_t remote_qp_num = 0;
+  uint32_t sq_psn = 0;
+  uint32_t rq_psn = 0;
+  uint16_t remote_lid = 0;
+  uint8_t port = 1;
+  uint8_t gid_index = 0;
+  uint8_t remote_gid[16] = {};
+  uint64_t user = 0;
+};
+
+/**
+ * Everything handed from a running process to its successor.
+ *
+ * The device context, PDs and MRs are shared through ibv_import_*: the
+ * successor keeps using the same registrations, so nothing is
+ * re-registered and the rkeys peers hold stay valid. Registered memory must
+ * be shared (e.g. a memfd) so the successor can map it where it was
+ * registered. Verbs has no QP import, so QPs travel as handover_qp records
+ * from which the successor re-connects.
+ *
+ * cmd_fd and the region fds travel as SCM_RIGHTS; the rest as plain data.
+ *
+ * Example usage:
+ *
+ *     // The running process, once a successor connects:
+ *     adverbs::handover_message message;
+ *     message.cmd_fd = context.get()->cmd_fd;
+ *     message.add_mr(message.add_pd(pd), mr);
+ *     message.regions.push_back({memfd, addr, length});
+ *     adverbs::send_handover(accept(listener, nullptr, nullptr), message);
+ *     _exit(0);
+ *
+ *     // The successor:
+ *     int socket = adverbs::handover_connect(path);
+ *     auto state =
+ *         adverbs::import_handover(socket, adverbs::receive_handover(socket));
+ */
+struct handover_message {
+  // The exported context's cmd_fd (context.get()->cmd_fd); on the receiving
+  // side, owned by the context import_handover() creates.
+  int cmd_fd = -1;
+  std::vector<uint32_t> pds;
+  std::vector<handover_mr> mrs;
+  std::vector<handover_region> regions;
+  std::vector<handover_qp> qps;
+  std::vector<std::byte> app_state;
+
+  /**
+   * Add a PD of the exported context.
+   *
+   * @return The PD's index, for add_mr().
+   */
+  uint32_t add_pd(protection_domain_handle& pd) {
+    pds.push_back(pd.get()->handle);
+    return (uint32_t)pds.size() - 1;
+  }
+
+  void add_mr(uint32_t pd, memory_region_handle& mr) {
+    mrs.push_back(
+        {pd, mr.get()->handle, (uint64_t)(uintptr_t)mr.addr(), mr.length()});
+  }
+};
+
+/**
+ * An RAII shared mapping of a handed-over region, at its original address.
+ */
+class mapped_region {
+ public:
+  /**
+   * Map region.fd at region.addr, which must be free in this process.
+   * Takes ownership of region.fd.
+   *
+   * @throws std::runtime_error if the mapping fails or the address is taken.
+   */
+  explicit mapped_region(const handover_region& region);
+
+  ~mapped_region();
+
+  mapped_region(mapped_region&& other) noexcept;
+  mapped_region& operator=(mapped_region&&) = delete;
+  mapped_region(const mapped_region&) = delete;
+
+  [[nodiscard]]
+  void* data() const {
+    return _data;
+  }
+
+  [[nodiscard]]
+  size_t length() const {
+    return _length;
+  }
+
+ private:
+  void* _data;
+  size_t _length;
+  int _fd;
+};
+
+/**
+ * The successor's view of a handed-over process.
+ */
+struct handover_state {
+  context_handle context;
+  std::vector<protection_domain_handle> pds;
+  std::vector<memory_region_handle> mrs;
+  std::vector<mapped_region> regions;
+  std::vector<handover_qp> qps;
+  std::vector<std::byte> app_state;
+};
+
+/**
+ * Listen for a successor on a Unix socket.
+ *
+ * @throws std::runtime_error if the socket can't be bound.
+ */
+int handover_listen(const std::string& path);
+
+/**
+ * Connect to a running predecessor's Unix socket.
+ *
+ * @throws std::runtime_error if the connection fails.
+ */
+int handover_connect(const std::string& path);
+
+/**
+ * Send a handover and wait for the successor to acknowledge it.
+ *
+ * Once this returns the successor owns the shared objects: the caller must
+ * stop using them and exit without destroying them (e.g. _exit()), since
+ * deallocating a PD or MR would destroy it for the successor too.
+ *
+ * @throws std::runtime_error on a socket error or a missing acknowledgement.
+ */
+void send_handover(int socket, const handover_message& message);
+
+/**
+ * Receive a handover message. Received fds are owned by the caller (or by
+ * import_handover()). Does not acknowledge; see import_handover().
+ *
+ * @throws std::runtime_error on a socket or protocol error.
+ */
+handover_message receive_handover(int socket);
+
+/**
+ * Import a received handover: the device context, its PDs and MRs, and the
+ * regions backing them mapped at their original addresses. Acknowledges
+ * the handover on socket once everything is imported.
+ *
+ * Takes ownership of the message's fds; if the import fails they are
+ * closed.
+ *
+ * @throws std::runtime_error if any import fails; nothing is acknowledged.
+ */
+handover_state import_handover(int socket, const handover_message& message);
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_HANDOVER_H
@@ -0,0 +1,199 @@
+#ifndef ADVERBS_IDLE_STRATEGY_H
+#define ADVERBS_IDLE_STRATEGY_H
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace adverbs {
+
+/**
+ * Hint to the CPU that we are in a spin-wait loop.
+ * Emits `pause` on x86 and `yield` on aarch64.
+ */
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#else
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/**
+ * Exponential `pause` backoff for spin-wait loops.
+ *
+ * Each call to idle() spins for the current number of pauses and then
+ * doubles it, up to max_spins. Call reset() after useful work was found.
+ */
+class pause_backoff {
+ public:
+  explicit pause_backoff(uint32_t max_spins = 1024) : _max_spins(max_spins) {}
+
+  void idle() {
+    for (uint32_t i = 0; i < _spins; ++i) cpu_relax();
+    if (_spins < _max_spins) _spins <<= 1;
+  }
+
+  void reset() { _spins = 1; }
+
+  [[nodiscard]]
+  uint32_t spins() const {
+    return _spins;
+  }
+
+  [[nodiscard]]
+  bool saturated() const {
+    return _spins >= _max_spins;
+  }
+
+ private:
+  uint32_t _max_spins;
+  uint32_t _spins = 1;
+};
+
+/**
+ * Whether the CPU supports UMONITOR, UMWAIT and TPAUSE (CPUID.7.0:ECX[5]).
+ */
+inline bool cpu_has_waitpkg() {
+#if defined(__x86_64__)
+  static const bool supported = []() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    return (ecx & (1u << 5)) != 0;
+  }();
+  return supported;
+#else
+  return false;
+#endif
+}
+
+/**
+ * How an idle_strategy sleeps once its `pause` phase is exhausted.
+ */
+enum class idle_mode {
+  // Keep spinning with exponential `pause` backoff.
+  pause,
+  // UMWAIT on the polled cache line, or TPAUSE when there is none.
+  waitpkg,
+};
+
+struct idle_options {
+  // Maximum pauses per backoff step; sleeping starts once it is reached.
+  uint32_t max_spins = 64;
+  // Upper bound on one TPAUSE/UMWAIT, in TSC cycles. Keeps the wake-up
+  // latency bounded even if a monitored write is missed.
+  uint64_t max_wait_cycles = 2000;
+  // Allow the deeper C0.2 state; C0.1 wakes faster and is the default.
+  bool allow_c02 = false;
+  // Use the wait instructions when the CPU supports them.
+  bool use_waitpkg = true;
+};
+
+/**
+ * Power-aware idle strategy for pollers.
+ *
+ * After a short exponential `pause` phase the poller drops into the
+ * C0.1 (or C0.2) light sleep state with UMWAIT on the polled cache line, or
+ * TPAUSE when there is no single line to watch. On CPUs without WAITPKG it
+ * keeps backing off with `pause`. Every sleep is bounded by max_wait_cycles,
+ * so wake-up latency stays sub-microsecond.
+ *
+ * Example usage:
+ *
+ *     adverbs::idle_strategy idle;
+ *     while (!ready(flag)) {
+ *       idle.idle(&flag, [&] { return ready(flag); });
+ *     }
+ *     idle.reset();
+ */
+class idle_strategy {
+ public:
+  explicit idle_strategy(idle_options options = {})
+      : _options(options),
+        _backoff(options.max_spins),
+        _mode(
+            options.use_waitpkg && cpu_has_waitpkg() ? idle_mode::waitpkg
+                                                     : idle_mode::pause) {}
+
+  [[nodiscard]]
+  idle_mode mode() const {
+    return _mode;
+  }
+
+  /**
+   * Idle once, with no address to monitor.
+   */
+  void idle() {
+    if (!_backoff.saturated() || _mode == idle_mode::pause) {
+      _backoff.idle();
+      return;
+    }
+    tpause();
+  }
+
+  /**
+   * Idle once, waking early if the cache line holding addr is written.
+   *
+   * The monitor is armed before ready() is re-checked, so a write that
+   * lands between the caller's last check and the wait is not lost.
+   *
+   * @param addr The address being polled.
+   * @param ready Re-checks the polled condition after arming the monitor.
+   */
+  template <typename Ready>
+  void idle(const void* addr, Ready&& ready) {
+    if (!_backoff.saturated() || _mode == idle_mode::pause) {
+      _backoff.idle();
+      return;
+    }
+    umwait(addr, ready);
+  }
+
+  /**
+   * Return to the spinning phase; call after useful work was found.
+   */
+  void reset() { _backoff.reset(); }
+
+ private:
+  [[nodiscard]]
+  unsigned control() const {
+    // Bit 0 clear selects C0.2, set selects C0.1.
+    return _options.allow_c02 ? 0 : 1;
+  }
+
+#if defined(__x86_64__)
+  __attribute__((target("waitpkg"))) void tpause() {
+    _tpause(control(), __rdtsc() + _options.max_wait_cycles);
+  }
+
+  template <typename Ready>
+  __attribute__((target("waitpkg"))) void umwait(
+      const void* addr,
+      Ready& ready) {
+    _umonitor(const_cast<void*>(addr));
+    if (ready()) return;
+    _umwait(control(), __rdtsc() + _options.max_wait_cycles);
+  }
+#else
+  void tpause() { _backoff.idle(); }
+
+  template <typename Ready>
+  void umwait(const void*, Ready&) {
+    _backoff.idle();
+  }
+#endif
+
+  idle_options _options;
+  pause_backoff _backoff;
+  idle_mode _mode;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_IDLE_STRATEGY_H
@@ -0,0 +1,248 @@
+#ifndef ADVERBS_LAST_BYTE_POLLER_H
+#define ADVERBS_LAST_BYTE_POLLER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+
+#include "idle_strategy.h"
+
+namespace adverbs {
+
+/**
+ * Footer stamped into the last 16 bytes of every message slot.
+ *
+ * `seq` is the very last word of the slot; it is the "last byte" the
+ * receiver polls on. Message n (counting from 0) carries seq n + 1, so
+ * zeroed memory and stale slots from a previous lap never look ready.
+ */
+struct slot_footer {
+  uint64_t length;
+  uint64_t seq;
+};
+
+/**
+ * Receiver for one-sided (RDMA WRITE) message rings using last-byte polling.
+ *
+ * The ring is num_slots slots of slot_size bytes in registered memory. A
+ * message is right-aligned in its slot so that the payload and footer form a
+ * single contiguous extent ending at the slot boundary; the sender issues one
+ * RDMA WRITE for that extent (see encode()). The HCA places the bytes of a
+ * single WRITE in increasing address order, so once the footer's seq is
+ * observed with acquire ordering the payload before it is complete.
+ *
+ * Slot reuse is flow-controlled by the application: the sender must not
+ * overwrite a slot until the receiver has released it (e.g. via credits).
+ *
+ * Example usage:
+ *
+ *     adverbs::last_byte_poller rx(mr->addr, 4096, 256);
+ *     for (;;) {
+ *       auto msg = rx.wait();
+ *       handle(msg.data, msg.length);
+ *       rx.release();
+ *     }
+ */
+class last_byte_poller {
+ public:
+  struct message {
+    const std::byte* data;
+    size_t length;
+    uint64_t seq;
+  };
+
+  static constexpr size_t slot_alignment = 64;
+
+  /**
+   * Construct a last_byte_poller over an existing slot ring.
+   *
+   * @param base The base of the ring; must be 64-byte aligned.
+   * @param slot_size The size of each slot; a non-zero multiple of 64.
+   * @param num_slots The number of slots in the ring.
+   * @throws std::invalid_argument if the ring geometry is invalid.
+   */
+  last_byte_poller(void* base, size_t slot_size, size_t num_slots)
+      : _base(static_cast<std::byte*>(base)),
+        _slot_size(slot_size),
+        _num_slots(num_slots) {
+    if (reinterpret_cast<uintptr_t>(base) % slot_alignment != 0) {
+      throw std::invalid_argument("slot ring base must be 64-byte aligned");
+    }
+    if (slot_size == 0 || slot_size % slot_alignment != 0) {
+      throw std::invalid_argument("slot_size must be a multiple of 64");
+    }
+    if (num_slots == 0) {
+      throw std::invalid_argument("num_slots must be non-zero");
+    }
+  }
+
+  /**
+   * The largest payload a single slot can carry.
+   */
+  [[nodiscard]]
+  static constexpr size_t max_payload(size_t slot_size) {
+    return slot_size - sizeof(slot_footer);
+  }
+
+  /**
+   * Stage a message into a local copy of a slot.
+   *
+   * Copies the payload right-aligned against the footer and stamps the
+   * footer. The returned extent is exactly what should be RDMA-written to
+   * the same offset within the remote slot.
+   *
+   * @param slot The local staging slot; its size is the ring's slot_size.
+   * @param payload The message payload.
+   * @param seq The sequence number; message n carries seq n + 1.
+   * @return The sub-span of slot to write to the remote slot.
+   * @throws std::invalid_argument if the payload does not fit in the slot.
+   */
+  static std::span<std::byte> encode(
+      std::span<std::byte> slot,
+      std::span<const std::byte> payload,
+      uint64_t seq) {
+    if (payload.size() > max_payload(slot.size())) {
+      throw std::invalid_argument("payload does not fit in slot");
+    }
+    size_t offset = slot.size() - sizeof(slot_footer) - payload.size();
+    if (!payload.empty()) {
+      std::memcpy(slot.data() + offset, payload.data(), payload.size());
+    }
+    slot_footer footer{payload.size(), seq};
+    std::memcpy(
+        slot.data() + slot.size() - sizeof(slot_footer),
+        &footer,
+        sizeof(footer));
+    return slot.subspan(offset);
+  }
+
+  /**
+   * Check whether the next message has arrived, without blocking.
+   *
+   * @param out Filled in with the message if one is ready.
+   * @return true if a message is ready at the head of the ring.
+   */
+  [[nodiscard]]
+  bool poll(message& out) const {
+    if (load_seq(_head, std::memory_order_acquire) != _head + 1) return false;
+    out = read_message(_head);
+    return true;
+  }
+
+  /**
+   * Wait for the next message.
+   *
+   * Spins with exponential `pause` backoff, then UMWAITs on the head slot's
+   * footer where the CPU supports it (see idle_strategy).
+   *
+   * @param options How to idle while waiting.
+   * @return The message at the head of the ring.
+   */
+  [[nodiscard]]
+  message wait(idle_options options = {}) const {
+    idle_strategy idle(options);
+    message msg{};
+    while (!poll(msg)) {
+      idle.idle(&footer(_head)->seq, [&]() { return poll(msg); });
+    }
+    return msg;
+  }
+
+  /**
+   * Count how many consecutive messages are ready at the head of the ring.
+   *
+   * Each footer is a separate load: footers are a slot apart, so there is
+   * no contiguous run of them for a vector load to cover. After scan()
+   * returns n, peek(0) .. peek(n - 1) are safe to read.
+   *
+   * @param max_count The maximum number of slots to examine.
+   * @return The number of consecutive ready messages starting at the head.
+   */
+  [[nodiscard]]
+  size_t scan(size_t max_count) const {
+    if (max_count > _num_slots) max_count = _num_slots;
+    size_t n = 0;
+    while (n < max_count &&
+           load_seq(_head + n, std::memory_order_relaxed) == _head + n + 1) {
+      ++n;
+    }
+    // Pairs with the HCA's ordered placement: every relaxed footer load above
+    // happens-before the payload reads that follow.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return n;
+  }
+
+  /**
+   * Read the i-th message from the head; only valid for i < scan().
+   */
+  [[nodiscard]]
+  message peek(size_t i) const {
+    return read_message(_head + i);
+  }
+
+  /**
+   * Release messages at the head of the ring, advancing it.
+   *
+   * @param count The number of messages to release.
+   */
+  void release(size_t count = 1) { _head += count; }
+
+  /**
+   * The number of messages released so far; the next expected seq is
+   * head() + 1.
+   */
+  [[nodiscard]]
+  uint64_t head() const {
+    return _head;
+  }
+
+  [[nodiscard]]
+  size_t slot_size() const {
+    return _slot_size;
+  }
+
+  [[nodiscard]]
+  size_t num_slots() const {
+    return _num_slots;
+  }
+
+ private:
+  [[nodiscard]]
+  std::byte* slot(uint64_t index) const {
+    return _base + (index % _num_slots) * _slot_size;
+  }
+
+  [[nodiscard]]
+  slot_footer* footer(uint64_t index) const {
+    return reinterpret_cast<slot_footer*>(
+        slot(index) + _slot_size - sizeof(slot_footer));
+  }
+
+  [[nodiscard]]
+  uint64_t load_seq(uint64_t index, std::memory_order order) const {
+    return std::atomic_ref<uint64_t>(footer(index)->seq).load(order);
+  }
+
+  [[nodiscard]]
+  message read_message(uint64_t index) const {
+    const slot_footer* f = footer(index);
+    size_t length = f->length;
+    if (length > max_payload(_slot_size)) length = max_payload(_slot_size);
+    return {
+        reinterpret_cast<const std::byte*>(f) - length,
+        length,
+        f->seq};
+  }
+
+  std::byte* _base;
+  size_t _slot_size;
+  size_t _num_slots;
+  uint64_t _head = 0;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_LAST_BYTE_POLLER_H
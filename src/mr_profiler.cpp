@@ -0,0 +1,239 @@
+#include "mr_profiler.h"
+
+#include <execinfo.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "poller_metrics.h"
+
+namespace adverbs {
+
+namespace {
+
+constexpr int max_frames = 16;
+// The frame of track() itself.
+constexpr int skipped_frames = 1;
+
+struct callsite_frames {
+  void* frames[max_frames];
+  int depth;
+};
+
+// lkeys are allocated per device, so two HCAs can hand out the same one.
+using record_key = std::pair<const struct ibv_context*, uint32_t>;
+
+struct profiler_state {
+  std::mutex mutex;
+  std::map<record_key, mr_record> records;
+  std::unordered_map<uint64_t, callsite_frames> callsites;
+  bool exit_hook_installed = false;
+};
+
+profiler_state& state() {
+  static profiler_state s;
+  return s;
+}
+
+uint64_t hash_frames(void* const* frames, int depth) {
+  // FNV-1a over the return addresses.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < depth; ++i) {
+    auto value = reinterpret_cast<uintptr_t>(frames[i]);
+    for (size_t b = 0; b < sizeof(value); ++b) {
+      hash ^= (value >> (8 * b)) & 0xff;
+      hash *= 0x100000001b3ULL;
+    }
+  }
+  return hash;
+}
+
+std::vector<std::string> symbolize(const callsite_frames& site) {
+  std::vector<std::string> frames;
+  std::unique_ptr<char*, decltype(&std::free)> symbols(
+      backtrace_symbols(site.frames, site.depth),
+      std::free);
+  if (!symbols) return frames;
+  for (int i = 0; i < site.depth; ++i) frames.emplace_back(symbols.get()[i]);
+  return frames;
+}
+
+template <typename Predicate>
+std::vector<mr_record> select(Predicate&& predicate) {
+  profiler_state& s = state();
+  std::vector<mr_record> out;
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for (const auto& [key, record] : s.records) {
+      if (predicate(record)) out.push_back(record);
+    }
+  }
+  std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) {
+    return a.registered_ns < b.registered_ns;
+  });
+  return out;
+}
+
+void report_at_exit() {
+  if (mr_profiler::enabled()) mr_profiler::report(std::cerr);
+}
+
+}  // namespace
+
+void mr_profiler::enable(bool report_on_exit) {
+  profiler_state& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (report_on_exit && !s.exit_hook_installed) {
+    std::atexit(report_at_exit);
+    s.exit_hook_installed = true;
+  }
+  _enabled.store(true);
+}
+
+void mr_profiler::disable() {
+  profiler_state& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  _enabled.store(false);
+  s.records.clear();
+  s.callsites.clear();
+}
+
+void mr_profiler::track(
+    const struct ibv_context* context,
+    const void* addr,
+    size_t length,
+    int access,
+    uint32_t lkey,
+    uint32_t rkey) {
+  if (!enabled()) return;
+
+  callsite_frames site{};
+  void* frames[max_frames + skipped_frames];
+  int depth = backtrace(frames, max_frames + skipped_frames);
+  site.depth = std::max(0, depth - skipped_frames);
+  std::copy(frames + skipped_frames, frames + depth, site.frames);
+
+  mr_record record;
+  record.context = context;
+  record.addr = reinterpret_cast<uintptr_t>(addr);
+  record.length = length;
+  record.access = access;
+  record.lkey = lkey;
+  record.rkey = rkey;
+  record.callsite = hash_frames(site.frames, site.depth);
+  record.registered_ns = monotonic_ns();
+
+  profiler_state& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.records[{context, lkey}] = record;
+  s.callsites.emplace(record.callsite, site);
+}
+
+void mr_profiler::untrack(const struct ibv_context* context, uint32_t lkey) {
+  if (!enabled()) return;
+  profiler_state& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.records.erase({context, lkey});
+}
+
+void mr_profiler::note_use(
+    const struct ibv_context* context,
+    uint32_t lkey) {
+  if (!enabled()) return;
+  profiler_state& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto it = s.records.find({context, lkey});
+  if (it == s.records.end()) return;
+  it->second.uses++;
+  it->second.last_used_ns = monotonic_ns();
+}
+
+std::vector<mr_record> mr_profiler::live() {
+  return select([](const mr_record&) { return true; });
+}
+
+std::vector<mr_callsite_usage> mr_profiler::pinned_by_callsite() {
+  profiler_state& s = state();
+  std::map<uint64_t, mr_callsite_usage> by_callsite;
+  std::vector<mr_callsite_usage> out;
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for (const auto& [key, record] : s.records) {
+      auto& usage = by_callsite[record.callsite];
+      usage.callsite = record.callsite;
+      usage.registrations++;
+      usage.pinned_bytes += record.length;
+    }
+    for (auto& [callsite, usage] : by_callsite) {
+      auto site = s.callsites.find(callsite);
+      if (site != s.callsites.end()) usage.frames = symbolize(site->second);
+      out.push_back(std::move(usage));
+    }
+  }
+  std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) {
+    return a.pinned_bytes > b.pinned_bytes;
+  });
+  return out;
+}
+
+std::vector<mr_record> mr_profiler::long_lived(
+    std::chrono::nanoseconds min_age) {
+  uint64_t now = monotonic_ns();
+  return select([&](const mr_record& record) {
+    return now - record.registered_ns >= (uint64_t)min_age.count();
+  });
+}
+
+std::vector<mr_record> mr_profiler::never_used() {
+  return select([](const mr_record& record) { return record.uses == 0; });
+}
+
+void mr_profiler::report(std::ostream& out, std::chrono::nanoseconds min_age) {
+  auto records = live();
+  size_t pinned = 0;
+  for (const auto& record : records) pinned += record.length;
+
+  out << "adverbs mr_profiler: " << records.size() << " live registrations, "
+      << pinned << " bytes pinned";
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 &&
+      limit.rlim_cur != RLIM_INFINITY) {
+    out << " of " << limit.rlim_cur << " RLIMIT_MEMLOCK";
+  }
+  out << "\n";
+
+  out << "pinned bytes by call site:\n";
+  for (const auto& usage : pinned_by_callsite()) {
+    out << "  " << usage.pinned_bytes << " bytes in " << usage.registrations
+        << " registrations, call site " << std::hex << usage.callsite
+        << std::dec << "\n";
+    for (const auto& frame : usage.frames) out << "      " << frame << "\n";
+  }
+
+  uint64_t now = monotonic_ns();
+  auto print = [&](const mr_record& record) {
+    out << "  lkey " << record.lkey << ": " << record.length << " bytes at 0x"
+        << std::hex << record.addr << std::dec << ", access ";
+    if (record.access < 0) {
+      out << "unknown";
+    } else {
+      out << "0x" << std::hex << record.access << std::dec;
+    }
+    out << ", age " << (now - record.registered_ns) / 1000000 << " ms, "
+        << record.uses << " uses\n";
+  };
+  out << "long-lived registrations:\n";
+  for (const auto& record : long_lived(min_age)) print(record);
+  out << "registrations never used in a work request:\n";
+  for (const auto& record : never_used()) print(record);
+}
+
+}  // namespace adverbs
@@ -0,0 +1,181 @@
+#ifndef ADVERBS_MR_PROFILER_H
+#define ADVERBS_MR_PROFILER_H
+
+#include <infiniband/verbs.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace adverbs {
+
+/**
+ * What the profiler knows about one live memory registration.
+ */
+struct mr_record {
+  // The registering device; lkeys are only unique per device.
+  const struct ibv_context* context = nullptr;
+  uintptr_t addr = 0;
+  size_t length = 0;
+  // The ibv_access_flags, or -1 if unknown (an imported region).
+  int access = 0;
+  uint32_t lkey = 0;
+  uint32_t rkey = 0;
+  // Hash of the return addresses of the registering call stack.
+  uint64_t callsite = 0;
+  uint64_t registered_ns = 0;
+  uint64_t last_used_ns = 0;
+  uint64_t uses = 0;
+};
+
+/**
+ * Pinned memory attributed to one registering call stack.
+ */
+struct mr_callsite_usage {
+  uint64_t callsite = 0;
+  size_t registrations = 0;
+  size_t pinned_bytes = 0;
+  // Symbolized frames of the first registration seen from this call stack.
+  std::vector<std::string> frames;
+};
+
+/**
+ * Process-wide profiler and leak detector for memory registrations.
+ *
+ * While enabled, every memory_region_handle registration is recorded with
+ * its size, access flags, call-stack hash and time. Reports answer where
+ * pinned memory comes from, which registrations are long-lived, and which
+ * were never referenced by a work request (uses are counted by note_use(),
+ * which the library's own posting helpers call through note_posted()).
+ *
+ * Recording takes a mutex, so this is a diagnostic mode; while disabled
+ * every hook is a single relaxed load.
+ *
+ * Example usage:
+ *
+ *     adverbs::mr_profiler::enable(true);  // also report at exit
+ *     ...
+ *     adverbs::note_posted(qp->context, &wr);
+ *     ibv_post_send(qp, &wr, &bad_wr);
+ *     ...
+ *     adverbs::mr_profiler::report(std::cerr);
+ */
+class mr_profiler {
+ public:
+  /**
+   * Start recording registrations.
+   *
+   * @param report_on_exit Write report() to stderr when the process exits.
+   */
+  static void enable(bool report_on_exit = false);
+
+  /**
+   * Stop recording and forget all records.
+   */
+  static void disable();
+
+  [[nodiscard]]
+  static bool enabled() {
+    return _enabled.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Record a registration; called by memory_region_handle.
+   * Captures the caller's stack for attribution.
+   */
+  static void track(
+      const struct ibv_context* context,
+      const void* addr,
+      size_t length,
+      int access,
+      uint32_t lkey,
+      uint32_t rkey);
+
+  /**
+   * Forget a registration; called by memory_region_handle on deregistration.
+   */
+  static void untrack(const struct ibv_context* context, uint32_t lkey);
+
+  /**
+   * Record that a work request referencing lkey on context's device is
+   * being posted.
+   */
+  static void note_use(const struct ibv_context* context, uint32_t lkey);
+
+  /**
+   * All live registrations, oldest first.
+   */
+  [[nodiscard]]
+  static std::vector<mr_record> live();
+
+  /**
+   * Live pinned bytes grouped by registering call stack, largest first.
+   */
+  [[nodiscard]]
+  static std::vector<mr_callsite_usage> pinned_by_callsite();
+
+  /**
+   * Live registrations at least min_age old, oldest first.
+   */
+  [[nodiscard]]
+  static std::vector<mr_record> long_lived(std::chrono::nanoseconds min_age);
+
+  /**
+   * Live registrations never passed to note_use(), oldest first.
+   */
+  [[nodiscard]]
+  static std::vector<mr_record> never_used();
+
+  /**
+   * Write a human-readable report, including RLIMIT_MEMLOCK headroom.
+   *
+   * @param out The stream to write to.
+   * @param min_age The age at which a registration is reported as long-lived.
+   */
+  static void report(
+      std::ostream& out,
+      std::chrono::nanoseconds min_age = std::chrono::minutes(10));
+
+ private:
+  inline static std::atomic<bool> _enabled{false};
+};
+
+/**
+ * mr_profiler::note_use() for every SGE of a send chain being posted on
+ * context's device. Inline data is copied at post time, so its lkeys are
+ * not uses.
+ */
+inline void note_posted(
+    const struct ibv_context* context,
+    const struct ibv_send_wr* wr) {
+  if (!mr_profiler::enabled()) return;
+  for (; wr; wr = wr->next) {
+    if (wr->send_flags & IBV_SEND_INLINE) continue;
+    for (int i = 0; i < wr->num_sge; ++i) {
+      mr_profiler::note_use(context, wr->sg_list[i].lkey);
+    }
+  }
+}
+
+/**
+ * mr_profiler::note_use() for every SGE of a receive chain being posted on
+ * context's device.
+ */
+inline void note_posted(
+    const struct ibv_context* context,
+    const struct ibv_recv_wr* wr) {
+  if (!mr_profiler::enabled()) return;
+  for (; wr; wr = wr->next) {
+    for (int i = 0; i < wr->num_sge; ++i) {
+      mr_profiler::note_use(context, wr->sg_list[i].lkey);
+    }
+  }
+}
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_MR_PROFILER_H
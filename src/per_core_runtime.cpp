@@ -0,0 +1,157 @@
+#include "per_core_runtime.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+namespace adverbs {
+
+void pin_current_thread(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+    throw std::runtime_error("pthread_setaffinity_np failed");
+  }
+}
+
+std::vector<int> current_thread_cpus() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  std::vector<int> cpus;
+  if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set)) {
+    throw std::runtime_error("pthread_getaffinity_np failed");
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+namespace {
+
+per_core_options resolve_cpus(per_core_options options) {
+  if (options.cpus.empty()) options.cpus = current_thread_cpus();
+  return options;
+}
+
+}  // namespace
+
+per_core_runtime::per_core_runtime(
+    const ibv_device* device,
+    per_core_options options)
+    : _options(resolve_cpus(std::move(options))),
+      _mesh(_options.cpus.size(), _options.queue_capacity) {
+  _shards.resize(_options.cpus.size());
+
+  for (unsigned core = 0; core < _shards.size(); ++core) {
+    std::exception_ptr error;
+    std::thread builder([&, core]() {
+      try {
+        int cpu = _options.cpus[core];
+        pin_current_thread(cpu);
+        _shards[core] =
+            std::make_unique<core_shard>(core, cpu, device, _options.cq_depth);
+      } catch (...) {
+        error = std::current_exception();
+      }
+    });
+    builder.join();
+    if (error) std::rethrow_exception(error);
+  }
+}
+
+void per_core_runtime::start(poll_fn poll, message_fn on_message) {
+  if (_running.exchange(true)) {
+    throw std::runtime_error("per_core_runtime already started");
+  }
+  _poll = std::move(poll);
+  _on_message = std::move(on_message);
+  _errors.assign(_shards.size(), nullptr);
+  for (unsigned core = 0; core < _shards.size(); ++core) {
+    std::promise<void> pinned;
+    std::future<void> ready = pinned.get_future();
+    _threads.emplace_back(
+        &per_core_runtime::run, this, core, std::move(pinned));
+    try {
+      ready.get();
+    } catch (...) {
+      join();
+      _errors.clear();
+      throw;
+    }
+  }
+}
+
+void per_core_runtime::join() {
+  _running.store(false);
+  for (auto& thread : _threads) thread.join();
+  _threads.clear();
+}
+
+void per_core_runtime::stop() {
+  join();
+
+  std::exception_ptr error;
+  for (const auto& e : _errors) {
+    if (e && !error) error = e;
+  }
+  _errors.clear();
+  if (error) std::rethrow_exception(error);
+}
+
+void per_core_runtime::run(unsigned core, std::promise<void> pinned) {
+  // Pinning fails start() rather than this thread.
+  try {
+    pin_current_thread(_shards[core]->cpu());
+  } catch (...) {
+    pinned.set_exception(std::current_exception());
+    return;
+  }
+  pinned.set_value();
+
+  try {
+    loop(core);
+  } catch (...) {
+    _errors[core] = std::current_exception();
+  }
+}
+
+void per_core_runtime::loop(unsigned core) {
+  core_shard& shard = *_shards[core];
+  idle_strategy idle(_options.idle);
+  poller_metrics& metrics = shard.metrics();
+  while (_running.load(std::memory_order_relaxed)) {
+    size_t work;
+    {
+      auto iteration = metrics.time_iteration();
+      int polled = _poll ? _poll(shard) : 0;
+      if (polled < 0) {
+        throw std::runtime_error(
+            "per_core_runtime: poll failed on core " + std::to_string(core));
+      }
+      metrics.record_poll((size_t)polled);
+
+      uint64_t start = monotonic_ns();
+      size_t delivered = _mesh.drain(
+          core,
+          [&](const core_message& msg) {
+            if (_on_message) _on_message(shard, msg);
+          },
+          _options.message_budget);
+      if (delivered) metrics.record_callback(monotonic_ns() - start);
+
+      work = (size_t)polled + delivered;
+    }
+    if (work) {
+      idle.reset();
+    } else {
+      idle.idle();
+    }
+  }
+}
+
+}  // namespace adverbs
@@ -0,0 +1,318 @@
+#ifndef ADVERBS_PER_CORE_RUNTIME_H
+#define ADVERBS_PER_CORE_RUNTIME_H
+
+#include <infiniband/verbs.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "adverbs.h"
+#include "idle_strategy.h"
+#include "poller_metrics.h"
+#include "spsc_queue.h"
+
+namespace adverbs {
+
+/**
+ * Pin the calling thread to a single CPU.
+ *
+ * @param cpu The CPU to pin to.
+ * @throws std::runtime_error if pthread_setaffinity_np fails.
+ */
+void pin_current_thread(int cpu);
+
+/**
+ * The CPUs in the calling thread's affinity mask, in ascending order.
+ */
+std::vector<int> current_thread_cpus();
+
+/**
+ * Map a connection key to one of num_shards shards.
+ *
+ * The key is mixed with the splitmix64 finalizer so that sequential keys
+ * (QP numbers, ports) spread evenly, then reduced without a division.
+ */
+inline unsigned shard_for_key(uint64_t key, size_t num_shards) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebULL;
+  key ^= key >> 31;
+  return (unsigned)(((unsigned __int128)key * num_shards) >> 64);
+}
+
+/**
+ * A fixed-size message passed between cores.
+ *
+ * The runtime never interprets the fields; `kind` and `arg` are
+ * application-defined, and ownership of `ptr` moves with the message.
+ */
+struct core_message {
+  uint32_t kind = 0;
+  uint32_t source = 0;
+  uint64_t arg = 0;
+  void* ptr = nullptr;
+};
+
+/**
+ * A full mesh of spsc_queues between num_cores cores.
+ *
+ * Every (source, dest) pair has its own queue, so every queue has exactly
+ * one producer and one consumer and no core ever contends on a shared line
+ * with more than one peer.
+ */
+class core_mesh {
+ public:
+  core_mesh(size_t num_cores, size_t queue_capacity)
+      : _num_cores(num_cores), _cursors(num_cores) {
+    _queues.reserve(num_cores * num_cores);
+    for (size_t i = 0; i < num_cores * num_cores; ++i) {
+      _queues.push_back(
+          std::make_unique<spsc_queue<core_message>>(queue_capacity));
+    }
+  }
+
+  [[nodiscard]]
+  size_t size() const {
+    return _num_cores;
+  }
+
+  /**
+   * Send a message; must be called from the source core.
+   *
+   * @return false if the (source, dest) queue is full.
+   */
+  bool send(unsigned source, unsigned dest, core_message msg) {
+    msg.source = source;
+    return queue(source, dest).try_push(msg);
+  }
+
+  /**
+   * Deliver pending messages for dest; must be called from the dest core.
+   *
+   * Peers are drained round-robin, up to budget messages in total. Each
+   * call starts after the last peer the previous call served, so a busy
+   * peer can't keep the budget from reaching the others.
+   *
+   * @return The number of messages delivered.
+   */
+  template <typename F>
+  size_t drain(unsigned dest, F&& fn, size_t budget = 64) {
+    size_t delivered = 0;
+    size_t& next_source = _cursors[dest].next_source;
+    size_t start = next_source;
+    core_message msg;
+    for (size_t k = 0; k < _num_cores && delivered < budget; ++k) {
+      size_t source = (start + k) % _num_cores;
+      auto& q = queue(source, dest);
+      while (delivered < budget && q.try_pop(msg)) {
+        fn(msg);
+        ++delivered;
+        next_source = (source + 1) % _num_cores;
+      }
+    }
+    return delivered;
+  }
+
+ private:
+  spsc_queue<core_message>& queue(size_t source, size_t dest) {
+    return *_queues[source * _num_cores + dest];
+  }
+
+  // Written only by its dest core; padded against false sharing.
+  struct alignas(64) cursor {
+    size_t next_source = 0;
+  };
+
+  size_t _num_cores;
+  std::vector<std::unique_ptr<spsc_queue<core_message>>> _queues;
+  std::vector<cursor> _cursors;
+};
+
+/**
+ * The verbs resources owned by a single core.
+ *
+ * Each shard opens its own context on the device, so doorbells, PDs, CQs
+ * and QPs are never touched by more than one thread.
+ */
+class core_shard {
+ public:
+  core_shard(unsigned core_id, int cpu, const ibv_device* device, int cq_depth)
+      : _core_id(core_id),
+        _cpu(cpu),
+        _context(device),
+        _pd(_context),
+        _cq(_context, cq_depth) {}
+
+  [[nodiscard]]
+  unsigned core_id() const {
+    return _core_id;
+  }
+
+  [[nodiscard]]
+  int cpu() const {
+    return _cpu;
+  }
+
+  context_handle& context() { return _context; }
+
+  protection_domain_handle& pd() { return _pd; }
+
+  completion_queue_handle& cq() { return _cq; }
+
+  std::deque<queue_pair_handle>& qps() { return _qps; }
+
+  /**
+   * Utilization of this shard's polling loop; readable from any thread.
+   */
+  poller_metrics& metrics() { return _metrics; }
+
+  /**
+   * Create a QP on this shard, using the shard's CQ for sends and receives.
+   *
+   * @return The QP, which stays where it is as more are created.
+   * @throws std::runtime_error if ibv_create_qp fails.
+   */
+  queue_pair_handle& create_qp(const struct ibv_qp_init_attr& init_attr) {
+    return _qps.emplace_back(_pd, _cq, _cq, init_attr);
+  }
+
+ private:
+  unsigned _core_id;
+  int _cpu;
+  context_handle _context;
+  protection_domain_handle _pd;
+  completion_queue_handle _cq;
+  std::deque<queue_pair_handle> _qps;
+  poller_metrics _metrics;
+};
+
+struct per_core_options {
+  // One shard per CPU; defaults to the calling thread's affinity mask.
+  std::vector<int> cpus;
+  int cq_depth = 4096;
+  size_t queue_capacity = 1024;
+  // Maximum cross-core messages delivered per loop iteration.
+  size_t message_budget = 64;
+  // How a shard's loop idles when a pass finds no work.
+  idle_options idle;
+};
+
+/**
+ * Shared-nothing per-core runtime.
+ *
+ * Every core owns a core_shard (context, PD, CQ, QPs) and runs its own
+ * polling loop on a pinned thread. Cores only communicate through the
+ * core_mesh; connections are assigned to cores with shard_for().
+ *
+ * Shards are constructed on their own pinned CPU so that driver
+ * allocations are local to it.
+ *
+ * Example usage:
+ *
+ *     adverbs::per_core_runtime runtime(device_list[0], {});
+ *     runtime.start(
+ *         [](adverbs::core_shard& shard) {
+ *           struct ibv_wc wc[32];
+ *           int n = ibv_poll_cq(shard.cq().get(), 32, wc);
+ *           ...
+ *           return n;
+ *         },
+ *         [](adverbs::core_shard& shard, const adverbs::core_message& msg) {
+ *           ...
+ *         });
+ *     ...
+ *     runtime.stop();
+ */
+class per_core_runtime {
+ public:
+  // Returns the completions it handled, or a negative value on error.
+  using poll_fn = std::function<int(core_shard&)>;
+  using message_fn = std::function<void(core_shard&, const core_message&)>;
+
+  /**
+   * Construct a per_core_runtime; opens one context per CPU.
+   *
+   * @throws std::runtime_error if any shard's resources can't be created.
+   */
+  per_core_runtime(const ibv_device* device, per_core_options options);
+
+  ~per_core_runtime() {
+    try {
+      stop();
+    } catch (...) {
+      // A shard's error is only reported to an explicit stop().
+    }
+  }
+
+  per_core_runtime(const per_core_runtime&) = delete;
+  per_core_runtime& operator=(const per_core_runtime&) = delete;
+
+  [[nodiscard]]
+  size_t size() const {
+    return _shards.size();
+  }
+
+  core_shard& shard(unsigned core) { return *_shards[core]; }
+
+  core_mesh& mesh() { return _mesh; }
+
+  /**
+   * The core that owns the connection identified by key.
+   */
+  [[nodiscard]]
+  unsigned shard_for(uint64_t key) const {
+    return shard_for_key(key, _shards.size());
+  }
+
+  /**
+   * Start one pinned polling thread per shard.
+   *
+   * Each loop iteration calls poll and then delivers up to
+   * message_budget cross-core messages to on_message; when both find no
+   * work the thread idles with an idle_strategy.
+   *
+   * The value returned by poll is recorded as the completions of one poll
+   * in the shard's metrics(); time spent in on_message is recorded as
+   * callback time. A negative value, or an exception from either
+   * callback, stops that shard's thread; stop() reports it.
+   *
+   * @throws std::runtime_error if already started, or if a thread can't be
+   *    pinned to its CPU; the threads already started are stopped again.
+   */
+  void start(poll_fn poll, message_fn on_message);
+
+  /**
+   * Stop and join the polling threads; idempotent.
+   *
+   * @throws The first error a polling thread stopped on: std::runtime_error
+   *    for a negative poll result, or whatever a callback threw.
+   */
+  void stop();
+
+ private:
+  void run(unsigned core, std::promise<void> pinned);
+  void loop(unsigned core);
+  void join();
+
+  per_core_options _options;
+  std::vector<std::unique_ptr<core_shard>> _shards;
+  core_mesh _mesh;
+  poll_fn _poll;
+  message_fn _on_message;
+  std::atomic<bool> _running{false};
+  std::vector<std::thread> _threads;
+  // Per shard, the error its thread stopped on.
+  std::vector<std::exception_ptr> _errors;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_PER_CORE_RUNTIME_H
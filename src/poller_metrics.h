@@ -0,0 +1,254 @@
+#ifndef ADVERBS_POLLER_METRICS_H
+#define ADVERBS_POLLER_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace adverbs {
+
+/**
+ * Monotonic nanoseconds, for timing loop iterations and callbacks.
+ */
+inline uint64_t monotonic_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * A point-in-time copy of a poller_metrics.
+ */
+struct poller_metrics_snapshot {
+  static constexpr size_t num_buckets = 64;
+
+  uint64_t polls = 0;
+  uint64_t empty_polls = 0;
+  uint64_t completions = 0;
+  uint64_t iterations = 0;
+  uint64_t loop_ns = 0;
+  uint64_t callbacks = 0;
+  uint64_t callback_ns = 0;
+  // Bucket i counts iterations taking [2^(i-1), 2^i) ns; bucket 0 is 0 ns.
+  std::array<uint64_t, num_buckets> iteration_histogram{};
+
+  [[nodiscard]]
+  uint64_t productive_polls() const {
+    return polls - empty_polls;
+  }
+
+  /**
+   * The fraction of polls that found no work; 1.0 is an idle-spinning core.
+   */
+  [[nodiscard]]
+  double empty_fraction() const {
+    return polls ? (double)empty_polls / (double)polls : 0.0;
+  }
+
+  [[nodiscard]]
+  double completions_per_productive_poll() const {
+    uint64_t productive = productive_polls();
+    return productive ? (double)completions / (double)productive : 0.0;
+  }
+
+  /**
+   * The fraction of loop time spent in user callbacks.
+   */
+  [[nodiscard]]
+  double callback_fraction() const {
+    return loop_ns ? (double)callback_ns / (double)loop_ns : 0.0;
+  }
+
+  /**
+   * An upper bound on the q-quantile iteration time, in ns.
+   *
+   * @param q The quantile, in [0, 1].
+   */
+  [[nodiscard]]
+  uint64_t iteration_quantile_ns(double q) const {
+    if (iterations == 0) return 0;
+    auto rank = (uint64_t)(q * (double)(iterations - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < num_buckets; ++i) {
+      seen += iteration_histogram[i];
+      if (seen >= rank) return i == 0 ? 0 : 1ULL << i;
+    }
+    return UINT64_MAX;
+  }
+
+  /**
+   * The snapshot as named monotonic counters, for export to a metrics
+   * system. The iteration histogram is Prometheus-style: every bucket,
+   * cumulative, by inclusive upper bound, ending in +Inf, then _sum and
+   * _count.
+   */
+  [[nodiscard]]
+  std::vector<std::pair<std::string, uint64_t>> counters() const {
+    std::vector<std::pair<std::string, uint64_t>> out = {
+        {"polls_total", polls},
+        {"empty_polls_total", empty_polls},
+        {"productive_polls_total", productive_polls()},
+        {"completions_total", completions},
+        {"iterations_total", iterations},
+        {"loop_ns_total", loop_ns},
+        {"callbacks_total", callbacks},
+        {"callback_ns_total", callback_ns},
+    };
+    uint64_t cumulative = 0;
+    // The last bucket also holds everything beyond it: it is +Inf.
+    for (size_t i = 0; i + 1 < num_buckets; ++i) {
+      cumulative += iteration_histogram[i];
+      // Bucket i holds durations below 2^i.
+      uint64_t le = (1ULL << i) - 1;
+      out.emplace_back(
+          "iteration_ns_bucket{le=\"" + std::to_string(le) + "\"}",
+          cumulative);
+    }
+    cumulative += iteration_histogram[num_buckets - 1];
+    out.emplace_back("iteration_ns_bucket{le=\"+Inf\"}", cumulative);
+    out.emplace_back("iteration_ns_sum", loop_ns);
+    out.emplace_back("iteration_ns_count", iterations);
+    return out;
+  }
+};
+
+/**
+ * Utilization counters for a single polling loop.
+ *
+ * Written only by the polling thread, so updates are plain relaxed
+ * load/store pairs with no locked instructions; snapshot() may be called
+ * from any thread.
+ *
+ * Example usage:
+ *
+ *     adverbs::poller_metrics metrics;
+ *     for (;;) {
+ *       auto iteration = metrics.time_iteration();
+ *       int n = ibv_poll_cq(cq, 32, wc);
+ *       metrics.record_poll(n);
+ *       {
+ *         auto callback = metrics.time_callback();
+ *         handle(wc, n);
+ *       }
+ *     }
+ */
+class poller_metrics {
+ public:
+  /**
+   * RAII timer which records its lifetime into a poller_metrics.
+   */
+  class scoped_timer {
+   public:
+    scoped_timer(poller_metrics& metrics, bool callback)
+        : _metrics(metrics), _callback(callback), _start(monotonic_ns()) {}
+
+    ~scoped_timer() {
+      uint64_t elapsed = monotonic_ns() - _start;
+      if (_callback) {
+        _metrics.record_callback(elapsed);
+      } else {
+        _metrics.record_iteration(elapsed);
+      }
+    }
+
+    scoped_timer(const scoped_timer&) = delete;
+    scoped_timer& operator=(const scoped_timer&) = delete;
+
+   private:
+    poller_metrics& _metrics;
+    bool _callback;
+    uint64_t _start;
+  };
+
+  /**
+   * Record one poll which returned completions entries (0 for empty).
+   */
+  void record_poll(size_t completions) {
+    bump(_polls, 1);
+    if (completions == 0) {
+      bump(_empty_polls, 1);
+    } else {
+      bump(_completions, completions);
+    }
+  }
+
+  /**
+   * Record one loop iteration which took ns nanoseconds.
+   */
+  void record_iteration(uint64_t ns) {
+    bump(_iterations, 1);
+    bump(_loop_ns, ns);
+    bump(_histogram[bucket(ns)], 1);
+  }
+
+  /**
+   * Record one user callback which took ns nanoseconds.
+   */
+  void record_callback(uint64_t ns) {
+    bump(_callbacks, 1);
+    bump(_callback_ns, ns);
+  }
+
+  [[nodiscard]]
+  scoped_timer time_iteration() {
+    return {*this, false};
+  }
+
+  [[nodiscard]]
+  scoped_timer time_callback() {
+    return {*this, true};
+  }
+
+  [[nodiscard]]
+  poller_metrics_snapshot snapshot() const {
+    poller_metrics_snapshot s;
+    s.polls = _polls.load(std::memory_order_relaxed);
+    s.empty_polls = _empty_polls.load(std::memory_order_relaxed);
+    s.completions = _completions.load(std::memory_order_relaxed);
+    s.iterations = _iterations.load(std::memory_order_relaxed);
+    s.loop_ns = _loop_ns.load(std::memory_order_relaxed);
+    s.callbacks = _callbacks.load(std::memory_order_relaxed);
+    s.callback_ns = _callback_ns.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < _histogram.size(); ++i) {
+      s.iteration_histogram[i] = _histogram[i].load(std::memory_order_relaxed);
+    }
+    return s;
+  }
+
+  /**
+   * The histogram bucket for a duration: 0 for 0 ns, else floor(log2) + 1.
+   */
+  [[nodiscard]]
+  static size_t bucket(uint64_t ns) {
+    size_t b = std::bit_width(ns);
+    return b < poller_metrics_snapshot::num_buckets
+               ? b
+               : poller_metrics_snapshot::num_buckets - 1;
+  }
+
+ private:
+  static void bump(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(
+        counter.load(std::memory_order_relaxed) + n,
+        std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> _polls{0};
+  std::atomic<uint64_t> _empty_polls{0};
+  std::atomic<uint64_t> _completions{0};
+  std::atomic<uint64_t> _iterations{0};
+  std::atomic<uint64_t> _loop_ns{0};
+  std::atomic<uint64_t> _callbacks{0};
+  std::atomic<uint64_t> _callback_ns{0};
+  std::array<std::atomic<uint64_t>, poller_metrics_snapshot::num_buckets>
+      _histogram{};
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_POLLER_METRICS_H
@@ -0,0 +1,149 @@
+#include "port_health.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace adverbs {
+
+namespace {
+
+uint64_t read_counter(const std::string& dir, const char* name) {
+  std::ifstream in(dir + "/" + name);
+  uint64_t value = 0;
+  in >> value;
+  return value;
+}
+
+// Counters saturate rather than wrap, and reset to zero when cleared; a
+// drop is a reset and counts as no errors.
+double delta(uint64_t from, uint64_t to) {
+  return to >= from ? (double)(to - from) : 0;
+}
+
+}  // namespace
+
+port_counters port_counters::read(const std::string& dir) {
+  port_counters c;
+  c.symbol_error = read_counter(dir, "symbol_error");
+  c.link_error_recovery = read_counter(dir, "link_error_recovery");
+  c.link_downed = read_counter(dir, "link_downed");
+  c.port_rcv_errors = read_counter(dir, "port_rcv_errors");
+  c.local_link_integrity_errors =
+      read_counter(dir, "local_link_integrity_errors");
+  return c;
+}
+
+const char* link_state_name(link_state state) {
+  switch (state) {
+    case link_state::healthy:
+      return "healthy";
+    case link_state::degrading:
+      return "degrading";
+    case link_state::failing:
+      return "failing";
+  }
+  return "unknown";
+}
+
+size_t port_health_monitor::add_port(const std::string& counters_dir) {
+  _ports.push_back({counters_dir, {}, {}});
+  return _ports.size() - 1;
+}
+
+void port_health_monitor::sample() {
+  auto now = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < _ports.size(); ++i) {
+    double seconds =
+        std::chrono::duration<double>(now - _ports[i].sampled).count();
+    update(i, port_counters::read(_ports[i].dir), seconds);
+    _ports[i].sampled = now;
+  }
+}
+
+double port_health_monitor::weighted_errors(
+    const port_counters& from,
+    const port_counters& to) const {
+  const auto& o = _options;
+  return o.symbol_error_weight * delta(from.symbol_error, to.symbol_error) +
+         o.link_error_recovery_weight *
+             delta(from.link_error_recovery, to.link_error_recovery) +
+         o.link_downed_weight * delta(from.link_downed, to.link_downed) +
+         o.port_rcv_errors_weight *
+             delta(from.port_rcv_errors, to.port_rcv_errors) +
+         o.local_link_integrity_weight *
+             delta(
+                 from.local_link_integrity_errors,
+                 to.local_link_integrity_errors);
+}
+
+void port_health_monitor::update(
+    size_t port,
+    const port_counters& counters,
+    double seconds) {
+  port_health& h = _ports.at(port).health;
+  h.saturated = counters.saturated();
+  if (h.samples++ == 0) {
+    h.last = counters;
+    if (h.saturated) {
+      h.state = link_state::degrading;
+      h.score = std::min(h.score, 0.5);
+    }
+    return;
+  }
+  double rate = weighted_errors(h.last, counters) / std::max(seconds, 1e-3);
+  bool downed = counters.link_downed > h.last.link_downed;
+  h.last = counters;
+
+  if (h.samples == 2) {
+    h.fast_rate = rate;
+    h.slow_rate = rate;
+  } else {
+    h.fast_rate += _options.fast_alpha * (rate - h.fast_rate);
+    h.slow_rate += _options.slow_alpha * (rate - h.slow_rate);
+  }
+  h.score = 1 / (1 + h.fast_rate / _options.degrade_rate);
+  // A pinned counter's errors no longer show up in the rate.
+  if (h.saturated) h.score = std::min(h.score, 0.5);
+
+  bool rising = h.fast_rate > _options.trend_floor &&
+                h.fast_rate > _options.trend_ratio * h.slow_rate;
+  if (downed || h.fast_rate >= _options.fail_rate) {
+    h.state = link_state::failing;
+  } else if (rising || h.saturated || h.fast_rate >= _options.degrade_rate) {
+    h.state = link_state::degrading;
+  } else {
+    h.state = link_state::healthy;
+  }
+}
+
+size_t port_health_monitor::best_port() const {
+  if (_ports.empty()) {
+    throw std::out_of_range("no ports are monitored");
+  }
+  size_t best = 0;
+  for (size_t i = 1; i < _ports.size(); ++i) {
+    const auto& a = _ports[i].health;
+    const auto& b = _ports[best].health;
+    if (a.state < b.state || (a.state == b.state && a.score > b.score)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+std::vector<double> port_health_monitor::traffic_weights() const {
+  std::vector<double> weights(_ports.size());
+  if (_ports.empty()) return weights;
+  link_state best = _ports[best_port()].health.state;
+  double total = 0;
+  for (size_t i = 0; i < _ports.size(); ++i) {
+    const auto& h = _ports[i].health;
+    if (h.state == best) weights[i] = h.score;
+    total += weights[i];
+  }
+  for (auto& w : weights) w /= total;
+  return weights;
+}
+
+}  // namespace adverbs
@@ -0,0 +1,198 @@
+#ifndef ADVERBS_PORT_HEALTH_H
+#define ADVERBS_PORT_HEALTH_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace adverbs {
+
+/**
+ * The error counters of one port, as found in sysfs under
+ * /sys/class/infiniband/<device>/ports/<port>/counters.
+ */
+struct port_counters {
+  // The counters' widths in the PortCounters attribute. They stop at their
+  // maximum instead of wrapping, until cleared (e.g. perfquery -R).
+  static constexpr uint64_t symbol_error_max = 0xffff;
+  static constexpr uint64_t link_error_recovery_max = 0xff;
+  static constexpr uint64_t link_downed_max = 0xff;
+  static constexpr uint64_t port_rcv_errors_max = 0xffff;
+  static constexpr uint64_t local_link_integrity_errors_max = 0xf;
+
+  uint64_t symbol_error = 0;
+  uint64_t link_error_recovery = 0;
+  uint64_t link_downed = 0;
+  uint64_t port_rcv_errors = 0;
+  uint64_t local_link_integrity_errors = 0;
+
+  /**
+   * Read the counters from a counters directory; missing counters (RoCE
+   * ports lack some) read as zero.
+   */
+  static port_counters read(const std::string& dir);
+
+  /**
+   * Whether any counter has stopped at its maximum, so its errors no
+   * longer show up as deltas.
+   */
+  [[nodiscard]]
+  bool saturated() const {
+    return symbol_error >= symbol_error_max ||
+           link_error_recovery >= link_error_recovery_max ||
+           link_downed >= link_downed_max ||
+           port_rcv_errors >= port_rcv_errors_max ||
+           local_link_integrity_errors >= local_link_integrity_errors_max;
+  }
+
+  /**
+   * The counters directory of a device's port.
+   *
+   * @param ibdev_path The device's sysfs path (ibv_device::ibdev_path).
+   */
+  static std::string path(const std::string& ibdev_path, uint8_t port) {
+    return ibdev_path + "/ports/" + std::to_string(port) + "/counters";
+  }
+};
+
+enum class link_state {
+  healthy,
+  // Errors are frequent or climbing: drain traffic away.
+  degrading,
+  // The link has gone down, or errors are so frequent it soon will.
+  failing,
+};
+
+const char* link_state_name(link_state state);
+
+struct port_health_options {
+  // How much one increment of each counter counts towards the error rate.
+  // Retraining and downed links are what hurt latency; symbol and receive
+  // errors are the early warning.
+  double symbol_error_weight = 1;
+  double link_error_recovery_weight = 20;
+  double link_downed_weight = 100;
+  double port_rcv_errors_weight = 1;
+  double local_link_integrity_weight = 10;
+  // EWMA weights of the newest sample for the fast and slow error rates.
+  double fast_alpha = 0.3;
+  double slow_alpha = 0.02;
+  // A weighted error rate, per second, at which a port is degrading; the
+  // score is 0.5 at this rate.
+  double degrade_rate = 1;
+  // The rate at which a port is failing.
+  double fail_rate = 50;
+  // A port is also degrading when its fast rate exceeds trend_ratio times
+  // its slow rate and trend_floor: errors are climbing from a low base.
+  double trend_ratio = 4;
+  double trend_floor = 0.1;
+};
+
+struct port_health {
+  // 1 for a clean port, falling towards 0 as errors grow.
+  double score = 1;
+  // Weighted errors per second, recent and long-run.
+  double fast_rate = 0;
+  double slow_rate = 0;
+  link_state state = link_state::healthy;
+  // A counter is pinned at its maximum: the port is held at degrading or
+  // worse until its counters are cleared.
+  bool saturated = false;
+  uint64_t samples = 0;
+  port_counters last;
+};
+
+/**
+ * Scores ports by their error counters so traffic can move off degrading
+ * links before they fail.
+ *
+ * Each sample turns the counter deltas into a weighted error rate, tracked
+ * by a fast and a slow EWMA. A port degrades when the fast rate passes
+ * degrade_rate, or when it climbs well above the slow rate (the trend);
+ * clean samples decay the fast rate, so a recovered port returns to
+ * healthy within a few samples. A counter pinned at its maximum hides
+ * further errors, so it keeps the port degrading until the counters are
+ * cleared. best_port() and traffic_weights() feed the
+ * scores into port or path selection.
+ *
+ * Example usage:
+ *
+ *     adverbs::port_health_monitor monitor;
+ *     for (auto& dev : device_list) {
+ *       monitor.add_port(adverbs::port_counters::path(dev->ibdev_path, 1));
+ *     }
+ *     // Every second or so:
+ *     monitor.sample();
+ *     auto* dev = device_list[monitor.best_port()];
+ */
+class port_health_monitor {
+ public:
+  explicit port_health_monitor(const port_health_options& options = {})
+      : _options(options) {}
+
+  /**
+   * Monitor a port.
+   *
+   * @param counters_dir Its counters directory; see port_counters::path().
+   * @return The port's index.
+   */
+  size_t add_port(const std::string& counters_dir);
+
+  /**
+   * Read every port's counters and update their health.
+   */
+  void sample();
+
+  /**
+   * Update a port's health from counters read seconds after the previous
+   * ones. The first update only sets the baseline.
+   *
+   * @throws std::out_of_range if port is not monitored.
+   */
+  void update(size_t port, const port_counters& counters, double seconds);
+
+  [[nodiscard]]
+  const port_health& health(size_t port) const {
+    return _ports.at(port).health;
+  }
+
+  [[nodiscard]]
+  size_t size() const {
+    return _ports.size();
+  }
+
+  /**
+   * The healthiest port: the best state, then the highest score, then the
+   * lowest index.
+   *
+   * @throws std::out_of_range if no port is monitored.
+   */
+  [[nodiscard]]
+  size_t best_port() const;
+
+  /**
+   * Shares of traffic per port, summing to 1: by score among the ports in
+   * the best state present, zero for the rest.
+   */
+  [[nodiscard]]
+  std::vector<double> traffic_weights() const;
+
+ private:
+  struct port {
+    std::string dir;
+    port_health health;
+    std::chrono::steady_clock::time_point sampled;
+  };
+
+  double weighted_errors(const port_counters& from, const port_counters& to)
+      const;
+
+  port_health_options _options;
+  std::vector<port> _ports;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_PORT_HEALTH_H
@@ -0,0 +1,142 @@
+#include "prefault.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "per_core_runtime.h"
+
+namespace adverbs {
+
+std::vector<int> parse_cpu_list(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    range.erase(
+        std::remove_if(range.begin(), range.end(), ::isspace),
+        range.end());
+    if (range.empty()) continue;
+    size_t dash = range.find('-');
+    try {
+      int first = std::stoi(range.substr(0, dash));
+      int last = dash == std::string::npos ? first
+                                           : std::stoi(range.substr(dash + 1));
+      if (last < first) throw std::invalid_argument(range);
+      for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    } catch (const std::logic_error&) {
+      throw std::invalid_argument("malformed cpu list: " + list);
+    }
+  }
+  return cpus;
+}
+
+int device_numa_node(const struct ibv_device* device) {
+  std::ifstream in(std::string(device->ibdev_path) + "/device/numa_node");
+  int node = -1;
+  if (!(in >> node)) return -1;
+  return node;
+}
+
+std::vector<int> numa_node_cpus(int node) {
+  if (node < 0) return current_thread_cpus();
+  std::string path =
+      "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+  std::ifstream in(path);
+  std::string list;
+  if (!std::getline(in, list)) {
+    throw std::runtime_error("can't read " + path);
+  }
+  return parse_cpu_list(list);
+}
+
+void prefault(void* addr, size_t length, const prefault_options& options) {
+  if (length == 0) return;
+  std::vector<int> cpus = numa_node_cpus(options.numa_node);
+  if (cpus.empty()) {
+    throw std::runtime_error("no CPUs to prefault from");
+  }
+
+  const auto page = (size_t)sysconf(_SC_PAGESIZE);
+  auto begin = reinterpret_cast<uintptr_t>(addr) & ~(uintptr_t)(page - 1);
+  auto end = reinterpret_cast<uintptr_t>(addr) + length;
+  size_t pages = (end - begin + page - 1) / page;
+
+  size_t threads = options.threads ? options.threads : cpus.size();
+  threads = std::max<size_t>(1, std::min(threads, pages));
+  size_t per_thread = (pages + threads - 1) / threads;
+
+  std::vector<std::exception_ptr> errors(threads);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      try {
+        pin_current_thread(cpus[t % cpus.size()]);
+        uintptr_t first = begin + t * per_thread * page;
+        uintptr_t last = std::min(end, first + per_thread * page);
+        bool populated = false;
+#ifdef MADV_POPULATE_WRITE
+        // Linux 5.14+: write-fault the pages without touching them, from
+        // this (pinned) thread.
+        populated = first < last &&
+                    madvise(
+                        reinterpret_cast<void*>(first),
+                        last - first,
+                        MADV_POPULATE_WRITE) == 0;
+#endif
+        for (uintptr_t p = std::max(first, (uintptr_t)addr);
+             !populated && p < last;
+             p = (p & ~(uintptr_t)(page - 1)) + page) {
+          // A write fault which keeps the byte's value; volatile so the
+          // store of what was just loaded isn't elided, leaving a read
+          // fault that maps the shared zero page.
+          auto* byte = reinterpret_cast<volatile unsigned char*>(p);
+          *byte = *byte;
+        }
+        if (options.lock && first < last) {
+          auto lock_first = std::max(first, (uintptr_t)addr);
+          if (mlock(reinterpret_cast<void*>(lock_first), last - lock_first)) {
+            throw std::runtime_error("mlock failed");
+          }
+        }
+      } catch (...) {
+        errors[t] = std::current_exception();
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+  for (auto& error : errors) {
+    if (error) std::rethrow_exception(error);
+  }
+}
+
+prefaulted_buffer::prefaulted_buffer(
+    size_t length,
+    const prefault_options& options,
+    bool populate)
+    : _length(length) {
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (populate) flags |= MAP_POPULATE;
+  if (options.lock && populate) flags |= MAP_LOCKED;
+  _data = mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (_data == MAP_FAILED) {
+    throw std::runtime_error("mmap failed");
+  }
+  try {
+    if (!populate) prefault(_data, length, options);
+  } catch (...) {
+    munmap(_data, length);
+    throw;
+  }
+}
+
+prefaulted_buffer::~prefaulted_buffer() { munmap(_data, _length); }
+
+}  // namespace adverbs
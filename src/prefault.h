@@ -0,0 +1,103 @@
+#ifndef ADVERBS_PREFAULT_H
+#define ADVERBS_PREFAULT_H
+
+#include <infiniband/verbs.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace adverbs {
+
+/**
+ * Parse a sysfs CPU list such as "0-3,8,10-11".
+ *
+ * @throws std::invalid_argument if the list is malformed.
+ */
+std::vector<int> parse_cpu_list(const std::string& list);
+
+/**
+ * The NUMA node a device is attached to, from its sysfs topology.
+ *
+ * @return The node, or -1 if unknown (or the machine is not NUMA).
+ */
+int device_numa_node(const struct ibv_device* device);
+
+/**
+ * The CPUs of a NUMA node; for node < 0, the calling thread's CPUs.
+ *
+ * @throws std::runtime_error if the node's CPU list can't be read.
+ */
+std::vector<int> numa_node_cpus(int node);
+
+struct prefault_options {
+  // The node whose CPUs do the touching, so pages land on it under the
+  // default local allocation policy; -1 uses the caller's CPUs.
+  int numa_node = -1;
+  // Worker threads; 0 uses one per CPU of the node.
+  size_t threads = 0;
+  // Also mlock() the range, so it stays resident until registration.
+  bool lock = false;
+};
+
+/**
+ * Fault in every page of a range before it is registered, in parallel.
+ *
+ * Each worker is pinned to a CPU of options.numa_node and write-faults its
+ * share of the pages, with MADV_POPULATE_WRITE where the kernel has it and
+ * otherwise by writing back each page's first byte, so existing contents
+ * are kept. The range must not be written concurrently.
+ * Registering the range afterwards no longer pays for the page faults,
+ * single-threaded, inside ibv_reg_mr, and the pages sit on the device's
+ * socket.
+ *
+ * Example usage:
+ *
+ *     adverbs::prefault(
+ *         buffer, length, {.numa_node = adverbs::device_numa_node(dev)});
+ *     adverbs::memory_region_handle mr(pd, buffer, length, access);
+ *
+ * @throws std::runtime_error if mlock fails or no CPUs are available.
+ */
+void prefault(void* addr, size_t length, const prefault_options& options);
+
+/**
+ * RAII anonymous mapping, prefaulted for registration.
+ *
+ * With populate set the kernel faults the mapping in at mmap() time
+ * (MAP_POPULATE), on the calling thread's node; otherwise it is
+ * prefaulted in parallel with prefault().
+ */
+class prefaulted_buffer {
+ public:
+  /**
+   * @throws std::runtime_error if mmap, prefaulting or mlock fails.
+   */
+  prefaulted_buffer(
+      size_t length,
+      const prefault_options& options = {},
+      bool populate = false);
+
+  ~prefaulted_buffer();
+
+  prefaulted_buffer(const prefaulted_buffer&) = delete;
+  prefaulted_buffer& operator=(const prefaulted_buffer&) = delete;
+
+  [[nodiscard]]
+  void* data() const {
+    return _data;
+  }
+
+  [[nodiscard]]
+  size_t length() const {
+    return _length;
+  }
+
+ private:
+  void* _data;
+  size_t _length;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_PREFAULT_H
@@ -0,0 +1,214 @@
+#include "rail_assignment.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace adverbs {
+
+namespace {
+
+constexpr uint64_t table_magic = 0x534c494152564441;  // "ADVRAILS"
+constexpr uint32_t table_version = 1;
+constexpr size_t table_slots = 512;
+
+struct claim {
+  int32_t pid;
+  uint8_t port;
+  char device[IBV_SYSFS_NAME_MAX];
+};
+
+struct claim_table {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t slots;
+  claim claims[table_slots];
+};
+
+[[noreturn]] void fail(const std::string& what) {
+  throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+bool alive(int32_t pid) {
+  return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+bool holds(const claim& c, const nic_rail& rail) {
+  return c.port == rail.port &&
+         std::strncmp(c.device, rail.device.c_str(), IBV_SYSFS_NAME_MAX) == 0;
+}
+
+// Holds an flock() for its lifetime.
+class file_lock {
+ public:
+  explicit file_lock(int fd) : _fd(fd) {
+    while (flock(_fd, LOCK_EX)) {
+      if (errno != EINTR) fail("rail table flock failed");
+    }
+  }
+
+  ~file_lock() {
+    flock(_fd, LOCK_UN);
+  }
+
+ private:
+  int _fd;
+};
+
+}  // namespace
+
+std::vector<nic_rail> discover_rails(const std::vector<std::string>& paths) {
+  namespace fs = std::filesystem;
+  std::vector<nic_rail> rails;
+  for (const auto& path : paths) {
+    int node = -1;
+    std::ifstream(path + "/device/numa_node") >> node;
+    std::vector<uint8_t> ports;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(path + "/ports", ec)) {
+      int state = 0;
+      std::ifstream(entry.path() / "state") >> state;
+      if (state != IBV_PORT_ACTIVE) continue;
+      ports.push_back((uint8_t)std::stoi(entry.path().filename().string()));
+    }
+    std::sort(ports.begin(), ports.end());
+    std::string name = fs::path(path).filename().string();
+    for (uint8_t port : ports) rails.push_back({name, port, node});
+  }
+  return rails;
+}
+
+std::vector<nic_rail> discover_rails(const scoped_device_list& devices) {
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < devices.size(); ++i) {
+    paths.emplace_back(devices[i]->ibdev_path);
+  }
+  return discover_rails(paths);
+}
+
+size_t choose_rail(
+    const std::vector<nic_rail>& rails,
+    std::span<const uint32_t> load,
+    int numa_node) {
+  if (rails.empty()) {
+    throw std::invalid_argument("no rails to choose from");
+  }
+  if (load.size() != rails.size()) {
+    throw std::invalid_argument("one load per rail is required");
+  }
+  auto key = [&](size_t i) {
+    bool remote = numa_node >= 0 && rails[i].numa_node != numa_node;
+    return std::make_pair(load[i], remote);
+  };
+  size_t best = 0;
+  for (size_t i = 1; i < rails.size(); ++i) {
+    if (key(i) < key(best)) best = i;
+  }
+  return best;
+}
+
+int current_numa_node() {
+  unsigned cpu = 0, node = 0;
+  if (getcpu(&cpu, &node)) return -1;
+  // On a machine without NUMA every CPU is on node 0 and every device on
+  // node -1; don't prefer anything there.
+  if (!std::filesystem::exists("/sys/devices/system/node/node1")) return -1;
+  return (int)node;
+}
+
+rail_lease::rail_lease(
+    const std::string& path,
+    const std::vector<nic_rail>& rails,
+    int numa_node) {
+  if (rails.empty()) {
+    throw std::invalid_argument("no rails to lease");
+  }
+  if (numa_node == detect_numa_node) numa_node = current_numa_node();
+
+  _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (_fd < 0) fail("can't open rail table " + path);
+  try {
+    file_lock lock(_fd);
+    if (ftruncate(_fd, sizeof(claim_table))) fail("rail table ftruncate");
+    _table = mmap(
+        nullptr,
+        sizeof(claim_table),
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED,
+        _fd,
+        0);
+    if (_table == MAP_FAILED) fail("rail table mmap failed");
+    auto* table = static_cast<claim_table*>(_table);
+    if (table->magic == 0) {
+      table->magic = table_magic;
+      table->version = table_version;
+      table->slots = table_slots;
+    } else if (
+        table->magic != table_magic || table->version != table_version) {
+      munmap(_table, sizeof(claim_table));
+      throw std::runtime_error(path + " is not a rail table");
+    }
+
+    std::vector<uint32_t> load(rails.size());
+    _slot = table_slots;
+    for (size_t s = 0; s < table_slots; ++s) {
+      claim& c = table->claims[s];
+      if (c.pid && !alive(c.pid)) c = {};
+      if (!c.pid) {
+        _slot = std::min(_slot, s);
+        continue;
+      }
+      for (size_t i = 0; i < rails.size(); ++i) {
+        if (holds(c, rails[i])) load[i]++;
+      }
+    }
+    if (_slot == table_slots) {
+      munmap(_table, sizeof(claim_table));
+      throw std::runtime_error(path + " is full");
+    }
+
+    _index = choose_rail(rails, load, numa_node);
+    _rail = rails[_index];
+    claim& mine = table->claims[_slot];
+    mine.pid = (int32_t)getpid();
+    mine.port = _rail.port;
+    std::strncpy(mine.device, _rail.device.c_str(), IBV_SYSFS_NAME_MAX);
+  } catch (...) {
+    ::close(_fd);
+    throw;
+  }
+}
+
+rail_lease::rail_lease(rail_lease&& other) noexcept
+    : _fd(other._fd),
+      _table(other._table),
+      _slot(other._slot),
+      _index(other._index),
+      _rail(std::move(other._rail)) {
+  other._fd = -1;
+  other._table = nullptr;
+}
+
+rail_lease::~rail_lease() {
+  if (!_table) return;
+  // Not file_lock, which throws. Clearing the claim unlocked at worst lets
+  // a concurrent chooser count this rail once too often.
+  while (flock(_fd, LOCK_EX) && errno == EINTR) {
+  }
+  static_cast<claim_table*>(_table)->claims[_slot] = {};
+  flock(_fd, LOCK_UN);
+  munmap(_table, sizeof(claim_table));
+  ::close(_fd);
+}
+
+}  // namespace adverbs
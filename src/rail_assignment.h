@@ -0,0 +1,128 @@
+#ifndef ADVERBS_RAIL_ASSIGNMENT_H
+#define ADVERBS_RAIL_ASSIGNMENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "adverbs.h"
+
+namespace adverbs {
+
+/**
+ * One active port of one device: the unit handed out to a process.
+ */
+struct nic_rail {
+  std::string device;
+  uint8_t port = 1;
+  // The device's NUMA node, or -1 if unknown.
+  int numa_node = -1;
+};
+
+/**
+ * The active ports of the devices under the given ibdev paths
+ * (/sys/class/infiniband/<name>), in order, read from sysfs.
+ */
+std::vector<nic_rail> discover_rails(const std::vector<std::string>& paths);
+
+/**
+ * The active ports of every device in the list.
+ */
+std::vector<nic_rail> discover_rails(const scoped_device_list& devices);
+
+/**
+ * Pick the rail for one more process: the least loaded, preferring rails on
+ * numa_node among equally loaded ones, then the lowest index.
+ *
+ * Spreading comes before locality, so processes share a NIC only once every
+ * NIC is taken; with ranks spread evenly over the sockets, each ends up on
+ * its own NIC on its own socket.
+ *
+ * @param rails The candidates.
+ * @param load How many processes hold each rail.
+ * @param numa_node The caller's node, or -1 for no preference.
+ * @return The rail's index.
+ * @throws std::invalid_argument if rails is empty or load is the wrong size.
+ */
+size_t choose_rail(
+    const std::vector<nic_rail>& rails,
+    std::span<const uint32_t> load,
+    int numa_node);
+
+/**
+ * The NUMA node of the CPU the caller is running on, or -1 if unknown.
+ */
+int current_numa_node();
+
+/**
+ * Passed as rail_lease's numa_node to use current_numa_node().
+ */
+constexpr int detect_numa_node = -2;
+
+/**
+ * A rail claimed in a node-local coordination file.
+ *
+ * Each local process of a job constructs one with the same path (say,
+ * /dev/shm/<job>.rails) and the same rails; under an flock() on the
+ * file, it counts the live claims per rail, picks one with choose_rail()
+ * and records its own. Claims of processes that died without releasing
+ * are dropped, so restarted ranks don't leave rails looking busy.
+ *
+ * Example usage:
+ *
+ *     adverbs::scoped_device_list devices;
+ *     adverbs::rail_lease lease(
+ *         "/dev/shm/" + job_id + ".rails", adverbs::discover_rails(devices));
+ *     adverbs::context_handle context(
+ *         devices.lookup_by_name(lease.rail().device.c_str()));
+ *     // ... use port lease.rail().port ...
+ */
+class rail_lease {
+ public:
+  /**
+   * Claim a rail.
+   *
+   * @param path The coordination file; created if missing.
+   * @param rails The rails to share out, the same in every process.
+   * @param numa_node The caller's node, -1 for no preference, or
+   *    detect_numa_node to use current_numa_node().
+   * @throws std::invalid_argument if rails is empty.
+   * @throws std::runtime_error if the file can't be used or is full.
+   */
+  rail_lease(
+      const std::string& path,
+      const std::vector<nic_rail>& rails,
+      int numa_node = detect_numa_node);
+
+  /**
+   * Release the claim.
+   */
+  ~rail_lease();
+
+  rail_lease(rail_lease&& other) noexcept;
+  rail_lease& operator=(rail_lease&&) = delete;
+  rail_lease(const rail_lease&) = delete;
+
+  [[nodiscard]]
+  const nic_rail& rail() const {
+    return _rail;
+  }
+
+  [[nodiscard]]
+  size_t index() const {
+    return _index;
+  }
+
+ private:
+  int _fd;
+  void* _table;
+  size_t _slot;
+  size_t _index;
+  nic_rail _rail;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_RAIL_ASSIGNMENT_H
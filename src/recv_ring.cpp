@@ -0,0 +1,122 @@
+#include "recv_ring.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "mr_profiler.h"
+
+namespace adverbs {
+
+recv_ring::recv_ring(
+    struct ibv_qp* qp,
+    void* slab,
+    size_t slab_length,
+    uint32_t lkey,
+    const recv_ring_options& options)
+    : recv_ring(qp, nullptr, slab, slab_length, lkey, options) {}
+
+recv_ring::recv_ring(
+    struct ibv_srq* srq,
+    void* slab,
+    size_t slab_length,
+    uint32_t lkey,
+    const recv_ring_options& options)
+    : recv_ring(nullptr, srq, slab, slab_length, lkey, options) {}
+
+recv_ring::recv_ring(
+    struct ibv_qp* qp,
+    struct ibv_srq* srq,
+    void* slab,
+    size_t slab_length,
+    uint32_t lkey,
+    const recv_ring_options& options)
+    : _qp(qp),
+      _srq(srq),
+      _slab(static_cast<std::byte*>(slab)),
+      _options(options) {
+  if (!options.depth || !options.buffer_size || !options.batch) {
+    throw std::invalid_argument(
+        "recv_ring depth, buffer_size and batch must be positive");
+  }
+  if (slab_length / options.buffer_size < options.depth) {
+    throw std::invalid_argument("recv_ring slab is too small");
+  }
+  _wrs.resize(options.depth);
+  _sges.resize(options.depth);
+  _state.assign(options.depth, slot_state::held);
+  for (size_t i = 0; i < options.depth; ++i) {
+    _sges[i].addr = (uint64_t)(uintptr_t)(_slab + i * options.buffer_size);
+    _sges[i].length = (uint32_t)options.buffer_size;
+    _sges[i].lkey = lkey;
+    _wrs[i].wr_id = i;
+    _wrs[i].sg_list = &_sges[i];
+    _wrs[i].num_sge = 1;
+  }
+}
+
+void recv_ring::link(size_t i) {
+  _wrs[i].next = nullptr;
+  if (_tail) {
+    _tail->next = &_wrs[i];
+  } else {
+    _head = &_wrs[i];
+  }
+  _tail = &_wrs[i];
+  _state[i] = slot_state::pending;
+  ++_pending;
+}
+
+void recv_ring::post_chain(size_t count) {
+  struct ibv_recv_wr* first = _head;
+  struct ibv_recv_wr* last = first;
+  for (size_t k = 1; k < count; ++k) last = last->next;
+  struct ibv_recv_wr* rest = last->next;
+  last->next = nullptr;
+
+  struct ibv_recv_wr* bad_wr = nullptr;
+  note_posted(_srq ? _srq->context : _qp->context, first);
+  int rc = _srq ? ibv_post_srq_recv(_srq, first, &bad_wr)
+                : ibv_post_recv(_qp, first, &bad_wr);
+  // On failure, WRs before bad_wr were posted; the rest stay pending.
+  struct ibv_recv_wr* stop = rc ? (bad_wr ? bad_wr : first) : nullptr;
+  size_t posted = 0;
+  for (auto* wr = first; wr != stop; wr = wr->next) {
+    _state[wr->wr_id] = slot_state::posted;
+    ++posted;
+  }
+  _pending -= posted;
+  _posted += posted;
+  if (rc) {
+    last->next = rest;
+    _head = stop;
+    if (!rest) _tail = last;
+    throw std::runtime_error("ibv_post_recv failed");
+  }
+  _head = rest;
+  if (!rest) _tail = nullptr;
+}
+
+void recv_ring::fill() {
+  for (size_t i = 0; i < _state.size(); ++i) {
+    if (_state[i] == slot_state::held) link(i);
+  }
+  while (_pending) post_chain(std::min(_pending, _options.batch));
+}
+
+void recv_ring::release(uint64_t wr_id) {
+  if (wr_id >= _state.size()) {
+    throw std::out_of_range("wr_id is not a recv_ring buffer");
+  }
+  if (_state[wr_id] != slot_state::posted) {
+    throw std::invalid_argument("recv_ring buffer is not posted");
+  }
+  --_posted;
+  link(wr_id);
+  if (_pending >= _options.batch) flush();
+}
+
+void recv_ring::flush() {
+  if (_pending) post_chain(_pending);
+}
+
+}  // namespace adverbs
@@ -0,0 +1,161 @@
+#ifndef ADVERBS_RECV_RING_H
+#define ADVERBS_RECV_RING_H
+
+#include <infiniband/verbs.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace adverbs {
+
+struct recv_ring_options {
+  // Receive buffers, and so receives kept posted.
+  size_t depth = 512;
+  // Bytes per buffer.
+  size_t buffer_size = 4096;
+  // Consumed receives are reposted once this many are pending; 16 to 64
+  // amortizes the doorbell without starving the queue.
+  size_t batch = 32;
+};
+
+/**
+ * Keeps a QP's (or SRQ's) receive queue stocked from a registered slab.
+ *
+ * Buffer i is the slab's i-th buffer_size bytes, and its receive WR (wr_id
+ * i) and SGE are built once. Released receives are linked onto a pending
+ * chain through the WRs' own next pointers and reposted with a single
+ * ibv_post_recv per batch, so steady-state receiving neither allocates nor
+ * rebuilds WRs, and costs one verbs call per batch rather than one per
+ * message.
+ *
+ * Example usage:
+ *
+ *     adverbs::recv_ring ring(qp, slab.addr(), slab.length(), slab.lkey());
+ *     ring.fill();
+ *     // For each receive completion:
+ *     handle(ring.buffer(wc.wr_id).first(wc.byte_len));
+ *     ring.release(wc.wr_id);
+ */
+class recv_ring {
+ public:
+  /**
+   * @param qp The QP whose receive queue to stock.
+   * @param slab The registered buffers, depth * buffer_size bytes or more.
+   * @param slab_length Its length.
+   * @param lkey Its lkey.
+   * @throws std::invalid_argument if the slab is too small or depth,
+   *    buffer_size or batch is zero.
+   */
+  recv_ring(
+      struct ibv_qp* qp,
+      void* slab,
+      size_t slab_length,
+      uint32_t lkey,
+      const recv_ring_options& options = {});
+
+  /**
+   * As above, stocking a shared receive queue.
+   */
+  recv_ring(
+      struct ibv_srq* srq,
+      void* slab,
+      size_t slab_length,
+      uint32_t lkey,
+      const recv_ring_options& options = {});
+
+  recv_ring(const recv_ring&) = delete;
+  recv_ring& operator=(const recv_ring&) = delete;
+
+  /**
+   * Post every buffer not already posted, batch at a time. Call once after
+   * the QP reaches INIT.
+   *
+   * @throws std::runtime_error if posting fails.
+   */
+  void fill();
+
+  /**
+   * The buffer a receive completion's wr_id refers to.
+   */
+  [[nodiscard]]
+  std::span<std::byte> buffer(uint64_t wr_id) const {
+    return {_slab + wr_id * _options.buffer_size, _options.buffer_size};
+  }
+
+  /**
+   * Hand a consumed buffer back; reposts the pending chain once it reaches
+   * the batch size.
+   *
+   * @param wr_id The completion's wr_id.
+   * @throws std::out_of_range if wr_id is not a buffer of this ring.
+   * @throws std::invalid_argument if the buffer isn't out for a receive.
+   * @throws std::runtime_error if posting fails; the unposted receives stay
+   *    pending.
+   */
+  void release(uint64_t wr_id);
+
+  /**
+   * Repost all pending receives now, e.g. before going idle.
+   *
+   * @throws std::runtime_error if posting fails; the unposted receives stay
+   *    pending.
+   */
+  void flush();
+
+  /**
+   * Receives currently posted.
+   */
+  [[nodiscard]]
+  size_t posted() const {
+    return _posted;
+  }
+
+  /**
+   * Receives released but not yet reposted.
+   */
+  [[nodiscard]]
+  size_t pending() const {
+    return _pending;
+  }
+
+  [[nodiscard]]
+  const recv_ring_options& options() const {
+    return _options;
+  }
+
+ private:
+  recv_ring(
+      struct ibv_qp* qp,
+      struct ibv_srq* srq,
+      void* slab,
+      size_t slab_length,
+      uint32_t lkey,
+      const recv_ring_options& options);
+
+  // Where a buffer is: with the application, on the pending chain, or
+  // posted to the receive queue.
+  enum class slot_state : uint8_t { held, pending, posted };
+
+  void link(size_t i);
+
+  // Post the first count WRs of the pending chain.
+  void post_chain(size_t count);
+
+  struct ibv_qp* _qp;
+  struct ibv_srq* _srq;
+  std::byte* _slab;
+  recv_ring_options _options;
+  std::vector<struct ibv_recv_wr> _wrs;
+  std::vector<struct ibv_sge> _sges;
+  std::vector<slot_state> _state;
+  struct ibv_recv_wr* _head = nullptr;
+  struct ibv_recv_wr* _tail = nullptr;
+  size_t _pending = 0;
+  size_t _posted = 0;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_RECV_RING_H
@@ -0,0 +1,189 @@
+#include "remote_allocator.h"
+
+#include <algorithm>
+#include <new>
+#include <optional>
+#include <stdexcept>
+
+namespace adverbs {
+
+chunk_server::chunk_server(
+    void* base,
+    size_t length,
+    uint32_t rkey,
+    size_t chunk_size)
+    : _base((uint64_t)(uintptr_t)base), _chunk_size(chunk_size), _rkey(rkey) {
+  if (chunk_size == 0 || chunk_size % buffer_arena::alignment ||
+      _base % buffer_arena::alignment) {
+    throw std::invalid_argument(
+        "chunk_server needs a 64-byte aligned pool and chunk size");
+  }
+  size_t n = length / chunk_size;
+  _allocated.assign(n, false);
+  _free.reserve(n);
+  // Hand out low addresses first.
+  for (size_t i = n; i > 0; --i) _free.push_back((uint32_t)(i - 1));
+}
+
+size_t chunk_server::free_chunks() const {
+  std::lock_guard lock(_mutex);
+  return _free.size();
+}
+
+chunk_reply chunk_server::handle(const chunk_request& request) {
+  chunk_reply reply;
+  reply.chunk_size = _chunk_size;
+  reply.rkey = _rkey;
+  std::lock_guard lock(_mutex);
+
+  if (request.op == chunk_op::allocate) {
+    uint32_t want = std::min(request.count, chunk_request::max_chunks);
+    while (reply.count < want && !_free.empty()) {
+      uint32_t index = _free.back();
+      _free.pop_back();
+      _allocated[index] = true;
+      reply.chunks[reply.count++] = _base + (uint64_t)index * _chunk_size;
+    }
+    if (want && reply.count == 0) reply.status = chunk_status::exhausted;
+    return reply;
+  }
+
+  if (request.op == chunk_op::release &&
+      request.count <= chunk_request::max_chunks) {
+    for (uint32_t i = 0; i < request.count; ++i) {
+      uint64_t addr = request.chunks[i];
+      uint64_t index = (addr - _base) / _chunk_size;
+      if (addr < _base || (addr - _base) % _chunk_size ||
+          index >= _allocated.size() || !_allocated[index]) {
+        reply.status = chunk_status::invalid;
+        continue;
+      }
+      _allocated[index] = false;
+      _free.push_back((uint32_t)index);
+      reply.count++;
+    }
+    return reply;
+  }
+
+  reply.status = chunk_status::invalid;
+  return reply;
+}
+
+remote_allocator::remote_allocator(
+    rpc_fn rpc,
+    const remote_allocator_options& options)
+    : _rpc(std::move(rpc)), _options(options) {
+  _options.refill_chunks = std::clamp<uint32_t>(
+      _options.refill_chunks,
+      1,
+      chunk_request::max_chunks);
+  _options.release_batch = std::clamp<uint32_t>(
+      _options.release_batch,
+      1,
+      chunk_request::max_chunks);
+}
+
+remote_allocator::~remote_allocator() {
+  for (const auto& [base, c] : _chunks) _to_release.push_back(base);
+  _chunks.clear();
+  try {
+    flush();
+  } catch (...) {
+    // The server reclaims a departed client's chunks its own way.
+  }
+}
+
+void remote_allocator::refill() {
+  chunk_request request;
+  request.op = chunk_op::allocate;
+  request.count = _options.refill_chunks;
+  _rpcs++;
+  chunk_reply reply = _rpc(request);
+  if (reply.count > chunk_request::max_chunks) {
+    throw std::runtime_error("remote_allocator: malformed chunk reply");
+  }
+  if (reply.status != chunk_status::ok || reply.count == 0) {
+    throw std::bad_alloc();
+  }
+  _chunk_size = reply.chunk_size;
+  _rkey = reply.rkey;
+  for (uint32_t i = 0; i < reply.count; ++i) {
+    uint64_t base = reply.chunks[i];
+    // The arena only does offset arithmetic; the memory is never touched.
+    _chunks[base].arena = std::make_unique<buffer_arena>(
+        reinterpret_cast<void*>((uintptr_t)base),
+        _chunk_size,
+        _rkey);
+    _empty++;
+  }
+  _current = reply.chunks[0];
+}
+
+remote_ptr remote_allocator::allocate(size_t size) {
+  if (_chunk_size && size > _chunk_size) {
+    throw std::invalid_argument("remote_allocator: allocation exceeds chunk");
+  }
+  auto carve = [&](uint64_t base, chunk& c) -> std::optional<remote_ptr> {
+    std::byte* data = c.arena->allocate(size);
+    if (!data) return std::nullopt;
+    if (c.live++ == 0) _empty--;
+    _current = base;
+    return remote_ptr{(uint64_t)(uintptr_t)data, _rkey};
+  };
+
+  if (auto it = _chunks.find(_current); it != _chunks.end()) {
+    if (auto ptr = carve(it->first, it->second)) return *ptr;
+  }
+  for (auto& [base, c] : _chunks) {
+    if (auto ptr = carve(base, c)) return *ptr;
+  }
+  refill();
+  if (size > _chunk_size) {
+    throw std::invalid_argument("remote_allocator: allocation exceeds chunk");
+  }
+  return *carve(_current, _chunks.at(_current));
+}
+
+void remote_allocator::deallocate(remote_ptr ptr, size_t size) {
+  auto it = _chunks.upper_bound(ptr.addr);
+  if (it == _chunks.begin() ||
+      ptr.addr >= std::prev(it)->first + _chunk_size) {
+    throw std::invalid_argument("remote_allocator: pointer not in a chunk");
+  }
+  --it;
+  chunk& c = it->second;
+  if (c.live == 0) {
+    throw std::invalid_argument("remote_allocator: chunk has nothing to free");
+  }
+  c.arena->deallocate(
+      reinterpret_cast<std::byte*>((uintptr_t)ptr.addr),
+      size);
+  if (--c.live > 0) return;
+
+  if (++_empty <= _options.spare_chunks) return;
+  _empty--;
+  if (_current == it->first) _current = 0;
+  _to_release.push_back(it->first);
+  _chunks.erase(it);
+  if (_to_release.size() >= _options.release_batch) flush();
+}
+
+void remote_allocator::flush() {
+  while (!_to_release.empty()) {
+    chunk_request request;
+    request.op = chunk_op::release;
+    size_t n =
+        std::min<size_t>(_to_release.size(), chunk_request::max_chunks);
+    std::copy_n(_to_release.end() - n, n, request.chunks);
+    request.count = (uint32_t)n;
+    _rpcs++;
+    chunk_reply reply = _rpc(request);
+    if (reply.status != chunk_status::ok) {
+      throw std::runtime_error("remote_allocator: chunk release failed");
+    }
+    // Forget the chunks only once the server has them back.
+    _to_release.resize(_to_release.size() - n);
+  }
+}
+
+}  // namespace adverbs
@@ -0,0 +1,217 @@
+#ifndef ADVERBS_REMOTE_ALLOCATOR_H
+#define ADVERBS_REMOTE_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "adverbs.h"
+#include "buffer_pool.h"
+
+namespace adverbs {
+
+enum class chunk_op : uint32_t {
+  allocate = 1,
+  release = 2,
+};
+
+enum class chunk_status : uint32_t {
+  ok = 0,
+  // No chunks were free.
+  exhausted = 1,
+  // A released chunk wasn't one the server handed out.
+  invalid = 2,
+};
+
+/**
+ * A chunk RPC request. Fixed size and trivially copyable, so it can be
+ * sent as-is in a SEND.
+ */
+struct chunk_request {
+  static constexpr uint32_t max_chunks = 30;
+
+  chunk_op op = chunk_op::allocate;
+  // allocate: chunks wanted; release: entries of chunks.
+  uint32_t count = 0;
+  uint64_t chunks[max_chunks] = {};
+};
+
+/**
+ * A chunk RPC reply.
+ */
+struct chunk_reply {
+  chunk_status status = chunk_status::ok;
+  // allocate: entries of chunks granted, possibly fewer than asked for.
+  uint32_t count = 0;
+  uint64_t chunk_size = 0;
+  uint32_t rkey = 0;
+  uint32_t reserved = 0;
+  uint64_t chunks[chunk_request::max_chunks] = {};
+};
+
+static_assert(std::is_trivially_copyable_v<chunk_request>);
+static_assert(std::is_trivially_copyable_v<chunk_reply>);
+
+/**
+ * The memory server's side: hands out fixed-size chunks of a registered
+ * pool.
+ *
+ * The server only keeps a free list; clients sub-allocate within their
+ * chunks without involving it. handle() is called by whatever transport
+ * carries the RPC and is thread-safe.
+ */
+class chunk_server {
+ public:
+  /**
+   * @param base The pool's (64-byte aligned) address.
+   * @param length The pool's length; a trailing partial chunk is unused.
+   * @param rkey The pool's rkey, handed to clients.
+   * @param chunk_size The chunk size; a non-zero multiple of 64.
+   * @throws std::invalid_argument if the pool or chunk size is unusable.
+   */
+  chunk_server(void* base, size_t length, uint32_t rkey, size_t chunk_size);
+
+  chunk_server(memory_region_handle& mr, size_t chunk_size)
+      : chunk_server(mr.addr(), mr.length(), mr.rkey(), chunk_size) {}
+
+  chunk_reply handle(const chunk_request& request);
+
+  [[nodiscard]]
+  size_t chunk_size() const {
+    return _chunk_size;
+  }
+
+  [[nodiscard]]
+  size_t total_chunks() const {
+    return _allocated.size();
+  }
+
+  [[nodiscard]]
+  size_t free_chunks() const;
+
+ private:
+  uint64_t _base;
+  size_t _chunk_size;
+  uint32_t _rkey;
+  mutable std::mutex _mutex;
+  std::vector<uint32_t> _free;
+  std::vector<bool> _allocated;
+};
+
+/**
+ * An address in a memory server's pool.
+ */
+struct remote_ptr {
+  uint64_t addr = 0;
+  uint32_t rkey = 0;
+};
+
+struct remote_allocator_options {
+  // Chunks asked for per allocate RPC.
+  uint32_t refill_chunks = 4;
+  // Empty chunks returned per release RPC.
+  uint32_t release_batch = 8;
+  // Empty chunks kept rather than returned, to absorb churn.
+  uint32_t spare_chunks = 1;
+};
+
+/**
+ * The client's side: sub-allocates remote memory from cached chunks.
+ *
+ * Chunks are obtained from a chunk_server a few at a time; allocations
+ * within them are local (a buffer_arena per chunk) and cost no round
+ * trips. Chunks which empty out are queued and returned in batches.
+ *
+ * The RPC transport is supplied by the caller, typically a SEND of the
+ * request and a RECV of the reply on a connection to the memory server.
+ * An allocator is not thread-safe; use one per thread.
+ *
+ * Example usage:
+ *
+ *     adverbs::remote_allocator alloc([&](const adverbs::chunk_request& r) {
+ *       return rpc_client.call(r);
+ *     });
+ *     auto ptr = alloc.allocate(4096);
+ *     ... RDMA WRITE to ptr.addr with ptr.rkey ...
+ *     alloc.deallocate(ptr, 4096);
+ */
+class remote_allocator {
+ public:
+  using rpc_fn = std::function<chunk_reply(const chunk_request&)>;
+
+  explicit remote_allocator(
+      rpc_fn rpc,
+      const remote_allocator_options& options = {});
+
+  /**
+   * Returns every chunk to the server.
+   */
+  ~remote_allocator();
+
+  remote_allocator(const remote_allocator&) = delete;
+  remote_allocator& operator=(const remote_allocator&) = delete;
+
+  /**
+   * @throws std::invalid_argument if size exceeds the chunk size.
+   * @throws std::bad_alloc if the server has no chunks left.
+   * @throws std::runtime_error if the server's reply is malformed.
+   */
+  remote_ptr allocate(size_t size);
+
+  /**
+   * Free an allocation; size must match the allocate() call.
+   *
+   * @throws std::invalid_argument if ptr isn't in one of our chunks, or
+   *    its chunk has no live allocations (a double free).
+   * @throws std::runtime_error as flush() does, if a batch of empty
+   *    chunks is due.
+   */
+  void deallocate(remote_ptr ptr, size_t size);
+
+  /**
+   * Return queued empty chunks now.
+   *
+   * @throws std::runtime_error if the server rejects a release; the
+   *    chunks stay queued for the next flush. Exceptions from the RPC
+   *    propagate the same way.
+   */
+  void flush();
+
+  [[nodiscard]]
+  size_t chunks() const {
+    return _chunks.size();
+  }
+
+  [[nodiscard]]
+  size_t rpcs() const {
+    return _rpcs;
+  }
+
+ private:
+  struct chunk {
+    std::unique_ptr<buffer_arena> arena;
+    size_t live = 0;
+  };
+
+  void refill();
+
+  rpc_fn _rpc;
+  remote_allocator_options _options;
+  uint64_t _chunk_size = 0;
+  uint32_t _rkey = 0;
+  // chunk base -> chunk
+  std::map<uint64_t, chunk> _chunks;
+  uint64_t _current = 0;
+  size_t _empty = 0;
+  std::vector<uint64_t> _to_release;
+  size_t _rpcs = 0;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_REMOTE_ALLOCATOR_H
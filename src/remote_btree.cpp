@@ -0,0 +1,292 @@
+#include "remote_btree.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "mr_profiler.h"
+
+namespace adverbs {
+
+namespace {
+
+// Deeper than any real tree; stops a walk looping through corrupt links.
+constexpr size_t max_depth = 64;
+
+}  // namespace
+
+size_t btree_node::index_of(uint64_t key) const {
+  size_t n = std::min<size_t>(count, fanout);
+  size_t i = std::upper_bound(keys, keys + n, key) - keys;
+  return i ? i - 1 : 0;
+}
+
+rdma_btree_reader::rdma_btree_reader(
+    struct ibv_qp* qp,
+    struct ibv_cq* cq,
+    uint32_t rkey,
+    btree_node* staging,
+    size_t staging_nodes,
+    uint32_t lkey)
+    : _qp(qp),
+      _cq(cq),
+      _rkey(rkey),
+      _staging(staging),
+      _staging_nodes(staging_nodes),
+      _lkey(lkey),
+      _wrs(staging_nodes),
+      _sges(staging_nodes) {
+  if (staging_nodes == 0) {
+    throw std::invalid_argument("rdma_btree_reader: no staging space");
+  }
+}
+
+void rdma_btree_reader::read(
+    std::span<const uint64_t> addrs,
+    std::span<btree_node> out) {
+  for (size_t first = 0; first < addrs.size(); first += _staging_nodes) {
+    size_t n = std::min(_staging_nodes, addrs.size() - first);
+    for (size_t i = 0; i < n; ++i) {
+      _sges[i] = {
+          (uint64_t)(uintptr_t)&_staging[i],
+          sizeof(btree_node),
+          _lkey};
+      struct ibv_send_wr& wr = _wrs[i];
+      wr = {};
+      wr.wr_id = first + i;
+      wr.next = i + 1 < n ? &_wrs[i + 1] : nullptr;
+      wr.sg_list = &_sges[i];
+      wr.num_sge = 1;
+      wr.opcode = IBV_WR_RDMA_READ;
+      // The last READ's completion implies the others'.
+      wr.send_flags = i + 1 < n ? 0 : IBV_SEND_SIGNALED;
+      wr.wr.rdma.remote_addr = addrs[first + i];
+      wr.wr.rdma.rkey = _rkey;
+    }
+    struct ibv_send_wr* bad_wr = nullptr;
+    note_posted(_qp->context, _wrs.data());
+    if (ibv_post_send(_qp, _wrs.data(), &bad_wr)) {
+      throw std::runtime_error("ibv_post_send failed");
+    }
+    // Only the last READ is signaled, but a failed READ completes with an
+    // error whether signaled or not, and the rest are then flushed.
+    uint64_t signaled = first + n - 1;
+    for (;;) {
+      struct ibv_wc wc;
+      int polled = ibv_poll_cq(_cq, 1, &wc);
+      if (polled < 0) {
+        throw std::runtime_error("ibv_poll_cq failed");
+      }
+      if (polled == 0) continue;
+      if (wc.status != IBV_WC_SUCCESS) {
+        throw std::runtime_error(
+            std::string("btree node read failed: ") +
+            ibv_wc_status_str(wc.status));
+      }
+      if (wc.wr_id == signaled) break;
+    }
+    std::copy(_staging, _staging + n, out.begin() + first);
+  }
+}
+
+void remote_btree::read_node(uint64_t addr, btree_node& node) {
+  _stats.node_reads++;
+  _reader.read({&addr, 1}, {&node, 1});
+}
+
+void remote_btree::cache(uint64_t addr, const btree_node& node) {
+  if (_options.cache_capacity == 0) return;
+  evict(addr);
+  if (_cache.size() >= _options.cache_capacity) {
+    // Only the root is cached; keep it.
+    if (_lru.empty()) return;
+    evict(_lru.back());
+  }
+  auto lru = _lru.end();
+  if (addr != _root) lru = _lru.insert(_lru.begin(), addr);
+  _cache.emplace(addr, cached_node{node, lru});
+}
+
+void remote_btree::evict(uint64_t addr) {
+  auto it = _cache.find(addr);
+  if (it == _cache.end()) return;
+  if (it->second.lru != _lru.end()) _lru.erase(it->second.lru);
+  _cache.erase(it);
+}
+
+bool remote_btree::descend(
+    uint64_t key,
+    bool use_cache,
+    btree_node& leaf,
+    std::optional<btree_node>& parent) {
+  _path.clear();
+  parent.reset();
+  uint64_t addr = _root;
+  btree_node fetched;
+  for (size_t depth = 0; depth < max_depth; ++depth) {
+    const btree_node* node;
+    auto it = use_cache ? _cache.find(addr) : _cache.end();
+    if (it != _cache.end()) {
+      _stats.cache_hits++;
+      node = &it->second.node;
+      if (it->second.lru != _lru.end()) {
+        _lru.splice(_lru.begin(), _lru, it->second.lru);
+      }
+    } else {
+      if (use_cache) _stats.cache_misses++;
+      read_node(addr, fetched);
+      if (!fetched.consistent()) return false;
+      node = &fetched;
+    }
+
+    if (!node->covers(key)) {
+      // Reached through a stale pointer: forget how we got here.
+      for (uint64_t stale : _path) evict(stale);
+      evict(addr);
+      return false;
+    }
+    if (node->is_leaf()) {
+      leaf = *node;
+      return true;
+    }
+    if (node->count == 0) return false;
+    if (node->level == 1) parent = *node;
+    _path.push_back(addr);
+    uint64_t child = node->values[node->index_of(key)];
+    if (it == _cache.end()) cache(addr, *node);
+    addr = child;
+  }
+  return false;
+}
+
+bool remote_btree::find_leaf(
+    uint64_t key,
+    btree_node& leaf,
+    std::optional<btree_node>& parent) {
+  for (size_t attempt = 0; attempt <= _options.max_retries; ++attempt) {
+    if (attempt) _stats.retries++;
+    // Only the first attempt trusts the cache.
+    if (descend(key, attempt == 0, leaf, parent)) return true;
+  }
+  _stats.fallbacks++;
+  return false;
+}
+
+std::optional<uint64_t> remote_btree::lookup(uint64_t key) {
+  btree_node leaf;
+  std::optional<btree_node> parent;
+  if (!find_leaf(key, leaf, parent)) {
+    if (!_fallback.lookup) {
+      throw std::runtime_error("remote_btree: no server fallback for lookup");
+    }
+    return _fallback.lookup(key);
+  }
+  size_t i = leaf.index_of(key);
+  if (i < leaf.count && leaf.keys[i] == key) return leaf.values[i];
+  return std::nullopt;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> remote_btree::scan(
+    uint64_t low,
+    uint64_t high,
+    size_t limit) {
+  std::vector<std::pair<uint64_t, uint64_t>> out;
+  // Appends a leaf's pairs in [from, high).
+  auto take = [&](const btree_node& leaf, uint64_t from) {
+    size_t n = std::min<size_t>(leaf.count, btree_node::fanout);
+    for (size_t i = 0; i < n && out.size() < limit; ++i) {
+      if (leaf.keys[i] >= high) break;
+      if (leaf.keys[i] >= from) out.emplace_back(leaf.keys[i], leaf.values[i]);
+    }
+  };
+
+  uint64_t key = low;
+  size_t conflicts = 0;
+  std::vector<uint64_t> addrs;
+  std::vector<btree_node> leaves;
+  while (key < high && out.size() < limit) {
+    btree_node leaf;
+    std::optional<btree_node> parent;
+    if (conflicts > _options.max_retries || !find_leaf(key, leaf, parent)) {
+      if (conflicts > _options.max_retries) _stats.fallbacks++;
+      if (!_fallback.scan) {
+        throw std::runtime_error("remote_btree: no server fallback for scan");
+      }
+      auto rest = _fallback.scan(key, high, limit - out.size());
+      out.insert(out.end(), rest.begin(), rest.end());
+      return out;
+    }
+    take(leaf, key);
+    // Every key below next_key has been taken; the next leaf must start
+    // there. sibling is the last leaf's right link.
+    uint64_t next_key = leaf.high_key;
+    uint64_t sibling = leaf.next;
+    // Take the leaf at sibling if it continues the scan.
+    auto follow = [&]() {
+      if (!sibling) return false;
+      btree_node link;
+      read_node(sibling, link);
+      if (!link.consistent() || !link.is_leaf() || link.low_key != next_key ||
+          link.high_key <= next_key) {
+        return false;
+      }
+      // The parent didn't list this leaf: it is stale.
+      for (uint64_t stale : _path) evict(stale);
+      take(link, next_key);
+      next_key = link.high_key;
+      sibling = link.next;
+      return true;
+    };
+
+    if (parent) {
+      // Read the parent's remaining leaves in pipelined batches.
+      size_t i = parent->index_of(key) + 1;
+      size_t count = std::min<size_t>(parent->count, btree_node::fanout);
+      bool stop = false;
+      while (!stop && i < count && parent->keys[i] < high &&
+             out.size() < limit) {
+        addrs.clear();
+        for (size_t j = i; j < count && parent->keys[j] < high &&
+                           addrs.size() < _options.scan_pipeline;
+             ++j) {
+          addrs.push_back(parent->values[j]);
+        }
+        if (addrs.empty()) addrs.push_back(parent->values[i]);
+        leaves.resize(addrs.size());
+        _stats.node_reads += addrs.size();
+        _reader.read(addrs, leaves);
+        for (size_t j = 0; j < leaves.size(); ++j) {
+          const btree_node& next = leaves[j];
+          bool usable = next.consistent() && next.is_leaf();
+          // A leaf split since the parent was read is only reachable
+          // through its left sibling's link.
+          while (usable && next.low_key > next_key && next_key < high &&
+                 out.size() < limit && follow()) {
+          }
+          if (next_key >= high || out.size() >= limit) {
+            stop = true;
+            break;
+          }
+          if (!usable || next.low_key != next_key) {
+            // Torn, or the parent is stale: re-read it and resume from the
+            // last leaf's high key.
+            for (uint64_t stale : _path) evict(stale);
+            conflicts++;
+            stop = true;
+            break;
+          }
+          take(next, next_key);
+          next_key = next.high_key;
+          sibling = next.next;
+        }
+        i += addrs.size();
+      }
+    }
+
+    if (next_key <= key || next_key == btree_node::max_key) break;
+    key = next_key;
+  }
+  return out;
+}
+
+}  // namespace adverbs
@@ -0,0 +1,272 @@
+#ifndef ADVERBS_REMOTE_BTREE_H
+#define ADVERBS_REMOTE_BTREE_H
+
+#include <infiniband/verbs.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace adverbs {
+
+/**
+ * A B+tree node as laid out in the server's registered memory.
+ *
+ * Inner nodes (level > 0) hold count children: keys[i] is the smallest key
+ * under values[i], the child's remote address. Leaves (level 0) hold
+ * count sorted key/value pairs and link to their right sibling by next.
+ * Every node covers the keys in [low_key, high_key).
+ *
+ * Writers bracket changes with begin_update() and end_update(), which
+ * bump the version words at both ends of the node. A node read while it
+ * is changing has an odd or mismatched version pair; this relies on the
+ * NIC reading a node in increasing address order.
+ */
+struct btree_node {
+  static constexpr uint64_t max_key = UINT64_MAX;
+  static constexpr size_t fanout = 29;
+
+  uint64_t version = 0;
+  uint32_t level = 0;
+  uint32_t count = 0;
+  uint64_t low_key = 0;
+  uint64_t high_key = max_key;
+  uint64_t next = 0;
+  uint64_t keys[fanout] = {};
+  uint64_t values[fanout] = {};
+  uint64_t version_end = 0;
+
+  [[nodiscard]]
+  bool consistent() const {
+    return version == version_end && !(version & 1);
+  }
+
+  [[nodiscard]]
+  bool covers(uint64_t key) const {
+    return low_key <= key && key < high_key;
+  }
+
+  [[nodiscard]]
+  bool is_leaf() const {
+    return level == 0;
+  }
+
+  /**
+   * The index of the child (inner) or slot (leaf) at or before key.
+   */
+  [[nodiscard]]
+  size_t index_of(uint64_t key) const;
+
+  void begin_update() {
+    version_end = ++version;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+  }
+
+  void end_update() {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    version_end = ++version;
+  }
+};
+
+static_assert(sizeof(btree_node) == 512);
+
+/**
+ * Fetches nodes from the server; an RDMA transport or a test double.
+ */
+class btree_reader {
+ public:
+  virtual ~btree_reader() = default;
+
+  /**
+   * Read the nodes at addrs into out, which is the same size. Every read
+   * is complete on return.
+   */
+  virtual void read(
+      std::span<const uint64_t> addrs,
+      std::span<btree_node> out) = 0;
+};
+
+/**
+ * Reads nodes with chained RDMA READs over a dedicated QP.
+ */
+class rdma_btree_reader : public btree_reader {
+ public:
+  /**
+   * @param qp A connected QP used only by this reader.
+   * @param cq The QP's send CQ.
+   * @param rkey The rkey of the server's tree memory.
+   * @param staging Registered space for staging_nodes nodes.
+   * @param staging_nodes How many nodes are read per chain.
+   * @param lkey The staging buffer's lkey.
+   */
+  rdma_btree_reader(
+      struct ibv_qp* qp,
+      struct ibv_cq* cq,
+      uint32_t rkey,
+      btree_node* staging,
+      size_t staging_nodes,
+      uint32_t lkey);
+
+  /**
+   * @throws std::runtime_error if posting or any READ fails; the QP is then
+   *    in the error state.
+   */
+  void read(std::span<const uint64_t> addrs, std::span<btree_node> out)
+      override;
+
+ private:
+  struct ibv_qp* _qp;
+  struct ibv_cq* _cq;
+  uint32_t _rkey;
+  btree_node* _staging;
+  size_t _staging_nodes;
+  uint32_t _lkey;
+  std::vector<struct ibv_send_wr> _wrs;
+  std::vector<struct ibv_sge> _sges;
+};
+
+/**
+ * The server-side (two-sided) path, used when one-sided reads keep
+ * conflicting with writers.
+ */
+struct btree_fallback {
+  std::function<std::optional<uint64_t>(uint64_t key)> lookup;
+  // Up to limit pairs with keys in [low, high), ascending.
+  std::function<std::vector<std::pair<uint64_t, uint64_t>>(
+      uint64_t low,
+      uint64_t high,
+      size_t limit)>
+      scan;
+};
+
+struct remote_btree_options {
+  // Inner nodes kept locally. The least recently used one is evicted to
+  // make room, except the root.
+  size_t cache_capacity = 4096;
+  // Traversals retried (from the root, without the cache) before falling
+  // back to the server.
+  size_t max_retries = 4;
+  // Leaves read per batch during a scan.
+  size_t scan_pipeline = 8;
+};
+
+struct remote_btree_stats {
+  uint64_t cache_hits = 0;
+  uint64_t cache_misses = 0;
+  uint64_t node_reads = 0;
+  uint64_t retries = 0;
+  uint64_t fallbacks = 0;
+};
+
+/**
+ * A client for a B+tree hosted in a server's registered memory.
+ *
+ * Lookups and scans traverse the tree with one-sided reads, so the server
+ * CPU is not involved. Inner nodes are cached; a cached path is validated
+ * by the fence keys of the node it leads to, and a node which no longer
+ * covers the key (it was split or moved) evicts the path and the traversal
+ * is retried from the root. Torn reads are retried the same way. After
+ * max_retries the operation goes to the server.
+ *
+ * Scans read the leaves under each level-1 node in pipelined batches. Each
+ * leaf must start at the previous one's high key; a leaf split since the
+ * level-1 node was read is reached through its left sibling's next link.
+ *
+ * The root lives at a fixed address. A client is not thread-safe.
+ *
+ * Example usage:
+ *
+ *     adverbs::rdma_btree_reader reader(qp, cq, rkey, staging, 16, lkey);
+ *     adverbs::remote_btree tree(reader, root_addr, fallback);
+ *     auto value = tree.lookup(42);
+ *     auto rows = tree.scan(100, 200, 50);
+ */
+class remote_btree {
+ public:
+  remote_btree(
+      btree_reader& reader,
+      uint64_t root_addr,
+      btree_fallback fallback,
+      const remote_btree_options& options = {})
+      : _reader(reader),
+        _root(root_addr),
+        _fallback(std::move(fallback)),
+        _options(options) {}
+
+  /**
+   * @return The key's value, if present.
+   */
+  std::optional<uint64_t> lookup(uint64_t key);
+
+  /**
+   * @return Up to limit pairs with keys in [low, high), ascending.
+   */
+  std::vector<std::pair<uint64_t, uint64_t>> scan(
+      uint64_t low,
+      uint64_t high,
+      size_t limit = SIZE_MAX);
+
+  /**
+   * Drop every cached node.
+   */
+  void invalidate() {
+    _cache.clear();
+    _lru.clear();
+  }
+
+  [[nodiscard]]
+  size_t cached_nodes() const {
+    return _cache.size();
+  }
+
+  [[nodiscard]]
+  const remote_btree_stats& stats() const {
+    return _stats;
+  }
+
+ private:
+  // Walk to the leaf covering key; fills parent with the level-1 node when
+  // there is one. Returns false if the walk hit a stale or torn node.
+  bool descend(
+      uint64_t key,
+      bool use_cache,
+      btree_node& leaf,
+      std::optional<btree_node>& parent);
+
+  // Descend with retries; false once they're exhausted.
+  bool find_leaf(
+      uint64_t key,
+      btree_node& leaf,
+      std::optional<btree_node>& parent);
+
+  void read_node(uint64_t addr, btree_node& node);
+  void cache(uint64_t addr, const btree_node& node);
+  void evict(uint64_t addr);
+
+  struct cached_node {
+    btree_node node;
+    // Position in _lru; _lru.end() for the root, which is never evicted
+    // for space.
+    std::list<uint64_t>::iterator lru;
+  };
+
+  btree_reader& _reader;
+  uint64_t _root;
+  btree_fallback _fallback;
+  remote_btree_options _options;
+  remote_btree_stats _stats;
+  std::unordered_map<uint64_t, cached_node> _cache;
+  // Cached addresses other than the root's, most recently used first.
+  std::list<uint64_t> _lru;
+  std::vector<uint64_t> _path;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_REMOTE_BTREE_H
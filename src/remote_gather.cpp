@@ -0,0 +1,118 @@
+#include "remote_gather.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "mr_profiler.h"
+
+namespace adverbs {
+
+namespace {
+
+// A piece of an item of at most max_read bytes.
+struct piece {
+  uint64_t remote_addr;
+  uint32_t length;
+  size_t dense_offset;
+};
+
+}  // namespace
+
+gather_plan plan_gather(
+    std::span<const gather_item> items,
+    const gather_options& options) {
+  if (options.max_read == 0) {
+    throw std::invalid_argument("plan_gather: max_read must be positive");
+  }
+
+  gather_plan plan;
+  std::vector<piece> pieces;
+  pieces.reserve(items.size());
+  for (const auto& item : items) {
+    for (uint32_t done = 0; done < item.length;) {
+      uint32_t length = std::min(item.length - done, options.max_read);
+      pieces.push_back(
+          {item.remote_addr + done, length, plan.dense_bytes + done});
+      done += length;
+    }
+    plan.dense_bytes += item.length;
+  }
+  std::sort(pieces.begin(), pieces.end(), [](const piece& a, const piece& b) {
+    return a.remote_addr < b.remote_addr;
+  });
+
+  gather_read* read = nullptr;
+  for (const auto& p : pieces) {
+    uint64_t end = p.remote_addr + p.length;
+    if (read) {
+      uint64_t read_end = read->remote_addr + read->length;
+      uint64_t merged_end = std::max(read_end, end);
+      if (p.remote_addr <= read_end + options.max_gap &&
+          merged_end - read->remote_addr <= options.max_read) {
+        plan.staging_bytes += merged_end - read_end;
+        read->length = (uint32_t)(merged_end - read->remote_addr);
+        plan.copies.push_back(
+            {read->staging_offset + (p.remote_addr - read->remote_addr),
+             p.dense_offset,
+             p.length});
+        continue;
+      }
+    }
+    read = &plan.reads.emplace_back(
+        gather_read{p.remote_addr, p.length, plan.staging_bytes});
+    plan.staging_bytes += p.length;
+    plan.copies.push_back({read->staging_offset, p.dense_offset, p.length});
+  }
+  return plan;
+}
+
+size_t remote_gather::post(const gather_plan& plan, uint64_t wr_id) {
+  if (plan.staging_bytes > _staging_length) {
+    throw std::invalid_argument("remote_gather: staging buffer too small");
+  }
+  size_t chain = std::max<size_t>(1, _options.max_chain);
+  _wrs.resize(std::min(chain, plan.reads.size()));
+  _sges.resize(_wrs.size());
+
+  size_t signaled = 0;
+  for (size_t first = 0; first < plan.reads.size(); first += chain) {
+    size_t n = std::min(chain, plan.reads.size() - first);
+    for (size_t i = 0; i < n; ++i) {
+      const auto& read = plan.reads[first + i];
+      _sges[i] = {
+          (uint64_t)(uintptr_t)(_staging + read.staging_offset),
+          read.length,
+          _staging_lkey};
+      struct ibv_send_wr& wr = _wrs[i];
+      wr = {};
+      wr.wr_id = wr_id;
+      wr.next = i + 1 < n ? &_wrs[i + 1] : nullptr;
+      wr.sg_list = &_sges[i];
+      wr.num_sge = 1;
+      wr.opcode = IBV_WR_RDMA_READ;
+      wr.send_flags = i + 1 < n ? 0 : IBV_SEND_SIGNALED;
+      wr.wr.rdma.remote_addr = read.remote_addr;
+      wr.wr.rdma.rkey = _rkey;
+    }
+    struct ibv_send_wr* bad_wr = nullptr;
+    note_posted(_qp->context, _wrs.data());
+    if (ibv_post_send(_qp, _wrs.data(), &bad_wr)) {
+      throw gather_post_error(signaled);
+    }
+    ++signaled;
+  }
+  return signaled;
+}
+
+void remote_gather::scatter(const gather_plan& plan, void* dense) const {
+  auto* out = static_cast<std::byte*>(dense);
+  for (const auto& copy : plan.copies) {
+    std::memcpy(
+        out + copy.dense_offset,
+        _staging + copy.staging_offset,
+        copy.length);
+  }
+}
+
+}  // namespace adverbs
@@ -0,0 +1,172 @@
+#ifndef ADVERBS_REMOTE_GATHER_H
+#define ADVERBS_REMOTE_GATHER_H
+
+#include <infiniband/verbs.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace adverbs {
+
+/**
+ * One remote range to fetch, e.g. an embedding row.
+ */
+struct gather_item {
+  uint64_t remote_addr = 0;
+  uint32_t length = 0;
+};
+
+struct gather_options {
+  // Ranges separated by at most this many bytes are read together; the gap
+  // is read and discarded.
+  uint32_t max_gap = 64;
+  // The longest single RDMA READ; longer ranges are split.
+  uint32_t max_read = 1 << 20;
+  // READs chained into one ibv_post_send (one doorbell).
+  size_t max_chain = 32;
+};
+
+/**
+ * An RDMA READ of one coalesced range into the staging buffer.
+ */
+struct gather_read {
+  uint64_t remote_addr = 0;
+  uint32_t length = 0;
+  size_t staging_offset = 0;
+};
+
+/**
+ * A copy of one item (or piece of one) from staging to the dense output.
+ */
+struct gather_copy {
+  size_t staging_offset = 0;
+  size_t dense_offset = 0;
+  uint32_t length = 0;
+};
+
+/**
+ * How a list of items is fetched and laid out.
+ *
+ * Items land in the dense output in their original order, back to back.
+ */
+struct gather_plan {
+  std::vector<gather_read> reads;
+  std::vector<gather_copy> copies;
+  // Staging space the reads need.
+  size_t staging_bytes = 0;
+  // The dense output's length: the sum of the item lengths.
+  size_t dense_bytes = 0;
+};
+
+/**
+ * Plan a gather: sort the items by address, split ranges longer than
+ * max_read, and coalesce ranges which overlap or lie within max_gap of each
+ * other, as long as the merged read stays within max_read.
+ *
+ * @throws std::invalid_argument if max_read is 0.
+ */
+gather_plan plan_gather(
+    std::span<const gather_item> items,
+    const gather_options& options = {});
+
+/**
+ * Thrown when posting a gather fails after some of its chains were posted.
+ */
+class gather_post_error : public std::runtime_error {
+ public:
+  explicit gather_post_error(size_t signaled)
+      : std::runtime_error("ibv_post_send failed"), _signaled(signaled) {}
+
+  /**
+   * The signaled completions of the chains posted before the failure;
+   * they must still be reaped.
+   */
+  [[nodiscard]]
+  size_t signaled() const {
+    return _signaled;
+  }
+
+ private:
+  size_t _signaled;
+};
+
+/**
+ * Fetches scattered remote ranges with few RDMA READs and few doorbells.
+ *
+ * A gather is planned once per item list (plan_gather), posted as chains
+ * of READs into a registered staging buffer, and, once the READs complete,
+ * scattered into a dense output.
+ *
+ * Only the last READ of each chain is signaled; on an RC QP its completion
+ * implies the chain's earlier READs are done. The plan's READs must fit in
+ * the send queue.
+ *
+ * Example usage:
+ *
+ *     adverbs::remote_gather gather(qp, rkey, staging_mr);
+ *     auto plan = adverbs::plan_gather(rows);
+ *     size_t pending = gather.post(plan, request_id);
+ *     ... reap pending completions with wr_id request_id ...
+ *     gather.scatter(plan, dense.data());
+ */
+class remote_gather {
+ public:
+  /**
+   * @param qp The connected QP to read with.
+   * @param rkey The rkey of the remote ranges.
+   * @param staging The registered staging buffer.
+   * @param staging_length Its length.
+   * @param staging_lkey Its lkey.
+   * @param options The chain length is taken from here.
+   */
+  remote_gather(
+      struct ibv_qp* qp,
+      uint32_t rkey,
+      void* staging,
+      size_t staging_length,
+      uint32_t staging_lkey,
+      const gather_options& options = {})
+      : _qp(qp),
+        _rkey(rkey),
+        _staging(static_cast<std::byte*>(staging)),
+        _staging_length(staging_length),
+        _staging_lkey(staging_lkey),
+        _options(options) {}
+
+  /**
+   * Post the plan's READs.
+   *
+   * @param plan A plan from plan_gather.
+   * @param wr_id The wr_id of every READ.
+   * @return The number of signaled completions to wait for.
+   * @throws std::invalid_argument if the plan needs more staging space.
+   * @throws gather_post_error if ibv_post_send fails; its signaled() is
+   *    the completions already posted. READs of the failed chain ahead of
+   *    the rejected one may also be in flight, with no completion of their
+   *    own, so staging is only free again once the QP has been drained.
+   */
+  size_t post(const gather_plan& plan, uint64_t wr_id);
+
+  /**
+   * Copy the fetched items into dense, which must hold plan.dense_bytes.
+   * Only valid once every READ of the plan has completed.
+   */
+  void scatter(const gather_plan& plan, void* dense) const;
+
+ private:
+  struct ibv_qp* _qp;
+  uint32_t _rkey;
+  std::byte* _staging;
+  size_t _staging_length;
+  uint32_t _staging_lkey;
+  gather_options _options;
+  std::vector<struct ibv_send_wr> _wrs;
+  std::vector<struct ibv_sge> _sges;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_REMOTE_GATHER_H
@@ -0,0 +1,188 @@
+#include "remote_queue.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "idle_strategy.h"
+#include "mr_profiler.h"
+
+namespace adverbs {
+
+namespace {
+
+void check_layout(const remote_queue_layout& layout) {
+  // With one slot, "full for t" and "free for t + 1" would share a seq.
+  if (layout.capacity < 2) {
+    throw std::invalid_argument("remote queue capacity must be at least 2");
+  }
+  if (layout.slot_size == 0 ||
+      layout.slot_size % last_byte_poller::slot_alignment != 0) {
+    throw std::invalid_argument(
+        "remote queue slot_size must be a multiple of 64");
+  }
+}
+
+}  // namespace
+
+void rdma_queue_transport::execute(struct ibv_send_wr& wr) {
+  wr.send_flags |= IBV_SEND_SIGNALED;
+  struct ibv_send_wr* bad_wr = nullptr;
+  note_posted(_qp->context, &wr);
+  if (ibv_post_send(_qp, &wr, &bad_wr)) {
+    throw std::runtime_error("ibv_post_send failed");
+  }
+  struct ibv_wc wc;
+  int polled;
+  while ((polled = ibv_poll_cq(_cq, 1, &wc)) == 0) {
+    cpu_relax();
+  }
+  if (polled < 0) {
+    throw std::runtime_error("ibv_poll_cq failed");
+  }
+  if (wc.status != IBV_WC_SUCCESS) {
+    throw std::runtime_error(
+        std::string("remote queue operation failed: ") +
+        ibv_wc_status_str(wc.status));
+  }
+}
+
+uint64_t rdma_queue_transport::fetch_add(uint64_t remote_addr, uint64_t add) {
+  struct ibv_sge sge = {(uint64_t)(uintptr_t)_scratch, 8, _lkey};
+  struct ibv_send_wr wr = {};
+  wr.sg_list = &sge;
+  wr.num_sge = 1;
+  wr.opcode = IBV_WR_ATOMIC_FETCH_AND_ADD;
+  wr.wr.atomic.remote_addr = remote_addr;
+  wr.wr.atomic.compare_add = add;
+  wr.wr.atomic.rkey = _rkey;
+  execute(wr);
+  uint64_t prior;
+  std::memcpy(&prior, _scratch, sizeof(prior));
+  return prior;
+}
+
+void rdma_queue_transport::read(
+    uint64_t remote_addr,
+    std::span<std::byte> dst) {
+  if (dst.size() > _scratch_length) {
+    throw std::invalid_argument("remote queue read exceeds scratch buffer");
+  }
+  struct ibv_sge sge = {
+      (uint64_t)(uintptr_t)_scratch,
+      (uint32_t)dst.size(),
+      _lkey};
+  struct ibv_send_wr wr = {};
+  wr.sg_list = &sge;
+  wr.num_sge = 1;
+  wr.opcode = IBV_WR_RDMA_READ;
+  wr.wr.rdma.remote_addr = remote_addr;
+  wr.wr.rdma.rkey = _rkey;
+  execute(wr);
+  std::memcpy(dst.data(), _scratch, dst.size());
+}
+
+void rdma_queue_transport::write(
+    uint64_t remote_addr,
+    std::span<const std::byte> src) {
+  if (src.size() > _scratch_length) {
+    throw std::invalid_argument("remote queue write exceeds scratch buffer");
+  }
+  std::memcpy(_scratch, src.data(), src.size());
+  struct ibv_sge sge = {
+      (uint64_t)(uintptr_t)_scratch,
+      (uint32_t)src.size(),
+      _lkey};
+  struct ibv_send_wr wr = {};
+  wr.sg_list = &sge;
+  wr.num_sge = 1;
+  wr.opcode = IBV_WR_RDMA_WRITE;
+  wr.wr.rdma.remote_addr = remote_addr;
+  wr.wr.rdma.rkey = _rkey;
+  execute(wr);
+}
+
+remote_mpmc_queue::remote_mpmc_queue(
+    queue_transport& transport,
+    uint64_t remote_base,
+    const remote_queue_layout& layout)
+    : _transport(transport),
+      _base(remote_base),
+      _layout(layout),
+      _slot(layout.slot_size) {
+  check_layout(layout);
+}
+
+void remote_mpmc_queue::format(void* base, const remote_queue_layout& layout) {
+  check_layout(layout);
+  auto* bytes = static_cast<std::byte*>(base);
+  std::memset(bytes, 0, layout.bytes());
+  for (uint64_t i = 0; i < layout.capacity; ++i) {
+    slot_footer footer{0, i};
+    std::memcpy(
+        bytes + layout.slot_offset(i) + layout.slot_size - sizeof(footer),
+        &footer,
+        sizeof(footer));
+  }
+}
+
+slot_footer remote_mpmc_queue::await_seq(uint64_t ticket, uint64_t want) {
+  uint64_t footer_addr = _base + _layout.slot_offset(ticket) +
+                         _layout.slot_size - sizeof(slot_footer);
+  pause_backoff backoff;
+  for (;;) {
+    slot_footer footer;
+    _transport.read(
+        footer_addr,
+        {reinterpret_cast<std::byte*>(&footer), sizeof(footer)});
+    if (footer.seq == want) return footer;
+    backoff.idle();
+  }
+}
+
+uint64_t remote_mpmc_queue::enqueue(std::span<const std::byte> payload) {
+  if (payload.size() > _layout.max_payload()) {
+    throw std::invalid_argument("payload does not fit in a queue slot");
+  }
+  uint64_t ticket =
+      _transport.fetch_add(_base + remote_queue_layout::enqueue_offset, 1);
+  await_seq(ticket, ticket);
+  auto extent = last_byte_poller::encode(_slot, payload, ticket + 1);
+  _transport.write(
+      _base + _layout.slot_offset(ticket) + (extent.data() - _slot.data()),
+      extent);
+  return ticket;
+}
+
+size_t remote_mpmc_queue::dequeue(std::span<std::byte> out, uint64_t* ticket) {
+  if (out.size() < _layout.max_payload()) {
+    throw std::invalid_argument("dequeue buffer smaller than a slot payload");
+  }
+  uint64_t t =
+      _transport.fetch_add(_base + remote_queue_layout::dequeue_offset, 1);
+  uint64_t slot_addr = _base + _layout.slot_offset(t);
+  // The footer and payload are read separately: a READ covering both may
+  // be served while the producer's WRITE is still being placed, returning
+  // the new footer with a stale payload. The payload READ is issued only
+  // after a READ has returned the new footer.
+  slot_footer footer = await_seq(t, t + 1);
+  size_t length = footer.length;
+  if (length > _layout.max_payload()) {
+    throw std::runtime_error("remote queue slot has a corrupt length");
+  }
+  if (length) {
+    _transport.read(
+        slot_addr + _layout.slot_size - sizeof(footer) - length,
+        out.first(length));
+  }
+
+  // Free the slot for ticket t + capacity.
+  uint64_t next = t + _layout.capacity;
+  _transport.write(
+      slot_addr + _layout.slot_size - sizeof(uint64_t),
+      {reinterpret_cast<const std::byte*>(&next), sizeof(next)});
+  if (ticket) *ticket = t;
+  return length;
+}
+
+}  // namespace adverbs
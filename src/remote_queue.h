@@ -0,0 +1,207 @@
+#ifndef ADVERBS_REMOTE_QUEUE_H
+#define ADVERBS_REMOTE_QUEUE_H
+
+#include <infiniband/verbs.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "last_byte_poller.h"
+
+namespace adverbs {
+
+/**
+ * Blocking one-sided operations on a remote node's registered memory.
+ *
+ * Each call returns once the operation has completed.
+ */
+class queue_transport {
+ public:
+  virtual ~queue_transport() = default;
+
+  /**
+   * Atomically add to the 64-bit word at remote_addr.
+   *
+   * @return The word's prior value.
+   */
+  virtual uint64_t fetch_add(uint64_t remote_addr, uint64_t add) = 0;
+
+  virtual void read(uint64_t remote_addr, std::span<std::byte> dst) = 0;
+
+  virtual void write(uint64_t remote_addr, std::span<const std::byte> src) = 0;
+};
+
+/**
+ * A queue_transport over a connected RC QP.
+ *
+ * Data is staged through a registered scratch buffer; the QP and its send
+ * CQ must not be shared with other work.
+ */
+class rdma_queue_transport : public queue_transport {
+ public:
+  /**
+   * @param qp The connected QP.
+   * @param cq The QP's send CQ.
+   * @param rkey The rkey of the queue's host memory.
+   * @param scratch Registered scratch space, at least one slot plus 8 bytes.
+   * @param scratch_length Its length.
+   * @param lkey Its lkey.
+   */
+  rdma_queue_transport(
+      struct ibv_qp* qp,
+      struct ibv_cq* cq,
+      uint32_t rkey,
+      void* scratch,
+      size_t scratch_length,
+      uint32_t lkey)
+      : _qp(qp),
+        _cq(cq),
+        _rkey(rkey),
+        _scratch(static_cast<std::byte*>(scratch)),
+        _scratch_length(scratch_length),
+        _lkey(lkey) {}
+
+  /**
+   * @throws std::runtime_error if posting or the operation fails.
+   */
+  uint64_t fetch_add(uint64_t remote_addr, uint64_t add) override;
+
+  /**
+   * @throws std::invalid_argument if dst exceeds the scratch buffer.
+   * @throws std::runtime_error if posting or the operation fails.
+   */
+  void read(uint64_t remote_addr, std::span<std::byte> dst) override;
+
+  /**
+   * @throws std::invalid_argument if src exceeds the scratch buffer.
+   * @throws std::runtime_error if posting or the operation fails.
+   */
+  void write(uint64_t remote_addr, std::span<const std::byte> src) override;
+
+ private:
+  void execute(struct ibv_send_wr& wr);
+
+  struct ibv_qp* _qp;
+  struct ibv_cq* _cq;
+  uint32_t _rkey;
+  std::byte* _scratch;
+  size_t _scratch_length;
+  uint32_t _lkey;
+};
+
+/**
+ * The geometry of a remote_mpmc_queue in its host's memory.
+ *
+ * The host region holds the enqueue ticket (offset 0), the dequeue ticket
+ * (offset 64) and then capacity slots of slot_size bytes. Each slot ends in
+ * a slot_footer, whose seq says whose turn the slot is.
+ */
+struct remote_queue_layout {
+  static constexpr size_t enqueue_offset = 0;
+  static constexpr size_t dequeue_offset = 64;
+  static constexpr size_t header_bytes = 128;
+
+  // At least 2.
+  size_t capacity = 1024;
+  // A non-zero multiple of 64.
+  size_t slot_size = 256;
+
+  [[nodiscard]]
+  size_t bytes() const {
+    return header_bytes + capacity * slot_size;
+  }
+
+  [[nodiscard]]
+  size_t slot_offset(uint64_t ticket) const {
+    return header_bytes + (ticket % capacity) * slot_size;
+  }
+
+  [[nodiscard]]
+  size_t max_payload() const {
+    return last_byte_poller::max_payload(slot_size);
+  }
+};
+
+/**
+ * A multi-producer, multi-consumer queue hosted in one node's registered
+ * memory, driven entirely by one-sided operations.
+ *
+ * Producers and consumers each take a ticket with a remote fetch-and-add
+ * on their counter; ticket t owns slot t % capacity. A slot's footer seq
+ * is t while the slot is free for ticket t, and t + 1 once it holds ticket
+ * t's entry. The producer waits for seq == t and writes the payload and
+ * footer with one RDMA WRITE (the payload is right-aligned, as in
+ * last_byte_poller); the consumer waits for seq == t + 1, then reads the
+ * payload with a second READ (see dequeue()) and hands the slot to the
+ * next lap by writing seq = t + capacity.
+ *
+ * No host CPU is involved. Tickets are never abandoned, so enqueue()
+ * blocks while the queue is full and dequeue() while it is empty.
+ *
+ * Example usage:
+ *
+ *     // Host:
+ *     adverbs::remote_mpmc_queue::format(region, layout);
+ *     // Workers:
+ *     adverbs::remote_mpmc_queue queue(transport, host_addr, layout);
+ *     queue.enqueue(std::as_bytes(std::span(task)));
+ *     size_t length = queue.dequeue(buffer);
+ */
+class remote_mpmc_queue {
+ public:
+  /**
+   * @param transport The one-sided operations to the host.
+   * @param remote_base The host region's address.
+   * @param layout The queue geometry, the same as the host formatted.
+   * @throws std::invalid_argument if the geometry is invalid.
+   */
+  remote_mpmc_queue(
+      queue_transport& transport,
+      uint64_t remote_base,
+      const remote_queue_layout& layout);
+
+  /**
+   * Initialize a host region of layout.bytes() bytes.
+   *
+   * @throws std::invalid_argument if the geometry is invalid.
+   */
+  static void format(void* base, const remote_queue_layout& layout);
+
+  /**
+   * Append an entry; blocks while its slot is still occupied.
+   *
+   * @return The entry's ticket.
+   * @throws std::invalid_argument if the payload doesn't fit a slot.
+   */
+  uint64_t enqueue(std::span<const std::byte> payload);
+
+  /**
+   * Take the next entry; blocks until it has been written.
+   *
+   * @param out Receives the payload; at least layout.max_payload() bytes.
+   * @param ticket If non-null, receives the entry's ticket.
+   * @return The payload length.
+   * @throws std::invalid_argument if out is too small.
+   */
+  size_t dequeue(std::span<std::byte> out, uint64_t* ticket = nullptr);
+
+  [[nodiscard]]
+  const remote_queue_layout& layout() const {
+    return _layout;
+  }
+
+ private:
+  // Read ticket's slot footer until its seq is want.
+  slot_footer await_seq(uint64_t ticket, uint64_t want);
+
+  queue_transport& _transport;
+  uint64_t _base;
+  remote_queue_layout _layout;
+  std::vector<std::byte> _slot;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_REMOTE_QUEUE_H
@@ -0,0 +1,271 @@
+#ifndef ADVERBS_SHARED_BUFFER_H
+#define ADVERBS_SHARED_BUFFER_H
+
+#include <infiniband/verbs.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "adverbs.h"
+#include "mr_profiler.h"
+
+namespace adverbs {
+
+/**
+ * An immutable, reference-counted payload in registered memory.
+ *
+ * One shared_buffer can be referenced by many in-flight sends (e.g. one per
+ * subscriber), so a payload is fanned out without a copy per destination.
+ * Each posted send holds one reference, which is dropped when its
+ * completion is reaped (see completion_releaser); when the last reference
+ * is dropped the release callback runs, typically returning the memory to
+ * a pool.
+ *
+ * The creator holds the first reference and drops it with release() once it
+ * has finished posting. Sends must be IBV_SEND_SIGNALED, otherwise their
+ * references are never returned.
+ *
+ * Example usage:
+ *
+ *     auto* buf = new adverbs::shared_buffer(
+ *         mr, offset, length, [](adverbs::shared_buffer* b) { delete b; });
+ *     adverbs::post_fan_out(*buf, subscriber_qps);
+ *     buf->release();
+ *     ...
+ *     adverbs::completion_releaser releaser;
+ *     for (int i = 0; i < n; ++i) releaser.add(wc[i].wr_id);
+ *     releaser.flush();
+ */
+class shared_buffer {
+ public:
+  using release_fn = std::function<void(shared_buffer*)>;
+
+  /**
+   * Wrap memory registered elsewhere.
+   *
+   * @param data The payload; must stay valid and unmodified until released.
+   * @param length The payload length.
+   * @param lkey The lkey of the registration covering data.
+   * @param on_release Called when the last reference is dropped.
+   */
+  shared_buffer(
+      const void* data,
+      size_t length,
+      uint32_t lkey,
+      release_fn on_release)
+      : _data(static_cast<const std::byte*>(data)),
+        _length(length),
+        _lkey(lkey),
+        _on_release(std::move(on_release)) {}
+
+  /**
+   * Wrap a slice of a memory_region_handle, keeping the region registered
+   * until this buffer is destroyed.
+   *
+   * @throws std::out_of_range if the slice is not within the region.
+   */
+  shared_buffer(
+      memory_region_handle& mr,
+      size_t offset,
+      size_t length,
+      release_fn on_release)
+      : shared_buffer(
+            static_cast<const std::byte*>(mr.addr()) + offset,
+            length,
+            mr.lkey(),
+            std::move(on_release)) {
+    if (offset > mr.length() || length > mr.length() - offset) {
+      throw std::out_of_range("shared_buffer slice outside memory region");
+    }
+    _mr.emplace(mr);
+  }
+
+  shared_buffer(const shared_buffer&) = delete;
+  shared_buffer& operator=(const shared_buffer&) = delete;
+
+  [[nodiscard]]
+  std::span<const std::byte> data() const {
+    return {_data, _length};
+  }
+
+  [[nodiscard]]
+  uint32_t lkey() const {
+    return _lkey;
+  }
+
+  /**
+   * A scatter/gather entry covering the whole payload.
+   */
+  [[nodiscard]]
+  struct ibv_sge sge() const {
+    return {(uint64_t)(uintptr_t)_data, (uint32_t)_length, _lkey};
+  }
+
+  /**
+   * The wr_id which identifies this buffer in completions.
+   */
+  [[nodiscard]]
+  uint64_t wr_id() const {
+    return (uint64_t)(uintptr_t)this;
+  }
+
+  [[nodiscard]]
+  static shared_buffer* from_wr_id(uint64_t wr_id) {
+    return reinterpret_cast<shared_buffer*>((uintptr_t)wr_id);
+  }
+
+  /**
+   * Take count more references, one per send about to be posted.
+   */
+  void retain(uint32_t count = 1) {
+    _refs.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  /**
+   * Drop count references; runs the release callback on the last one.
+   */
+  void release(uint32_t count = 1) {
+    if (_refs.fetch_sub(count, std::memory_order_acq_rel) == count) {
+      if (_on_release) _on_release(this);
+    }
+  }
+
+  [[nodiscard]]
+  uint32_t refs() const {
+    return _refs.load(std::memory_order_relaxed);
+  }
+
+ private:
+  const std::byte* _data;
+  size_t _length;
+  uint32_t _lkey;
+  release_fn _on_release;
+  std::optional<memory_region_handle> _mr;
+  std::atomic<uint32_t> _refs{1};
+};
+
+/**
+ * Batches shared_buffer releases across a poll of the CQ.
+ *
+ * Completions for one fanned-out buffer tend to arrive together, so
+ * consecutive wr_ids for the same buffer are coalesced and each buffer's
+ * reference count is touched once per batch instead of once per
+ * completion.
+ */
+class completion_releaser {
+ public:
+  explicit completion_releaser(size_t capacity = 64) {
+    _pending.reserve(capacity);
+  }
+
+  ~completion_releaser() { flush(); }
+
+  completion_releaser(const completion_releaser&) = delete;
+  completion_releaser& operator=(const completion_releaser&) = delete;
+
+  /**
+   * Note a completion for a send posted from a shared_buffer.
+   */
+  void add(uint64_t wr_id) {
+    shared_buffer* buffer = shared_buffer::from_wr_id(wr_id);
+    // Scan the few most recent entries; fan-out completions cluster.
+    size_t scan = _pending.size() < 4 ? _pending.size() : 4;
+    for (size_t i = _pending.size() - scan; i < _pending.size(); ++i) {
+      if (_pending[i].buffer == buffer) {
+        _pending[i].count++;
+        return;
+      }
+    }
+    if (_pending.size() == _pending.capacity()) flush();
+    _pending.push_back({buffer, 1});
+  }
+
+  /**
+   * Apply all pending releases.
+   */
+  void flush() {
+    for (const auto& entry : _pending) entry.buffer->release(entry.count);
+    _pending.clear();
+  }
+
+  [[nodiscard]]
+  size_t pending() const {
+    return _pending.size();
+  }
+
+ private:
+  struct entry {
+    shared_buffer* buffer;
+    uint32_t count;
+  };
+
+  std::vector<entry> _pending;
+};
+
+/**
+ * Thrown when post_fan_out() fails part way through its QPs.
+ */
+class fan_out_error : public std::runtime_error {
+ public:
+  explicit fan_out_error(size_t posted)
+      : std::runtime_error("ibv_post_send failed"), _posted(posted) {}
+
+  /**
+   * The QPs ahead of the failed one, whose sends were posted; a retry
+   * should start after them.
+   */
+  [[nodiscard]]
+  size_t posted() const {
+    return _posted;
+  }
+
+ private:
+  size_t _posted;
+};
+
+/**
+ * Post one signaled SEND of buffer to each QP.
+ *
+ * Takes one reference per send; references for sends that fail to post
+ * are dropped again before throwing.
+ *
+ * @param buffer The payload to fan out.
+ * @param qps The destination queue pairs.
+ * @param send_flags Extra ibv_send_flags; IBV_SEND_SIGNALED is always set.
+ * @throws fan_out_error if ibv_post_send fails; qps.first(posted()) got
+ *    the payload.
+ */
+inline void post_fan_out(
+    shared_buffer& buffer,
+    std::span<struct ibv_qp* const> qps,
+    unsigned send_flags = 0) {
+  struct ibv_sge sge = buffer.sge();
+  struct ibv_send_wr wr = {};
+  wr.wr_id = buffer.wr_id();
+  wr.sg_list = &sge;
+  wr.num_sge = 1;
+  wr.opcode = IBV_WR_SEND;
+  wr.send_flags = send_flags | IBV_SEND_SIGNALED;
+
+  buffer.retain((uint32_t)qps.size());
+  size_t posted = 0;
+  for (struct ibv_qp* qp : qps) {
+    struct ibv_send_wr* bad_wr = nullptr;
+    note_posted(qp->context, &wr);
+    if (ibv_post_send(qp, &wr, &bad_wr)) {
+      buffer.release((uint32_t)(qps.size() - posted));
+      throw fan_out_error(posted);
+    }
+    ++posted;
+  }
+}
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_SHARED_BUFFER_H
@@ -0,0 +1,109 @@
+#ifndef ADVERBS_SPSC_QUEUE_H
+#define ADVERBS_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+
+namespace adverbs {
+
+/**
+ * Bounded lock-free single-producer single-consumer queue.
+ *
+ * Exactly one thread may call try_push() and exactly one thread may call
+ * try_pop(). The producer and consumer indices live on separate cache lines,
+ * and each side keeps a cached copy of the other side's index so that the
+ * shared line is only read when the queue looks full (or empty).
+ *
+ * Example usage:
+ *
+ *     adverbs::spsc_queue<int> queue(1024);
+ *     queue.try_push(42);           // producer thread
+ *     int value;
+ *     if (queue.try_pop(value)) {}  // consumer thread
+ */
+template <typename T>
+class spsc_queue {
+ public:
+  /**
+   * Construct a spsc_queue.
+   *
+   * @param capacity The minimum capacity; rounded up to a power of two.
+   * @throws std::invalid_argument if capacity is zero.
+   */
+  explicit spsc_queue(size_t capacity) {
+    if (capacity == 0) {
+      throw std::invalid_argument("spsc_queue capacity must be non-zero");
+    }
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    _mask = size - 1;
+    _slots = std::make_unique<T[]>(size);
+  }
+
+  spsc_queue(const spsc_queue&) = delete;
+  spsc_queue& operator=(const spsc_queue&) = delete;
+
+  /**
+   * Push a value; producer side only.
+   *
+   * @return false if the queue is full.
+   */
+  bool try_push(const T& value) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _cached_head > _mask) {
+      _cached_head = _head.load(std::memory_order_acquire);
+      if (tail - _cached_head > _mask) return false;
+    }
+    _slots[tail & _mask] = value;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Pop a value; consumer side only.
+   *
+   * @return false if the queue is empty.
+   */
+  bool try_pop(T& value) {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _cached_tail) {
+      _cached_tail = _tail.load(std::memory_order_acquire);
+      if (head == _cached_tail) return false;
+    }
+    value = std::move(_slots[head & _mask]);
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * The number of queued values; exact only when both sides are quiescent.
+   */
+  [[nodiscard]]
+  size_t size_approx() const {
+    return _tail.load(std::memory_order_acquire) -
+           _head.load(std::memory_order_acquire);
+  }
+
+  [[nodiscard]]
+  size_t capacity() const {
+    return _mask + 1;
+  }
+
+ private:
+  // Consumer-owned.
+  alignas(64) std::atomic<size_t> _head{0};
+  size_t _cached_tail = 0;
+
+  // Producer-owned.
+  alignas(64) std::atomic<size_t> _tail{0};
+  size_t _cached_head = 0;
+
+  alignas(64) size_t _mask = 0;
+  std::unique_ptr<T[]> _slots;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_SPSC_QUEUE_H
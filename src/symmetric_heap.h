@@ -0,0 +1,375 @@
+#ifndef ADVERBS_SYMMETRIC_HEAP_H
+#define ADVERBS_SYMMETRIC_HEAP_H
+
+#include <infiniband/verbs.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "adverbs.h"
+#include "mr_profiler.h"
+
+namespace adverbs {
+
+/**
+ * What one rank publishes about its symmetric heap.
+ */
+struct heap_segment {
+  uint64_t base = 0;
+  uint64_t length = 0;
+  uint32_t rkey = 0;
+};
+
+/**
+ * A partitioned global address space over RDMA, OpenSHMEM style.
+ *
+ * Every rank registers a heap of the same length and publishes its base
+ * address and rkey once, through a caller-supplied allgather (MPI, a TCP
+ * bootstrap, ...). Symmetric objects live at the same offset in every
+ * rank's heap: allocate() is a bump allocator, so ranks which make the same
+ * sequence of allocations get the same offsets.
+ *
+ * put/get/atomic calls take (rank, offset) and resolve to an RDMA operation
+ * from the table built at construction; no per-call lookup or exchange.
+ * Operations are only posted here: their completions are reaped from the
+ * CQ of the rank's QP, identified by wr_id. A heap is not thread-safe.
+ *
+ * Example usage:
+ *
+ *     adverbs::symmetric_heap heap(mr, rank, qps, [&](auto& mine) {
+ *       return bootstrap.allgather(mine);
+ *     });
+ *     size_t counter = heap.allocate(sizeof(uint64_t));
+ *     size_t result = heap.allocate(sizeof(uint64_t));
+ *     heap.atomic_add(0, counter, 1, result);
+ */
+class symmetric_heap {
+ public:
+  // Given this rank's segment, return every rank's segment, indexed by rank.
+  using allgather_fn =
+      std::function<std::vector<heap_segment>(const heap_segment&)>;
+
+  /**
+   * @param base The local heap; registered with remote read, write and
+   *    atomic access.
+   * @param length The heap length; the same on every rank.
+   * @param lkey The local heap's lkey.
+   * @param rkey The local heap's rkey.
+   * @param rank This process's rank.
+   * @param qps A connected QP to each rank, indexed by rank; this rank's
+   *    entry may be a loopback QP, or null if this rank's heap is only
+   *    accessed locally.
+   * @param allgather Exchanges the heap segments.
+   * @throws std::invalid_argument if the ranks' heaps don't match.
+   */
+  symmetric_heap(
+      void* base,
+      size_t length,
+      uint32_t lkey,
+      uint32_t rkey,
+      int rank,
+      std::vector<struct ibv_qp*> qps,
+      const allgather_fn& allgather)
+      : _base(static_cast<std::byte*>(base)),
+        _length(length),
+        _lkey(lkey),
+        _rank(rank),
+        _qps(std::move(qps)) {
+    _peers = allgather({(uint64_t)(uintptr_t)base, length, rkey});
+    if (_peers.size() != _qps.size()) {
+      throw std::invalid_argument(
+          "symmetric_heap: " + std::to_string(_peers.size()) +
+          " segments for " + std::to_string(_qps.size()) + " ranks");
+    }
+    if (rank < 0 || (size_t)rank >= _peers.size()) {
+      throw std::invalid_argument("symmetric_heap: rank out of range");
+    }
+    for (const auto& peer : _peers) {
+      if (peer.length != length) {
+        throw std::invalid_argument("symmetric_heap: heap lengths differ");
+      }
+    }
+  }
+
+  symmetric_heap(
+      memory_region_handle& mr,
+      int rank,
+      std::vector<struct ibv_qp*> qps,
+      const allgather_fn& allgather)
+      : symmetric_heap(
+            mr.addr(),
+            mr.length(),
+            mr.lkey(),
+            mr.rkey(),
+            rank,
+            std::move(qps),
+            allgather) {}
+
+  [[nodiscard]]
+  int rank() const {
+    return _rank;
+  }
+
+  [[nodiscard]]
+  int size() const {
+    return (int)_peers.size();
+  }
+
+  [[nodiscard]]
+  size_t length() const {
+    return _length;
+  }
+
+  /**
+   * Reserve a symmetric object.
+   *
+   * @return The object's offset, the same on every rank making the same
+   *    allocations.
+   * @throws std::bad_alloc if the heap is exhausted.
+   */
+  size_t allocate(size_t length, size_t alignment = 8) {
+    size_t offset = (_next + alignment - 1) & ~(alignment - 1);
+    if (offset > _length || length > _length - offset) {
+      throw std::bad_alloc();
+    }
+    _next = offset + length;
+    return offset;
+  }
+
+  /**
+   * The local copy of the object at offset.
+   */
+  template <typename T = std::byte>
+  T* local(size_t offset) const {
+    return reinterpret_cast<T*>(_base + offset);
+  }
+
+  /**
+   * RDMA write length bytes from a registered local buffer to rank's heap.
+   *
+   * @throws std::out_of_range if rank is not a rank, or the range is
+   *    outside the heap.
+   * @throws std::invalid_argument if rank has no QP, or length exceeds a
+   *    scatter/gather entry's 32 bits.
+   * @throws std::runtime_error if ibv_post_send fails.
+   */
+  void put(
+      int rank,
+      size_t offset,
+      const void* src,
+      size_t length,
+      uint32_t lkey,
+      uint64_t wr_id = 0,
+      unsigned send_flags = IBV_SEND_SIGNALED) {
+    post(
+        rank,
+        IBV_WR_RDMA_WRITE,
+        offset,
+        src,
+        length,
+        lkey,
+        wr_id,
+        send_flags);
+  }
+
+  /**
+   * RDMA write from this rank's copy of a symmetric object to rank's.
+   */
+  void put(
+      int rank,
+      size_t offset,
+      size_t length,
+      uint64_t wr_id = 0,
+      unsigned send_flags = IBV_SEND_SIGNALED) {
+    check(offset, length);
+    put(rank, offset, _base + offset, length, _lkey, wr_id, send_flags);
+  }
+
+  /**
+   * RDMA read length bytes of rank's heap into a registered local buffer.
+   */
+  void get(
+      int rank,
+      size_t offset,
+      void* dst,
+      size_t length,
+      uint32_t lkey,
+      uint64_t wr_id = 0,
+      unsigned send_flags = IBV_SEND_SIGNALED) {
+    post(
+        rank,
+        IBV_WR_RDMA_READ,
+        offset,
+        dst,
+        length,
+        lkey,
+        wr_id,
+        send_flags);
+  }
+
+  /**
+   * RDMA read rank's copy of a symmetric object into this rank's.
+   */
+  void get(
+      int rank,
+      size_t offset,
+      size_t length,
+      uint64_t wr_id = 0,
+      unsigned send_flags = IBV_SEND_SIGNALED) {
+    check(offset, length);
+    get(rank, offset, _base + offset, length, _lkey, wr_id, send_flags);
+  }
+
+  /**
+   * Atomically add to the 64-bit word at offset on rank; its prior value
+   * lands in the local heap at result_offset.
+   *
+   * @throws std::invalid_argument if either offset is not 8-byte aligned,
+   *    or rank has no QP.
+   */
+  void atomic_add(
+      int rank,
+      size_t offset,
+      uint64_t add,
+      size_t result_offset,
+      uint64_t wr_id = 0,
+      unsigned send_flags = IBV_SEND_SIGNALED) {
+    struct ibv_sge sge;
+    struct ibv_send_wr wr = atomic_wr(
+        IBV_WR_ATOMIC_FETCH_AND_ADD,
+        rank,
+        offset,
+        result_offset,
+        sge,
+        wr_id,
+        send_flags);
+    wr.wr.atomic.compare_add = add;
+    post(rank, wr);
+  }
+
+  /**
+   * Atomically replace the 64-bit word at offset on rank with swap if it
+   * equals compare; its prior value lands in the local heap at
+   * result_offset.
+   *
+   * @throws std::invalid_argument if either offset is not 8-byte aligned,
+   *    or rank has no QP.
+   */
+  void compare_swap(
+      int rank,
+      size_t offset,
+      uint64_t compare,
+      uint64_t swap,
+      size_t result_offset,
+      uint64_t wr_id = 0,
+      unsigned send_flags = IBV_SEND_SIGNALED) {
+    struct ibv_sge sge;
+    struct ibv_send_wr wr = atomic_wr(
+        IBV_WR_ATOMIC_CMP_AND_SWP,
+        rank,
+        offset,
+        result_offset,
+        sge,
+        wr_id,
+        send_flags);
+    wr.wr.atomic.compare_add = compare;
+    wr.wr.atomic.swap = swap;
+    post(rank, wr);
+  }
+
+ private:
+  void check(size_t offset, size_t length) const {
+    if (offset > _length || length > _length - offset) {
+      throw std::out_of_range("symmetric_heap: range outside heap");
+    }
+  }
+
+  void check_rank(int rank) const {
+    if (rank < 0 || (size_t)rank >= _peers.size()) {
+      throw std::out_of_range(
+          "symmetric_heap: no rank " + std::to_string(rank));
+    }
+    if (!_qps[rank]) {
+      throw std::invalid_argument(
+          "symmetric_heap: no QP to rank " + std::to_string(rank));
+    }
+  }
+
+  void post(
+      int rank,
+      enum ibv_wr_opcode opcode,
+      size_t offset,
+      const void* local,
+      size_t length,
+      uint32_t lkey,
+      uint64_t wr_id,
+      unsigned send_flags) {
+    check_rank(rank);
+    if (length > UINT32_MAX) {
+      throw std::invalid_argument("symmetric_heap: transfer over 4 GiB");
+    }
+    check(offset, length);
+    struct ibv_sge sge = {(uint64_t)(uintptr_t)local, (uint32_t)length, lkey};
+    struct ibv_send_wr wr = {};
+    wr.wr_id = wr_id;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.opcode = opcode;
+    wr.send_flags = send_flags;
+    wr.wr.rdma.remote_addr = _peers[rank].base + offset;
+    wr.wr.rdma.rkey = _peers[rank].rkey;
+    post(rank, wr);
+  }
+
+  struct ibv_send_wr atomic_wr(
+      enum ibv_wr_opcode opcode,
+      int rank,
+      size_t offset,
+      size_t result_offset,
+      struct ibv_sge& sge,
+      uint64_t wr_id,
+      unsigned send_flags) {
+    if (offset % 8 || result_offset % 8) {
+      throw std::invalid_argument("symmetric_heap: unaligned atomic");
+    }
+    check_rank(rank);
+    check(offset, 8);
+    check(result_offset, 8);
+    sge = {(uint64_t)(uintptr_t)(_base + result_offset), 8, _lkey};
+    struct ibv_send_wr wr = {};
+    wr.wr_id = wr_id;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.opcode = opcode;
+    wr.send_flags = send_flags;
+    wr.wr.atomic.remote_addr = _peers[rank].base + offset;
+    wr.wr.atomic.rkey = _peers[rank].rkey;
+    return wr;
+  }
+
+  void post(int rank, struct ibv_send_wr& wr) {
+    struct ibv_send_wr* bad_wr = nullptr;
+    note_posted(_qps[rank]->context, &wr);
+    if (ibv_post_send(_qps[rank], &wr, &bad_wr)) {
+      throw std::runtime_error("ibv_post_send failed");
+    }
+  }
+
+  std::byte* _base;
+  size_t _length;
+  uint32_t _lkey;
+  int _rank;
+  std::vector<struct ibv_qp*> _qps;
+  std::vector<heap_segment> _peers;
+  size_t _next = 0;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_SYMMETRIC_HEAP_H
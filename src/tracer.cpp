@@ -0,0 +1,261 @@
+#include "tracer.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "poller_metrics.h"
+#include "spsc_queue.h"
+
+namespace adverbs {
+
+namespace {
+
+struct trace_event {
+  uint64_t ts_ns = 0;
+  uint64_t id = 0;
+  const char* name = nullptr;
+  uint32_t qp_num = 0;
+  int status = 0;
+  char phase = 0;
+};
+
+struct thread_buffer {
+  thread_buffer(size_t capacity, uint64_t generation)
+      : events(capacity),
+        generation(generation),
+        tid((uint32_t)syscall(SYS_gettid)) {}
+
+  spsc_queue<trace_event> events;
+  uint64_t generation;
+  uint32_t tid;
+};
+
+// All tracer state other than the enabled flag; guarded by mutex except
+// for the atomics, the per-thread queues themselves, and file and
+// first_event, which belong to whichever thread drains: the flusher while
+// it runs, start() and stop() otherwise.
+struct tracer_state {
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::vector<std::shared_ptr<thread_buffer>> buffers;
+  tracer_options options;
+  std::atomic<uint64_t> generation{0};
+  std::atomic<uint64_t> dropped{0};
+  FILE* file = nullptr;
+  bool first_event = true;
+  bool stopping = false;
+  std::thread flusher;
+};
+
+tracer_state& state() {
+  static tracer_state s;
+  return s;
+}
+
+thread_local std::shared_ptr<thread_buffer> local_buffer;
+
+thread_buffer* buffer_for_this_thread() {
+  tracer_state& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (!local_buffer || local_buffer->generation != s.generation) {
+    local_buffer = std::make_shared<thread_buffer>(
+        s.options.buffer_capacity,
+        s.generation.load());
+    s.buffers.push_back(local_buffer);
+  }
+  return local_buffer.get();
+}
+
+// Write str as the contents of a JSON string.
+void write_escaped(FILE* file, const char* str) {
+  for (; *str; ++str) {
+    auto c = (unsigned char)*str;
+    if (c == '"' || c == '\\') {
+      std::fputc('\\', file);
+      std::fputc(c, file);
+    } else if (c < 0x20) {
+      std::fprintf(file, "\\u%04x", c);
+    } else {
+      std::fputc(c, file);
+    }
+  }
+}
+
+void write_event(tracer_state& s, const trace_event& e, uint32_t tid) {
+  std::fputs(s.first_event ? "\n{\"name\":\"" : ",\n{\"name\":\"", s.file);
+  write_escaped(s.file, e.name);
+  std::fprintf(
+      s.file,
+      "\",\"cat\":\"qp%u\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,"
+      "\"tid\":%u",
+      e.qp_num,
+      e.phase,
+      (unsigned long long)(e.ts_ns / 1000),
+      (unsigned long long)(e.ts_ns % 1000),
+      (int)getpid(),
+      tid);
+  s.first_event = false;
+  if (e.phase == 'i') {
+    std::fprintf(s.file, ",\"s\":\"t\",\"args\":{\"qp_num\":%u}}", e.qp_num);
+    return;
+  }
+  std::fprintf(
+      s.file,
+      ",\"id\":\"0x%llx\",\"args\":{\"qp_num\":%u,\"wr_id\":%llu",
+      (unsigned long long)e.id,
+      e.qp_num,
+      (unsigned long long)e.id);
+  if (e.phase == 'e') {
+    std::fprintf(
+        s.file,
+        ",\"status\":\"%s\"",
+        ibv_wc_status_str((enum ibv_wc_status)e.status));
+  }
+  std::fputs("}}", s.file);
+}
+
+// Drain buffers into the file.
+void drain(
+    tracer_state& s,
+    const std::vector<std::shared_ptr<thread_buffer>>& buffers) {
+  trace_event e;
+  for (const auto& buffer : buffers) {
+    while (buffer->events.try_pop(e)) write_event(s, e, buffer->tid);
+  }
+  std::fflush(s.file);
+}
+
+void flush_loop() {
+  tracer_state& s = state();
+  std::vector<std::shared_ptr<thread_buffer>> buffers;
+  std::unique_lock<std::mutex> lock(s.mutex);
+  while (!s.stopping) {
+    s.wake.wait_for(lock, s.options.flush_interval);
+    // Write outside the lock, so a thread registering its buffer never
+    // waits on file I/O.
+    buffers = s.buffers;
+    lock.unlock();
+    drain(s, buffers);
+    lock.lock();
+  }
+}
+
+}  // namespace
+
+void tracer::start(const std::string& path, tracer_options options) {
+  stop();
+
+  tracer_state& s = state();
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.file = std::fopen(path.c_str(), "w");
+    if (!s.file) {
+      throw std::runtime_error("can't open trace file: " + path);
+    }
+    std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", s.file);
+    s.options = options;
+    s.generation++;
+    s.buffers.clear();
+    s.dropped.store(0);
+    s.first_event = true;
+    s.stopping = false;
+  }
+  s.flusher = std::thread(flush_loop);
+  _enabled.store(true);
+}
+
+void tracer::stop() {
+  tracer_state& s = state();
+  if (!_enabled.exchange(false)) return;
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.stopping = true;
+  }
+  s.wake.notify_all();
+  s.flusher.join();
+
+  std::lock_guard<std::mutex> lock(s.mutex);
+  drain(s, s.buffers);
+  std::fputs("\n]}\n", s.file);
+  std::fclose(s.file);
+  s.file = nullptr;
+  s.buffers.clear();
+  // Threads still holding a buffer re-register on their next event.
+  s.generation++;
+}
+
+uint64_t tracer::dropped() {
+  return state().dropped.load(std::memory_order_relaxed);
+}
+
+void tracer::record(
+    char phase,
+    const char* name,
+    uint32_t qp_num,
+    uint64_t id,
+    int status) {
+  thread_buffer* buffer = local_buffer.get();
+  if (!buffer || buffer->generation != state().generation) {
+    buffer = buffer_for_this_thread();
+  }
+  trace_event e;
+  e.ts_ns = monotonic_ns();
+  e.id = id;
+  e.name = name;
+  e.qp_num = qp_num;
+  e.status = status;
+  e.phase = phase;
+  if (!buffer->events.try_push(e)) {
+    state().dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+const char* opcode_name(enum ibv_wr_opcode opcode) {
+  switch (opcode) {
+    case IBV_WR_RDMA_WRITE:
+    case IBV_WR_RDMA_WRITE_WITH_IMM:
+      return "RDMA_WRITE";
+    case IBV_WR_SEND:
+    case IBV_WR_SEND_WITH_IMM:
+    case IBV_WR_SEND_WITH_INV:
+      return "SEND";
+    case IBV_WR_RDMA_READ:
+      return "RDMA_READ";
+    case IBV_WR_ATOMIC_CMP_AND_SWP:
+      return "COMP_SWAP";
+    case IBV_WR_ATOMIC_FETCH_AND_ADD:
+      return "FETCH_ADD";
+    default:
+      return "WR";
+  }
+}
+
+const char* completion_name(enum ibv_wc_opcode opcode) {
+  switch (opcode) {
+    case IBV_WC_RDMA_WRITE:
+      return "RDMA_WRITE";
+    case IBV_WC_SEND:
+      return "SEND";
+    case IBV_WC_RDMA_READ:
+      return "RDMA_READ";
+    case IBV_WC_COMP_SWAP:
+      return "COMP_SWAP";
+    case IBV_WC_FETCH_ADD:
+      return "FETCH_ADD";
+    case IBV_WC_RECV:
+    case IBV_WC_RECV_RDMA_WITH_IMM:
+      return "RECV";
+    default:
+      return "WR";
+  }
+}
+
+}  // namespace adverbs
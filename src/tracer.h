@@ -0,0 +1,146 @@
+#ifndef ADVERBS_TRACER_H
+#define ADVERBS_TRACER_H
+
+#include <infiniband/verbs.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace adverbs {
+
+struct tracer_options {
+  // Events each thread can buffer between flushes; overflow is dropped.
+  size_t buffer_capacity = 1 << 16;
+  // How often the background thread drains the per-thread buffers.
+  std::chrono::milliseconds flush_interval{10};
+};
+
+/**
+ * Process-wide RDMA timeline tracer.
+ *
+ * Records per-operation spans (post to completion, keyed by QP and wr_id)
+ * and connection lifecycle events, and writes them as Chrome trace JSON,
+ * which chrome://tracing and the Perfetto UI both load.
+ *
+ * Recording is lock-free: each thread appends to its own spsc_queue, and a
+ * background thread drains all of them every flush_interval. When the
+ * tracer is stopped, every trace_* call is a single relaxed load.
+ *
+ * Only signaled work requests produce a completion, so only trace_post()
+ * those; an unmatched post shows up as an unterminated span.
+ *
+ * Example usage:
+ *
+ *     adverbs::tracer::start("/tmp/rdma.trace.json");
+ *     adverbs::trace_post(qp->qp_num, wr.wr_id, wr.opcode);
+ *     ibv_post_send(qp, &wr, &bad_wr);
+ *     ...
+ *     int n = ibv_poll_cq(cq, 16, wc);
+ *     for (int i = 0; i < n; ++i) adverbs::trace_completion(wc[i]);
+ *     ...
+ *     adverbs::tracer::stop();
+ */
+class tracer {
+ public:
+  /**
+   * Start tracing to a file; replaces any trace in progress.
+   *
+   * @param path The file to write the Chrome trace JSON to.
+   * @param options Buffering options.
+   * @throws std::runtime_error if the file can't be opened.
+   */
+  static void start(const std::string& path, tracer_options options = {});
+
+  /**
+   * Flush all buffered events, close the trace file and stop tracing.
+   */
+  static void stop();
+
+  [[nodiscard]]
+  static bool enabled() {
+    return _enabled.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * The number of events dropped because a thread's buffer was full.
+   */
+  [[nodiscard]]
+  static uint64_t dropped();
+
+ private:
+  friend void trace_post(uint32_t, uint64_t, enum ibv_wr_opcode);
+  friend void trace_completion(const struct ibv_wc&);
+  friend void trace_recv_posted(uint32_t, uint64_t);
+  friend void trace_instant(const char*, uint32_t);
+
+  static void record(
+      char phase,
+      const char* name,
+      uint32_t qp_num,
+      uint64_t id,
+      int status);
+
+  inline static std::atomic<bool> _enabled{false};
+};
+
+/**
+ * The span name used for a send opcode; matches completion_name().
+ */
+const char* opcode_name(enum ibv_wr_opcode opcode);
+
+/**
+ * The span name used for a completion opcode; matches opcode_name().
+ */
+const char* completion_name(enum ibv_wc_opcode opcode);
+
+/**
+ * Begin a span for a signaled send work request.
+ */
+inline void trace_post(
+    uint32_t qp_num,
+    uint64_t wr_id,
+    enum ibv_wr_opcode opcode) {
+  if (!tracer::enabled()) return;
+  tracer::record('b', opcode_name(opcode), qp_num, wr_id, 0);
+}
+
+/**
+ * Begin a span for a receive work request.
+ */
+inline void trace_recv_posted(uint32_t qp_num, uint64_t wr_id) {
+  if (!tracer::enabled()) return;
+  tracer::record('b', "RECV", qp_num, wr_id, 0);
+}
+
+/**
+ * End the span for a completed work request.
+ *
+ * A failed completion's opcode is undefined, so its span end is named
+ * "error"; the status is in its args.
+ */
+inline void trace_completion(const struct ibv_wc& wc) {
+  if (!tracer::enabled()) return;
+  tracer::record(
+      'e',
+      wc.status == IBV_WC_SUCCESS ? completion_name(wc.opcode) : "error",
+      wc.qp_num,
+      wc.wr_id,
+      (int)wc.status);
+}
+
+/**
+ * Record a point-in-time event for a QP, e.g. a connection state change.
+ *
+ * @param name A string with static storage duration; escaped as JSON.
+ * @param qp_num The QP the event belongs to.
+ */
+inline void trace_instant(const char* name, uint32_t qp_num) {
+  if (!tracer::enabled()) return;
+  tracer::record('i', name, qp_num, 0, 0);
+}
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_TRACER_H
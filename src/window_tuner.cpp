@@ -0,0 +1,73 @@
+#include "window_tuner.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace adverbs {
+
+void window_tuner::on_completion(
+    size_t bytes,
+    uint64_t latency_ns,
+    uint64_t now_ns) {
+  uint64_t index = _completions++;
+  while (!_rtts.empty() && _rtts.back().second >= latency_ns) {
+    _rtts.pop_back();
+  }
+  _rtts.emplace_back(index, latency_ns);
+  // A window of 0 would expire the sample just added.
+  size_t window = std::max<size_t>(1, _options.rtt_window);
+  while (_rtts.front().first + window <= index) {
+    _rtts.pop_front();
+  }
+
+  if (!_started) {
+    // Bytes completing now were sent before the interval began; the
+    // interval starts here.
+    _started = true;
+    _interval_start = now_ns;
+    return;
+  }
+  _interval_bytes += bytes;
+  uint64_t elapsed = now_ns - _interval_start;
+  if (elapsed == 0 || elapsed < min_rtt_ns()) return;
+  _rates.push_back((double)_interval_bytes / (double)elapsed);
+  if (_rates.size() > std::max<size_t>(1, _options.bandwidth_window)) {
+    _rates.pop_front();
+  }
+  _interval_start = now_ns;
+  _interval_bytes = 0;
+}
+
+double window_tuner::bandwidth() const {
+  double best = 0;
+  for (double rate : _rates) best = std::max(best, rate);
+  return best;
+}
+
+transfer_window window_tuner::current(bool reads) const {
+  uint32_t max_depth =
+      reads ? std::min(_limits.max_read_depth, _limits.max_depth)
+            : _limits.max_depth;
+  max_depth = std::max<uint32_t>(max_depth, 1);
+  double target = bdp() * _options.headroom;
+  if (target <= 0) {
+    return {
+        std::clamp(
+            _options.initial_chunk,
+            _limits.min_chunk,
+            _limits.max_chunk),
+        std::clamp<uint32_t>(_options.initial_depth, 1, max_depth)};
+  }
+
+  uint32_t preferred =
+      std::clamp<uint32_t>(_options.preferred_depth, 1, max_depth);
+  // Round to a power of two: chunk sizes that divide buffers evenly.
+  double ideal = target / preferred;
+  size_t chunk = (size_t)1 << (int)std::ceil(std::log2(std::max(ideal, 1.0)));
+  chunk = std::clamp(chunk, _limits.min_chunk, _limits.max_chunk);
+  auto depth = (uint32_t)std::min<double>(
+      std::ceil(target / (double)chunk), max_depth);
+  return {chunk, std::max<uint32_t>(depth, 1)};
+}
+
+}  // namespace adverbs
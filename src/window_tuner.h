@@ -0,0 +1,160 @@
+#ifndef ADVERBS_WINDOW_TUNER_H
+#define ADVERBS_WINDOW_TUNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+#include "device_caps.h"
+
+namespace adverbs {
+
+/**
+ * Hard bounds on a pipelined transfer's window.
+ */
+struct window_limits {
+  // Outstanding operations per QP (the send queue depth).
+  uint32_t max_depth = 128;
+  // Outstanding RDMA reads and atomics per QP.
+  uint32_t max_read_depth = 16;
+  size_t min_chunk = 4096;
+  size_t max_chunk = 1 << 20;
+
+  /**
+   * Bounds from a device's limits: max_qp_wr, and for reads the lesser of
+   * max_qp_rd_atom (responder) and max_qp_init_rd_atom (initiator).
+   */
+  static window_limits from(const device_caps& caps) {
+    window_limits limits;
+    if (caps.max_qp_wr) limits.max_depth = caps.max_qp_wr;
+    uint32_t reads = caps.max_qp_rd_atom;
+    if (caps.max_qp_init_rd_atom && caps.max_qp_init_rd_atom < reads) {
+      reads = caps.max_qp_init_rd_atom;
+    }
+    if (reads) limits.max_read_depth = reads;
+    return limits;
+  }
+};
+
+struct window_tuner_options {
+  // The in-flight target as a multiple of the bandwidth-delay product;
+  // above 1 to ride out completion jitter.
+  double headroom = 1.5;
+  // The depth the chunk size is chosen for: enough operations in flight
+  // to pipeline, few enough that each is large.
+  uint32_t preferred_depth = 8;
+  // The window used until the link has been measured.
+  size_t initial_chunk = 64 * 1024;
+  uint32_t initial_depth = 8;
+  // Completions the minimum RTT is taken over; old minimums expire so a
+  // route change is noticed. At least 1.
+  size_t rtt_window = 256;
+  // Bandwidth samples (one per RTT) the maximum is taken over; at least 1.
+  size_t bandwidth_window = 10;
+};
+
+/**
+ * A chunk size and an outstanding-operation depth.
+ */
+struct transfer_window {
+  size_t chunk = 0;
+  uint32_t depth = 0;
+
+  [[nodiscard]]
+  size_t bytes() const {
+    return chunk * depth;
+  }
+};
+
+/**
+ * Sizes a pipelined transfer's window from the measured bandwidth-delay
+ * product.
+ *
+ * Completions give two estimates: the propagation RTT, as the minimum
+ * completion latency over a sliding window (queueing only ever adds
+ * latency), and the bottleneck bandwidth, as the maximum delivery rate
+ * over recent RTT-long intervals. The window targets headroom times their
+ * product: enough to keep the link full, and no more, since anything
+ * beyond the BDP only waits in queues and inflates latency. Chunks are
+ * sized for preferred_depth operations in flight, grown when the depth
+ * bound (max_qp_wr, or max_qp_rd_atom for reads) would cut the window
+ * short.
+ *
+ * The RTT includes one chunk's serialization, so the target keeps one
+ * chunk on the wire beyond the pure BDP, which is what a pipeline needs.
+ *
+ * Example usage:
+ *
+ *     adverbs::window_tuner tuner(
+ *         adverbs::window_limits::from(context.caps()));
+ *     // Before posting:
+ *     auto window = tuner.current(true);
+ *     while (in_flight < window.depth) post_read(window.chunk);
+ *     // On each completion:
+ *     tuner.on_completion(bytes, now_ns - posted_ns, now_ns);
+ */
+class window_tuner {
+ public:
+  explicit window_tuner(
+      const window_limits& limits = {},
+      const window_tuner_options& options = {})
+      : _limits(limits), _options(options) {}
+
+  /**
+   * Record a completed operation.
+   *
+   * @param bytes Its size.
+   * @param latency_ns The time from posting to completion.
+   * @param now_ns The completion time, on any monotonic clock.
+   */
+  void on_completion(size_t bytes, uint64_t latency_ns, uint64_t now_ns);
+
+  /**
+   * The window to run with now.
+   *
+   * @param reads Whether the operations are RDMA reads or atomics, bounded
+   *    by max_read_depth.
+   */
+  [[nodiscard]]
+  transfer_window current(bool reads = false) const;
+
+  /**
+   * The minimum RTT in the window, or 0 before the first completion.
+   */
+  [[nodiscard]]
+  uint64_t min_rtt_ns() const {
+    return _rtts.empty() ? 0 : _rtts.front().second;
+  }
+
+  /**
+   * The bottleneck bandwidth estimate in bytes per ns (GB/s), or 0 until
+   * the first RTT-long interval has passed.
+   */
+  [[nodiscard]]
+  double bandwidth() const;
+
+  /**
+   * The bandwidth-delay product in bytes, or 0 until both are measured.
+   */
+  [[nodiscard]]
+  double bdp() const {
+    return bandwidth() * (double)min_rtt_ns();
+  }
+
+ private:
+  window_limits _limits;
+  window_tuner_options _options;
+  // Completion index and latency, increasing in latency: a monotonic
+  // queue whose front is the window's minimum.
+  std::deque<std::pair<uint64_t, uint64_t>> _rtts;
+  uint64_t _completions = 0;
+  std::deque<double> _rates;
+  uint64_t _interval_start = 0;
+  uint64_t _interval_bytes = 0;
+  bool _started = false;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_WINDOW_TUNER_H
@@ -0,0 +1,311 @@
+#ifndef ADVERBS_WR_TEMPLATE_H
+#define ADVERBS_WR_TEMPLATE_H
+
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "mr_profiler.h"
+
+namespace adverbs {
+
+/**
+ * A send WR and its SGE, pre-built for one repeated operation.
+ *
+ * The QP, opcode, flags, lkey, rkey and both base addresses are filled in
+ * once; each post patches only the offsets, length, wr_id and immediate.
+ * The pair is cache-line aligned and kept hot by reuse, so a post writes a
+ * few words instead of building some 150 bytes of WR.
+ *
+ * Offsets aren't checked against the regions: the caller keeps them in
+ * bounds, as with a hand-built WR.
+ *
+ * Sends never touch the WR's wr union, which for a UD QP holds the
+ * address: set wr.ud once on the WR prepare() returns, and every later
+ * post keeps it.
+ *
+ * Example usage:
+ *
+ *     adverbs::send_template write(
+ *         qp, IBV_WR_RDMA_WRITE, log.data(), log_mr.lkey(), replica_base,
+ *         replica_rkey);
+ *     for (auto& record : records) {
+ *       write.post(record.seq, record.offset, record.offset, record.length);
+ *     }
+ */
+class alignas(64) send_template {
+ public:
+  /**
+   * @param qp The QP to post to.
+   * @param opcode A send, RDMA write or RDMA read opcode.
+   * @param local_base The local region offsets are relative to.
+   * @param lkey Its lkey.
+   * @param remote_base The remote region (ignored by sends).
+   * @param rkey Its rkey (ignored by sends).
+   * @param send_flags The ibv_send_flags of every post.
+   * @throws std::invalid_argument for atomic and other opcodes that carry
+   *    no simple data range.
+   */
+  send_template(
+      struct ibv_qp* qp,
+      enum ibv_wr_opcode opcode,
+      const void* local_base,
+      uint32_t lkey,
+      uint64_t remote_base,
+      uint32_t rkey,
+      unsigned int send_flags = IBV_SEND_SIGNALED)
+      : _qp(qp), _local(reinterpret_cast<uintptr_t>(local_base)) {
+    switch (opcode) {
+      case IBV_WR_SEND:
+      case IBV_WR_SEND_WITH_IMM:
+        _rdma = false;
+        break;
+      case IBV_WR_RDMA_WRITE:
+      case IBV_WR_RDMA_WRITE_WITH_IMM:
+      case IBV_WR_RDMA_READ:
+        break;
+      default:
+        throw std::invalid_argument("opcode can't be templated");
+    }
+    _sge.lkey = lkey;
+    _wr.sg_list = &_sge;
+    _wr.num_sge = 1;
+    _wr.opcode = opcode;
+    _wr.send_flags = send_flags;
+    if (_rdma) {
+      _wr.wr.rdma.remote_addr = remote_base;
+      _wr.wr.rdma.rkey = rkey;
+    }
+    _remote = remote_base;
+  }
+
+  // The WR points at the template's own SGE.
+  send_template(const send_template&) = delete;
+  send_template& operator=(const send_template&) = delete;
+
+  /**
+   * Patch the WR for one operation, without posting it. The immediate is
+   * reset to 0.
+   *
+   * @return The WR, e.g. to link into a chain or set imm_data.
+   */
+  struct ibv_send_wr& prepare(
+      uint64_t wr_id,
+      size_t local_offset,
+      uint64_t remote_offset,
+      uint32_t length) {
+    _wr.wr_id = wr_id;
+    _wr.imm_data = 0;
+    _sge.addr = _local + local_offset;
+    _sge.length = length;
+    if (_rdma) _wr.wr.rdma.remote_addr = _remote + remote_offset;
+    return _wr;
+  }
+
+  /**
+   * Patch and post one operation.
+   *
+   * @throws std::runtime_error if ibv_post_send fails.
+   */
+  void post(
+      uint64_t wr_id,
+      size_t local_offset,
+      uint64_t remote_offset,
+      uint32_t length) {
+    prepare(wr_id, local_offset, remote_offset, length);
+    submit();
+  }
+
+  /**
+   * Patch and post one operation with immediate data (host order), for the
+   * _WITH_IMM opcodes.
+   *
+   * @throws std::runtime_error if ibv_post_send fails.
+   */
+  void post(
+      uint64_t wr_id,
+      size_t local_offset,
+      uint64_t remote_offset,
+      uint32_t length,
+      uint32_t imm) {
+    prepare(wr_id, local_offset, remote_offset, length);
+    _wr.imm_data = htonl(imm);
+    submit();
+  }
+
+  [[nodiscard]]
+  const struct ibv_send_wr& wr() const {
+    return _wr;
+  }
+
+ private:
+  friend class send_batch;
+
+  void submit() {
+    struct ibv_send_wr* bad_wr = nullptr;
+    note_posted(_qp->context, &_wr);
+    if (ibv_post_send(_qp, &_wr, &bad_wr)) {
+      throw std::runtime_error("ibv_post_send failed");
+    }
+  }
+
+  struct ibv_send_wr _wr = {};
+  struct ibv_sge _sge = {};
+  struct ibv_qp* _qp;
+  uintptr_t _local;
+  uint64_t _remote;
+  // Whether the opcode addresses remote memory through wr.rdma.
+  bool _rdma = true;
+};
+
+/**
+ * Thrown when ibv_post_send rejects a WR part way through a send_batch.
+ */
+class batch_post_error : public std::runtime_error {
+ public:
+  explicit batch_post_error(size_t posted)
+      : std::runtime_error("ibv_post_send failed"), _posted(posted) {}
+
+  /**
+   * The WRs ahead of the rejected one, which were posted.
+   */
+  [[nodiscard]]
+  size_t posted() const {
+    return _posted;
+  }
+
+ private:
+  size_t _posted;
+};
+
+/**
+ * Up to capacity operations of one send_template, posted as one chain.
+ *
+ * The WRs are pre-linked copies of the template; add() patches the next
+ * one, and post() cuts the chain after the last added and posts it with a
+ * single ibv_post_send. With signal_last_only, only the chain's last WR
+ * is signaled, whatever the template's flags.
+ *
+ * Example usage:
+ *
+ *     adverbs::send_batch batch(write, 32, true);
+ *     for (auto& record : records) {
+ *       batch.add(record.seq, record.offset, record.offset, record.length);
+ *       if (batch.full()) batch.post();
+ *     }
+ *     batch.post();
+ */
+class send_batch {
+ public:
+  send_batch(
+      const send_template& proto,
+      size_t capacity,
+      bool signal_last_only = false)
+      : _qp(proto._qp),
+        _local(proto._local),
+        _remote(proto._remote),
+        _rdma(proto._rdma),
+        _signal_last_only(signal_last_only),
+        _wrs(capacity, proto._wr),
+        _sges(capacity, proto._sge) {
+    if (capacity == 0) {
+      throw std::invalid_argument("send_batch capacity must be positive");
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+      _wrs[i].sg_list = &_sges[i];
+      _wrs[i].next = i + 1 < capacity ? &_wrs[i + 1] : nullptr;
+      if (signal_last_only) _wrs[i].send_flags &= ~IBV_SEND_SIGNALED;
+    }
+  }
+
+  send_batch(const send_batch&) = delete;
+  send_batch& operator=(const send_batch&) = delete;
+
+  /**
+   * Patch the next WR of the chain. Its immediate is reset to 0.
+   *
+   * @return The WR, e.g. to set imm_data.
+   * @throws std::length_error if the batch is full.
+   */
+  struct ibv_send_wr& add(
+      uint64_t wr_id,
+      size_t local_offset,
+      uint64_t remote_offset,
+      uint32_t length) {
+    if (_size == _wrs.size()) {
+      throw std::length_error("send_batch is full");
+    }
+    struct ibv_send_wr& wr = _wrs[_size];
+    struct ibv_sge& sge = _sges[_size];
+    ++_size;
+    wr.wr_id = wr_id;
+    wr.imm_data = 0;
+    sge.addr = _local + local_offset;
+    sge.length = length;
+    if (_rdma) wr.wr.rdma.remote_addr = _remote + remote_offset;
+    return wr;
+  }
+
+  /**
+   * Post the added WRs, if any, and empty the batch.
+   *
+   * @param solicit_last Set IBV_SEND_SOLICITED on the last WR, so a
+   *    receiver sleeping for solicited events (cq_waiter) wakes once per
+   *    batch; for the send and _WITH_IMM opcodes.
+   * @throws batch_post_error if ibv_post_send fails; its posted() WRs went
+   *    out and the rest didn't. The batch is emptied either way. With
+   *    signal_last_only the posted WRs were all unsignaled, so nothing
+   *    will report their completion: the QP has to be reset or torn down.
+   */
+  void post(bool solicit_last = false) {
+    if (_size == 0) return;
+    struct ibv_send_wr& last = _wrs[_size - 1];
+    struct ibv_send_wr* next = last.next;
+    unsigned int flags = last.send_flags;
+    last.next = nullptr;
+    if (_signal_last_only) last.send_flags |= IBV_SEND_SIGNALED;
+    if (solicit_last) last.send_flags |= IBV_SEND_SOLICITED;
+    struct ibv_send_wr* bad_wr = nullptr;
+    note_posted(_qp->context, _wrs.data());
+    int rc = ibv_post_send(_qp, _wrs.data(), &bad_wr);
+    last.next = next;
+    last.send_flags = flags;
+    size_t count = _size;
+    _size = 0;
+    if (rc) {
+      size_t posted = 0;
+      if (bad_wr >= _wrs.data() && bad_wr < _wrs.data() + count) {
+        posted = bad_wr - _wrs.data();
+      }
+      throw batch_post_error(posted);
+    }
+  }
+
+  [[nodiscard]]
+  size_t size() const {
+    return _size;
+  }
+
+  [[nodiscard]]
+  bool full() const {
+    return _size == _wrs.size();
+  }
+
+ private:
+  struct ibv_qp* _qp;
+  uintptr_t _local;
+  uint64_t _remote;
+  bool _rdma;
+  bool _signal_last_only;
+  std::vector<struct ibv_send_wr> _wrs;
+  std::vector<struct ibv_sge> _sges;
+  size_t _size = 0;
+};
+
+}  // namespace adverbs
+
+#endif  // ADVERBS_WR_TEMPLATE_H
@@ -0,0 +1,155 @@
+#include "buffer_pool.h"
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+struct test_arena {
+  explicit test_arena(size_t length)
+      : memory(std::make_unique<std::byte[]>(length + 64)),
+        arena(memory.get(), length + 64, 7) {}
+
+  std::unique_ptr<std::byte[]> memory;
+  adverbs::buffer_arena arena;
+};
+
+}  // namespace
+
+TEST(buffer_arena, allocates_and_coalesces) {
+  test_arena t(4096);
+  size_t total = t.arena.free_bytes();
+  EXPECT_GE(total, 4096);
+
+  std::byte* a = t.arena.allocate(100);
+  std::byte* b = t.arena.allocate(64);
+  std::byte* c = t.arena.allocate(1);
+  ASSERT_NE(nullptr, a);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(a) % 64);
+  EXPECT_EQ(a + 128, b);
+  EXPECT_EQ(b + 64, c);
+  EXPECT_EQ(total - 256, t.arena.free_bytes());
+
+  t.arena.deallocate(a, 100);
+  t.arena.deallocate(c, 1);
+  t.arena.deallocate(b, 64);
+  EXPECT_EQ(total, t.arena.free_bytes());
+
+  // Fully coalesced: the whole arena is one extent again.
+  std::byte* all = t.arena.allocate(total);
+  EXPECT_EQ(a, all);
+  EXPECT_EQ(nullptr, t.arena.allocate(1));
+}
+
+TEST(buffer_pool, power_of_two_classes) {
+  test_arena t(1 << 20);
+  adverbs::buffer_pool pool(t.arena, {.min_size = 64, .max_size = 1000});
+  EXPECT_EQ(
+      (std::vector<size_t>{64, 128, 256, 512, 1024}),
+      pool.classes());
+
+  auto buf = pool.allocate(300);
+  ASSERT_TRUE(buf.has_value());
+  EXPECT_EQ(512, buf->capacity);
+  EXPECT_EQ(300, buf->size);
+  EXPECT_EQ(7, buf->lkey);
+  EXPECT_EQ(212, pool.wasted_bytes());
+
+  // Freed buffers are reused.
+  std::byte* data = buf->data;
+  pool.deallocate(*buf);
+  EXPECT_EQ(0, pool.wasted_bytes());
+  EXPECT_EQ(data, pool.allocate(257)->data);
+
+  EXPECT_THROW(pool.allocate(1001), std::invalid_argument);
+}
+
+TEST(buffer_pool, exhaustion) {
+  test_arena t(256);
+  adverbs::buffer_pool pool(t.arena, {.min_size = 128, .max_size = 128});
+  EXPECT_TRUE(pool.allocate(100).has_value());
+  EXPECT_TRUE(pool.allocate(100).has_value());
+  EXPECT_FALSE(pool.allocate(100).has_value());
+}
+
+TEST(buffer_pool, fit_classes_minimizes_waste) {
+  // Two modes; the 2 best classes are the top of each mode.
+  std::map<size_t, uint64_t> histogram = {
+      {250, 10},
+      {300, 100},
+      {1000, 5},
+      {1100, 50},
+  };
+  EXPECT_EQ(
+      (std::vector<size_t>{320, 1152}),
+      adverbs::buffer_pool::fit_classes(histogram, 2));
+  EXPECT_EQ(
+      (std::vector<size_t>{256, 320, 1024, 1152}),
+      adverbs::buffer_pool::fit_classes(histogram, 8));
+  EXPECT_EQ(
+      (std::vector<size_t>{1152}),
+      adverbs::buffer_pool::fit_classes(histogram, 1));
+}
+
+TEST(buffer_pool, adaptive_retunes_to_traffic) {
+  test_arena t(1 << 22);
+  adverbs::buffer_pool pool(
+      t.arena,
+      {.mode = adverbs::size_class_mode::adaptive,
+       .max_size = 4096,
+       .max_classes = 2,
+       .retune_interval = 100});
+
+  // Skewed traffic: just over the power-of-two boundaries.
+  std::vector<adverbs::pool_buffer> held;
+  for (int i = 0; i < 100; ++i) {
+    held.push_back(*pool.allocate(i % 4 == 0 ? 1100 : 300));
+  }
+  EXPECT_EQ((std::vector<size_t>{320, 1152}), pool.classes());
+
+  // Buffers from retired classes go straight back to the arena.
+  size_t free_before = t.arena.free_bytes();
+  for (const auto& buf : held) pool.deallocate(buf);
+  EXPECT_EQ(free_before + 75 * 512 + 25 * 2048, t.arena.free_bytes());
+  EXPECT_EQ(0, pool.wasted_bytes());
+
+  held.clear();
+  for (int i = 0; i < 10; ++i) held.push_back(*pool.allocate(300));
+  EXPECT_EQ(320, held[0].capacity);
+  EXPECT_EQ(200, pool.wasted_bytes());
+}
+
+TEST(buffer_pool, adaptive_returns_cold_classes) {
+  test_arena t(1 << 22);
+  adverbs::buffer_pool pool(
+      t.arena,
+      {.mode = adverbs::size_class_mode::adaptive,
+       .max_size = 4096,
+       .max_classes = 2,
+       .retune_interval = 50,
+       .reserve_headroom = 0});
+
+  auto churn = [&](size_t size, int outstanding, int rounds) {
+    for (int r = 0; r < rounds; ++r) {
+      std::vector<adverbs::pool_buffer> held;
+      for (int i = 0; i < outstanding; ++i) held.push_back(*pool.allocate(size));
+      for (const auto& buf : held) pool.deallocate(buf);
+    }
+  };
+
+  churn(300, 10, 5);
+  churn(1100, 5, 10);
+  ASSERT_EQ((std::vector<size_t>{320, 1152}), pool.classes());
+  // 1152 is new; its demand hasn't been measured yet.
+  EXPECT_EQ(SIZE_MAX, pool.reserve(1152));
+
+  churn(1100, 5, 10);
+  ASSERT_EQ((std::vector<size_t>{320, 1152}), pool.classes());
+  // The 320 class saw no use in the last interval, so its reserve is
+  // released to the arena.
+  EXPECT_EQ(0, pool.reserve(320));
+  EXPECT_EQ(5, pool.reserve(1152));
+}
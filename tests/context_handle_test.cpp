@@ -13,6 +13,12 @@ TEST(context_handle, attributes) {
     auto attr = handle.query_device_attr();
     EXPECT_GT(attr.max_mr_size, 0);
 
+    auto attr_ex = handle.query_device_attr_ex();
+    EXPECT_EQ(attr_ex.orig_attr.max_mr_size, attr.max_mr_size);
+    // Copies share one query.
+    EXPECT_EQ(&handle.caps(), &orig.caps());
+    EXPECT_EQ(handle.caps().max_qp_wr, (uint32_t)attr.max_qp_wr);
+
     auto ports = handle.query_ports();
 
     auto ib_ports = handle.query_ports([](const auto& port) {
@@ -20,3 +26,15 @@ TEST(context_handle, attributes) {
     });
   }
 }
+
+TEST(context_handle, completion_channel) {
+  adverbs::scoped_device_list device_list;
+
+  for (auto& dev : device_list) {
+    adverbs::context_handle context(dev);
+    adverbs::completion_channel_handle channel(context);
+    EXPECT_GE(channel.fd(), 0);
+    adverbs::completion_queue_handle cq(context, 16, channel);
+    cq.req_notify(true);
+  }
+}
@@ -0,0 +1,90 @@
+#include "copy_engine.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+std::vector<adverbs::copy_isa> supported_isas() {
+  std::vector<adverbs::copy_isa> isas;
+  for (auto isa :
+       {adverbs::copy_isa::scalar,
+        adverbs::copy_isa::avx2,
+        adverbs::copy_isa::avx512,
+        adverbs::copy_isa::neon}) {
+    if (adverbs::copy_engine::supported(isa)) isas.push_back(isa);
+  }
+  return isas;
+}
+
+std::vector<unsigned char> pattern(size_t n) {
+  std::vector<unsigned char> data(n);
+  for (size_t i = 0; i < n; ++i) data[i] = (unsigned char)(i * 131 + 7);
+  return data;
+}
+
+}  // namespace
+
+TEST(copy_engine, detect) {
+  EXPECT_TRUE(
+      adverbs::copy_engine::supported(adverbs::copy_engine::detect()));
+  EXPECT_TRUE(adverbs::copy_engine::supported(adverbs::copy_isa::scalar));
+  EXPECT_EQ(adverbs::copy_isa_name(adverbs::copy_isa::avx2), "avx2");
+}
+
+TEST(copy_engine, unsupported) {
+  for (auto isa : {adverbs::copy_isa::avx512, adverbs::copy_isa::neon}) {
+    if (!adverbs::copy_engine::supported(isa)) {
+      EXPECT_THROW(adverbs::copy_engine{isa}, std::invalid_argument);
+    }
+  }
+}
+
+TEST(copy_engine, non_temporal_sizes_and_alignments) {
+  auto src = pattern(4096 + 64);
+  for (auto isa : supported_isas()) {
+    adverbs::copy_engine engine(isa);
+    for (size_t n : {0, 1, 31, 32, 63, 64, 127, 255, 256, 257, 1000, 4096}) {
+      for (size_t misalign : {0, 1, 17, 33}) {
+        std::vector<unsigned char> dst(n + 64 + 2, 0xee);
+        engine.copy_non_temporal(dst.data() + misalign, src.data() + 3, n);
+        ASSERT_EQ(0, std::memcmp(dst.data() + misalign, src.data() + 3, n))
+            << adverbs::copy_isa_name(isa) << " n=" << n
+            << " misalign=" << misalign;
+        // Nothing written past the end.
+        ASSERT_EQ(dst[misalign + n], 0xee);
+        if (misalign) {
+          ASSERT_EQ(dst[misalign - 1], 0xee);
+        }
+      }
+    }
+  }
+}
+
+TEST(copy_engine, parallel) {
+  size_t n = 1024 * 1024 + 13;
+  auto src = pattern(n);
+  for (auto isa : supported_isas()) {
+    adverbs::copy_engine engine(
+        isa,
+        {.non_temporal_threshold = 1024,
+         .parallel_threshold = 64 * 1024,
+         .max_threads = 3});
+    std::vector<unsigned char> dst(n + 1, 0xee);
+    engine.copy(dst.data() + 1, src.data(), n);
+    ASSERT_EQ(0, std::memcmp(dst.data() + 1, src.data(), n))
+        << adverbs::copy_isa_name(isa);
+    EXPECT_EQ(dst[0], 0xee);
+  }
+}
+
+TEST(copy_engine, small_copies) {
+  auto src = pattern(100);
+  adverbs::copy_engine engine;
+  std::vector<unsigned char> dst(100);
+  engine.copy(dst.data(), src.data(), 100);
+  EXPECT_EQ(dst, src);
+}
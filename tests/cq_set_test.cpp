@@ -0,0 +1,117 @@
+#include "cq_set.h"
+
+#include <infiniband/verbs.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "fake_verbs.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+void fill(adverbs_test::fake_verbs& fake, struct ibv_cq* cq, int n) {
+  for (int i = 0; i < n; ++i) fake.complete(cq, {.wr_id = (uint64_t)i});
+}
+
+TEST(cq_set, budgets_share_rounds_fairly) {
+  adverbs_test::fake_verbs fake;
+  adverbs::cq_set cqs({.budget = 16});
+  std::vector<struct ibv_cq*> raw;
+  for (int i = 0; i < 3; ++i) {
+    raw.push_back(fake.make_cq());
+    cqs.add(raw.back());
+  }
+  fill(fake, raw[0], 100);
+  fill(fake, raw[1], 100);
+  fill(fake, raw[2], 5);
+
+  std::vector<size_t> per_cq(3);
+  auto count = [&](size_t cq, const struct ibv_wc&) { per_cq[cq]++; };
+  EXPECT_EQ(cqs.poll(count), 37u);
+  EXPECT_EQ(per_cq, (std::vector<size_t>{16, 16, 5}));
+  EXPECT_EQ(cqs.completions(2), 5u);
+}
+
+TEST(cq_set, rotates_the_first_cq) {
+  adverbs_test::fake_verbs fake;
+  adverbs::cq_set cqs({.max_idle_skip = 0});
+  std::vector<struct ibv_cq*> raw;
+  for (int i = 0; i < 3; ++i) {
+    raw.push_back(fake.make_cq());
+    cqs.add(raw.back());
+  }
+  std::vector<size_t> firsts;
+  for (int round = 0; round < 3; ++round) {
+    for (auto* cq : raw) fill(fake, cq, 1);
+    std::vector<size_t> order;
+    cqs.poll([&](size_t cq, const struct ibv_wc&) { order.push_back(cq); });
+    ASSERT_EQ(order.size(), 3u);
+    firsts.push_back(order[0]);
+  }
+  EXPECT_EQ(firsts, (std::vector<size_t>{0, 1, 2}));
+}
+
+TEST(cq_set, skips_idle_cqs_with_backoff) {
+  adverbs_test::fake_verbs fake;
+  adverbs::cq_set cqs({.max_idle_skip = 4});
+  auto* cq = fake.make_cq();
+  cqs.add(cq);
+  auto ignore = [](size_t, const struct ibv_wc&) {};
+
+  // Polled, then skipped 1, 2, 4, 4 rounds.
+  std::vector<int> polled_rounds;
+  for (int round = 0; round < 16; ++round) {
+    int before = fake.poll_cq_calls;
+    cqs.poll(ignore);
+    if (fake.poll_cq_calls != before) polled_rounds.push_back(round);
+  }
+  EXPECT_EQ(polled_rounds, (std::vector<int>{0, 2, 5, 10, 15}));
+  EXPECT_TRUE(cqs.idle(0));
+
+  // Waking ends the skip.
+  fill(fake, cq, 3);
+  cqs.wake(0);
+  EXPECT_FALSE(cqs.idle(0));
+  EXPECT_EQ(cqs.poll(ignore), 3u);
+}
+
+TEST(cq_set, boosts_busy_latency_cqs) {
+  adverbs_test::fake_verbs fake;
+  adverbs::cq_set cqs({.latency_budget = 1, .boost_rounds = 2});
+  auto* control = fake.make_cq();
+  std::vector<struct ibv_cq*> bulk;
+  size_t latency = cqs.add(control, adverbs::cq_priority::latency);
+  for (int i = 0; i < 3; ++i) {
+    bulk.push_back(fake.make_cq());
+    cqs.add(bulk.back());
+  }
+  for (auto* cq : bulk) fill(fake, cq, 100);
+  fill(fake, control, 10);
+
+  // A quiet latency CQ is polled once per round and never skipped.
+  std::vector<size_t> order;
+  auto record = [&](size_t cq, const struct ibv_wc&) { order.push_back(cq); };
+  cqs.poll(record);
+  // Boosted by its first completion, it is polled again after every
+  // normal CQ.
+  EXPECT_TRUE(cqs.boosted(latency));
+  std::vector<size_t> control_hits;
+  for (size_t k = 0; k < order.size(); ++k) {
+    if (order[k] == latency) control_hits.push_back(k);
+  }
+  EXPECT_EQ(control_hits.size(), 4u);
+
+  // Once drained, the boost wears off after boost_rounds rounds.
+  for (int round = 0; round < 4; ++round) cqs.poll(record);
+  EXPECT_EQ(cqs.completions(latency), 10u);
+  for (int round = 0; round < 3; ++round) cqs.poll(record);
+  EXPECT_FALSE(cqs.boosted(latency));
+  EXPECT_FALSE(cqs.idle(latency));
+}
+
+TEST(cq_set, rejects_bad_budgets) {
+  EXPECT_THROW(adverbs::cq_set({.budget = 0}), std::invalid_argument);
+}
+
+}  // namespace
@@ -0,0 +1,143 @@
+#include "cq_waiter.h"
+
+#include <infiniband/verbs.h>
+#include <unistd.h>
+
+#include <optional>
+#include <vector>
+
+#include "fake_verbs.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// A completion channel backed by a pipe, whose fd is readable only while
+// the test has raised an event. Like the kernel's, an event carries its
+// CQ's handle.
+struct pipe_channel {
+  pipe_channel() {
+    EXPECT_EQ(pipe(fds), 0);
+    channel.fd = fds[0];
+  }
+
+  ~pipe_channel() {
+    close(fds[0]);
+    close(fds[1]);
+  }
+
+  void raise(struct ibv_cq* cq) {
+    EXPECT_EQ(write(fds[1], &cq, sizeof(cq)), (ssize_t)sizeof(cq));
+  }
+
+  struct ibv_cq* take(struct ibv_comp_channel* c) {
+    struct ibv_cq* cq = nullptr;
+    EXPECT_EQ(read(c->fd, &cq, sizeof(cq)), (ssize_t)sizeof(cq));
+    return cq;
+  }
+
+  int fds[2];
+  struct ibv_comp_channel channel = {};
+};
+
+TEST(cq_waiter, returns_ready_completions_without_arming) {
+  adverbs_test::fake_verbs fake;
+  auto* cq = fake.make_cq();
+  pipe_channel channel;
+  adverbs::cq_waiter waiter(cq, &channel.channel);
+
+  fake.complete(cq, {.wr_id = 1});
+  fake.complete(cq, {.wr_id = 2});
+  struct ibv_wc wc[4];
+  EXPECT_EQ(waiter.wait(wc), 2);
+  EXPECT_EQ(wc[1].wr_id, 2u);
+  EXPECT_TRUE(fake.notify_requests.empty());
+  EXPECT_EQ(waiter.sleeps(), 0u);
+}
+
+TEST(cq_waiter, arms_for_solicited_events_then_sleeps) {
+  adverbs_test::fake_verbs fake;
+  auto* cq = fake.make_cq();
+  pipe_channel channel;
+  adverbs::cq_waiter waiter(cq, &channel.channel);
+
+  struct ibv_wc wc[4];
+  EXPECT_EQ(waiter.wait(wc, 0), 0);
+  EXPECT_EQ(fake.notify_requests, std::vector<int>{1});
+  // Polled before arming, and again after to close the race.
+  EXPECT_EQ(fake.poll_cq_calls, 2);
+  EXPECT_EQ(waiter.sleeps(), 1u);
+
+  // Still armed: no second request.
+  EXPECT_EQ(waiter.wait(wc, 0), 0);
+  EXPECT_EQ(fake.notify_requests.size(), 1u);
+
+  // A completion that arrives while armed is returned directly.
+  fake.complete(cq, {.wr_id = 9});
+  EXPECT_EQ(waiter.wait(wc, 0), 1);
+  EXPECT_EQ(wc[0].wr_id, 9u);
+}
+
+TEST(cq_waiter, can_wake_on_every_completion) {
+  adverbs_test::fake_verbs fake;
+  auto* cq = fake.make_cq();
+  pipe_channel channel;
+  adverbs::cq_waiter waiter(cq, &channel.channel, {.solicited_only = false});
+
+  struct ibv_wc wc[1];
+  EXPECT_EQ(waiter.wait(wc, 0), 0);
+  EXPECT_EQ(fake.notify_requests, std::vector<int>{0});
+}
+
+TEST(cq_waiter, rearms_after_events_and_batches_acks) {
+  adverbs_test::fake_verbs fake;
+  auto* cq = fake.make_cq();
+  auto* other = fake.make_cq();
+  pipe_channel channel;
+  // Each event comes with the completion that raised it.
+  uint64_t next_wr_id = 0;
+  auto get_event = [&](struct ibv_comp_channel* c) {
+    struct ibv_cq* raised = channel.take(c);
+    fake.complete(raised, {.wr_id = next_wr_id++});
+    return raised;
+  };
+  std::optional<adverbs::cq_waiter> waiter;
+  waiter.emplace(
+      cq,
+      &channel.channel,
+      adverbs::cq_waiter_options{.ack_batch = 2},
+      get_event);
+
+  struct ibv_wc wc[4];
+  channel.raise(cq);
+  EXPECT_EQ(waiter->wait(wc, 0), 1);
+  EXPECT_EQ(wc[0].wr_id, 0u);
+  EXPECT_EQ(waiter->sleeps(), 1u);
+  EXPECT_EQ(waiter->events(), 1u);
+  EXPECT_EQ(cq->comp_events_completed, 0u);
+
+  // The event disarmed the CQ, so the next sleep arms it again; the
+  // second event completes a batch of acks.
+  channel.raise(cq);
+  EXPECT_EQ(waiter->wait(wc, 0), 1);
+  EXPECT_EQ(fake.notify_requests, (std::vector<int>{1, 1}));
+  EXPECT_EQ(cq->comp_events_completed, 2u);
+
+  channel.raise(cq);
+  EXPECT_EQ(waiter->wait(wc, 0), 1);
+  EXPECT_EQ(cq->comp_events_completed, 2u);
+
+  // Another CQ's event is acked at once and leaves this one armed: it
+  // sleeps again without a fifth request.
+  channel.raise(other);
+  EXPECT_EQ(waiter->wait(wc, 0), 0);
+  EXPECT_EQ(other->comp_events_completed, 1u);
+  EXPECT_EQ(fake.notify_requests.size(), 4u);
+  EXPECT_EQ(waiter->sleeps(), 5u);
+  EXPECT_EQ(waiter->events(), 4u);
+
+  // The destructor acks the rest of the batch.
+  waiter.reset();
+  EXPECT_EQ(cq->comp_events_completed, 3u);
+}
+
+}  // namespace
@@ -0,0 +1,71 @@
+#include "device_caps.h"
+
+#include <infiniband/verbs.h>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(device_caps, empty_attributes_support_nothing) {
+  struct ibv_device_attr_ex attr = {};
+  auto caps = adverbs::device_caps::from(attr);
+  EXPECT_FALSE(caps.odp());
+  EXPECT_FALSE(caps.odp_implicit());
+  EXPECT_FALSE(caps.odp_supports(IBV_QPT_RC, IBV_ODP_SUPPORT_SEND));
+  EXPECT_FALSE(caps.completion_timestamps());
+  EXPECT_FALSE(caps.rate_limit(IBV_QPT_RC));
+  EXPECT_FALSE(caps.tso(IBV_QPT_RAW_PACKET));
+  EXPECT_FALSE(caps.rss(IBV_QPT_RAW_PACKET));
+  EXPECT_FALSE(caps.device_memory());
+}
+
+TEST(device_caps, from_attributes) {
+  struct ibv_device_attr_ex attr = {};
+  attr.orig_attr.max_qp_wr = 32768;
+  attr.orig_attr.max_qp_rd_atom = 16;
+  attr.orig_attr.max_mr_size = 1ull << 40;
+  attr.orig_attr.atomic_cap = IBV_ATOMIC_HCA;
+  attr.orig_attr.device_cap_flags = IBV_DEVICE_MEM_WINDOW;
+  attr.device_cap_flags_ex = IBV_DEVICE_PCI_WRITE_END_PADDING;
+  attr.odp_caps.general_caps = IBV_ODP_SUPPORT;
+  attr.odp_caps.per_transport_caps.rc_odp_caps =
+      IBV_ODP_SUPPORT_SEND | IBV_ODP_SUPPORT_RECV | IBV_ODP_SUPPORT_WRITE;
+  attr.completion_timestamp_mask = (1ull << 63) - 1;
+  attr.hca_core_clock = 156250;
+  attr.packet_pacing_caps.qp_rate_limit_min = 1000;
+  attr.packet_pacing_caps.qp_rate_limit_max = 100'000'000;
+  attr.packet_pacing_caps.supported_qpts = 1 << IBV_QPT_RAW_PACKET;
+  attr.tso_caps.max_tso = 262144;
+  attr.tso_caps.supported_qpts = 1 << IBV_QPT_RAW_PACKET;
+  attr.rss_caps.supported_qpts = 1 << IBV_QPT_RAW_PACKET;
+  attr.rss_caps.max_rwq_indirection_table_size = 512;
+  attr.max_dm_size = 131072;
+
+  auto caps = adverbs::device_caps::from(attr);
+  EXPECT_EQ(caps.max_qp_wr, 32768u);
+  EXPECT_EQ(caps.max_qp_rd_atom, 16u);
+  EXPECT_EQ(caps.atomic_cap, IBV_ATOMIC_HCA);
+  EXPECT_TRUE(caps.has_flag(IBV_DEVICE_MEM_WINDOW));
+  EXPECT_TRUE(caps.has_flag(IBV_DEVICE_PCI_WRITE_END_PADDING));
+  EXPECT_FALSE(caps.has_flag(IBV_DEVICE_RAW_SCATTER_FCS));
+
+  EXPECT_TRUE(caps.odp());
+  EXPECT_FALSE(caps.odp_implicit());
+  EXPECT_TRUE(caps.odp_supports(
+      IBV_QPT_RC, IBV_ODP_SUPPORT_SEND | IBV_ODP_SUPPORT_WRITE));
+  EXPECT_FALSE(caps.odp_supports(IBV_QPT_RC, IBV_ODP_SUPPORT_READ));
+  EXPECT_FALSE(caps.odp_supports(IBV_QPT_UD, IBV_ODP_SUPPORT_SEND));
+
+  EXPECT_TRUE(caps.completion_timestamps());
+  EXPECT_EQ(caps.hca_core_clock, 156250u);
+
+  EXPECT_TRUE(caps.rate_limit(IBV_QPT_RAW_PACKET));
+  EXPECT_FALSE(caps.rate_limit(IBV_QPT_RC));
+  EXPECT_EQ(caps.rate_limit_max, 100'000'000u);
+  EXPECT_TRUE(caps.tso(IBV_QPT_RAW_PACKET));
+  EXPECT_TRUE(caps.rss(IBV_QPT_RAW_PACKET));
+  EXPECT_FALSE(caps.rss(IBV_QPT_UD));
+  EXPECT_TRUE(caps.device_memory());
+}
+
+}  // namespace
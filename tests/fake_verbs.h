@@ -0,0 +1,138 @@
+#ifndef ADVERBS_TESTS_FAKE_VERBS_H
+#define ADVERBS_TESTS_FAKE_VERBS_H
+
+#include <infiniband/verbs.h>
+
+#include <cerrno>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace adverbs_test {
+
+/**
+ * A fake verbs provider for tests without RDMA hardware.
+ *
+ * ibv_post_send, ibv_post_recv, ibv_poll_cq and ibv_req_notify_cq are
+ * inline dispatches through ibv_context::ops; this fills those in, records
+ * what was posted, and serves completions queued by the test.
+ *
+ * Only one fake_verbs may be alive at a time.
+ */
+struct fake_verbs {
+  struct posted_send {
+    struct ibv_send_wr wr;
+    std::vector<struct ibv_sge> sges;
+  };
+
+  struct posted_recv {
+    struct ibv_recv_wr wr;
+    std::vector<struct ibv_sge> sges;
+  };
+
+  fake_verbs() {
+    current() = this;
+    context.ops.post_send = post_send;
+    context.ops.post_recv = post_recv;
+    context.ops.poll_cq = poll_cq;
+    context.ops.req_notify_cq = req_notify_cq;
+  }
+
+  ~fake_verbs() { current() = nullptr; }
+
+  fake_verbs(const fake_verbs&) = delete;
+  fake_verbs& operator=(const fake_verbs&) = delete;
+
+  struct ibv_qp* make_qp(uint32_t qp_num) {
+    auto& qp = qps.emplace_back();
+    qp.context = &context;
+    qp.qp_num = qp_num;
+    return &qp;
+  }
+
+  struct ibv_cq* make_cq() {
+    auto& cq = cqs.emplace_back();
+    cq.context = &context;
+    return &cq;
+  }
+
+  // Queue a completion for cq.
+  void complete(struct ibv_cq* cq, struct ibv_wc wc) {
+    completions[cq].push_back(wc);
+  }
+
+  struct ibv_context context = {};
+  std::deque<struct ibv_qp> qps;
+  std::deque<struct ibv_cq> cqs;
+
+  std::vector<posted_send> sends;
+  std::vector<posted_recv> recvs;
+  int post_send_calls = 0;
+  int post_recv_calls = 0;
+  int poll_cq_calls = 0;
+  std::vector<int> notify_requests;
+  // When non-negative, posting fails at the WR with this index.
+  int fail_send_at = -1;
+  int fail_recv_at = -1;
+
+  std::unordered_map<struct ibv_cq*, std::deque<struct ibv_wc>> completions;
+
+ private:
+  static fake_verbs*& current() {
+    static fake_verbs* instance = nullptr;
+    return instance;
+  }
+
+  static int post_send(
+      struct ibv_qp*,
+      struct ibv_send_wr* wr,
+      struct ibv_send_wr** bad_wr) {
+    fake_verbs& f = *current();
+    f.post_send_calls++;
+    for (; wr; wr = wr->next) {
+      if (f.fail_send_at == (int)f.sends.size()) {
+        *bad_wr = wr;
+        return ENOMEM;
+      }
+      f.sends.push_back({*wr, {wr->sg_list, wr->sg_list + wr->num_sge}});
+    }
+    return 0;
+  }
+
+  static int post_recv(
+      struct ibv_qp*,
+      struct ibv_recv_wr* wr,
+      struct ibv_recv_wr** bad_wr) {
+    fake_verbs& f = *current();
+    f.post_recv_calls++;
+    for (; wr; wr = wr->next) {
+      if (f.fail_recv_at == (int)f.recvs.size()) {
+        *bad_wr = wr;
+        return ENOMEM;
+      }
+      f.recvs.push_back({*wr, {wr->sg_list, wr->sg_list + wr->num_sge}});
+    }
+    return 0;
+  }
+
+  static int poll_cq(struct ibv_cq* cq, int num_entries, struct ibv_wc* wc) {
+    fake_verbs& f = *current();
+    f.poll_cq_calls++;
+    auto& queue = f.completions[cq];
+    int n = 0;
+    while (n < num_entries && !queue.empty()) {
+      wc[n++] = queue.front();
+      queue.pop_front();
+    }
+    return n;
+  }
+
+  static int req_notify_cq(struct ibv_cq*, int solicited_only) {
+    current()->notify_requests.push_back(solicited_only);
+    return 0;
+  }
+};
+
+}  // namespace adverbs_test
+
+#endif  // ADVERBS_TESTS_FAKE_VERBS_H
@@ -0,0 +1,196 @@
+#include "handover.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+struct socket_pair {
+  socket_pair() {
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  }
+  ~socket_pair() {
+    ::close(fds[0]);
+    ::close(fds[1]);
+  }
+  int fds[2];
+};
+
+}  // namespace
+
+TEST(handover, message_round_trip) {
+  socket_pair sockets;
+  int pipe_fds[2];
+  ASSERT_EQ(0, pipe(pipe_fds));
+  int memfd = memfd_create("handover_test", 0);
+  ASSERT_GE(memfd, 0);
+  ASSERT_EQ(0, ftruncate(memfd, 4096));
+  ASSERT_EQ(5, pwrite(memfd, "hello", 5, 0));
+
+  adverbs::handover_message sent;
+  // A stand-in for the device's cmd_fd.
+  sent.cmd_fd = pipe_fds[1];
+  sent.pds = {3, 9};
+  sent.mrs.push_back({1, 17, 0x10000, 4096});
+  sent.regions.push_back({memfd, 0x10000, 4096});
+  adverbs::handover_qp qp;
+  qp.qp_num = 100;
+  qp.remote_qp_num = 200;
+  qp.remote_gid[15] = 7;
+  qp.user = 42;
+  sent.qps.push_back(qp);
+  sent.app_state = {std::byte{1}, std::byte{2}, std::byte{3}};
+
+  auto sender = std::async(std::launch::async, [&]() {
+    adverbs::send_handover(sockets.fds[0], sent);
+  });
+  adverbs::handover_message received =
+      adverbs::receive_handover(sockets.fds[1]);
+  // Acknowledge as import_handover would.
+  uint8_t ack = 0x06;
+  ASSERT_EQ(1, write(sockets.fds[1], &ack, 1));
+  sender.get();
+
+  EXPECT_EQ(sent.pds, received.pds);
+  ASSERT_EQ(1, received.mrs.size());
+  EXPECT_EQ(1, received.mrs[0].pd);
+  EXPECT_EQ(17, received.mrs[0].handle);
+  ASSERT_EQ(1, received.qps.size());
+  EXPECT_EQ(200, received.qps[0].remote_qp_num);
+  EXPECT_EQ(7, received.qps[0].remote_gid[15]);
+  EXPECT_EQ(42, received.qps[0].user);
+  EXPECT_EQ(sent.app_state, received.app_state);
+
+  // The fds arrived as new descriptors for the same files.
+  ASSERT_EQ(1, received.regions.size());
+  EXPECT_NE(memfd, received.regions[0].fd);
+  char buf[5];
+  ASSERT_EQ(5, pread(received.regions[0].fd, buf, 5, 0));
+  EXPECT_EQ(0, std::memcmp(buf, "hello", 5));
+  ASSERT_EQ(1, write(received.cmd_fd, "x", 1));
+  ASSERT_EQ(1, read(pipe_fds[0], buf, 1));
+  EXPECT_EQ('x', buf[0]);
+
+  ::close(received.cmd_fd);
+  ::close(received.regions[0].fd);
+  ::close(memfd);
+  ::close(pipe_fds[0]);
+  ::close(pipe_fds[1]);
+}
+
+TEST(handover, rejects_garbage) {
+  socket_pair sockets;
+  char garbage[64] = {1, 2, 3};
+  ASSERT_EQ(64, write(sockets.fds[0], garbage, sizeof(garbage)));
+  EXPECT_THROW(adverbs::receive_handover(sockets.fds[1]), std::runtime_error);
+}
+
+TEST(handover, missing_ack) {
+  socket_pair sockets;
+  int pipe_fds[2];
+  ASSERT_EQ(0, pipe(pipe_fds));
+  adverbs::handover_message message;
+  message.cmd_fd = pipe_fds[0];
+  auto receiver = std::async(std::launch::async, [&]() {
+    auto received = adverbs::receive_handover(sockets.fds[1]);
+    ::close(received.cmd_fd);
+    shutdown(sockets.fds[1], SHUT_RDWR);
+  });
+  EXPECT_THROW(
+      adverbs::send_handover(sockets.fds[0], message),
+      std::runtime_error);
+  receiver.get();
+  ::close(pipe_fds[0]);
+  ::close(pipe_fds[1]);
+}
+
+TEST(handover, mapped_region_at_original_address) {
+  int memfd = memfd_create("handover_test", 0);
+  ASSERT_EQ(0, ftruncate(memfd, 8192));
+  void* original =
+      mmap(nullptr, 8192, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+  ASSERT_NE(MAP_FAILED, original);
+  std::strcpy(static_cast<char*>(original), "registered");
+
+  // The address is still taken by the original mapping.
+  int dup_fd = dup(memfd);
+  EXPECT_THROW(
+      adverbs::mapped_region({dup_fd, (uint64_t)(uintptr_t)original, 8192}),
+      std::runtime_error);
+
+  munmap(original, 8192);
+  {
+    adverbs::mapped_region region(
+        {memfd, (uint64_t)(uintptr_t)original, 8192});
+    EXPECT_EQ(original, region.data());
+    EXPECT_STREQ("registered", static_cast<char*>(region.data()));
+  }
+}
+
+TEST(handover, failed_import_closes_fds) {
+  auto is_open = [](int fd) { return fcntl(fd, F_GETFD) != -1; };
+  int memfd = memfd_create("handover_test", 0);
+  ASSERT_EQ(0, ftruncate(memfd, 4096));
+  void* taken =
+      mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+  ASSERT_NE(MAP_FAILED, taken);
+  int pipe_fds[2];
+  ASSERT_EQ(0, pipe(pipe_fds));
+  ::close(pipe_fds[1]);
+  socket_pair sockets;
+
+  // The first region's address is taken: the second is never mapped.
+  adverbs::handover_message message;
+  message.cmd_fd = pipe_fds[0];
+  message.regions.push_back({dup(memfd), (uint64_t)(uintptr_t)taken, 4096});
+  message.regions.push_back({dup(memfd), 0, 4096});
+  std::vector<int> fds = {
+      message.cmd_fd,
+      message.regions[0].fd,
+      message.regions[1].fd};
+  EXPECT_THROW(
+      adverbs::import_handover(sockets.fds[0], message),
+      std::runtime_error);
+  for (int fd : fds) EXPECT_FALSE(is_open(fd)) << fd;
+
+  // The regions map, but the cmd_fd isn't a device's.
+  munmap(taken, 4096);
+  ASSERT_EQ(0, pipe(pipe_fds));
+  ::close(pipe_fds[1]);
+  message.cmd_fd = pipe_fds[0];
+  message.regions = {{dup(memfd), (uint64_t)(uintptr_t)taken, 4096}};
+  fds = {message.cmd_fd, message.regions[0].fd};
+  EXPECT_THROW(
+      adverbs::import_handover(sockets.fds[0], message),
+      std::runtime_error);
+  for (int fd : fds) EXPECT_FALSE(is_open(fd)) << fd;
+  ::close(memfd);
+}
+
+TEST(handover, listen_and_connect) {
+  std::string path = "/tmp/adverbs_handover_test." + std::to_string(getpid());
+  int listener = adverbs::handover_listen(path);
+  int client = adverbs::handover_connect(path);
+  int server = accept(listener, nullptr, nullptr);
+  ASSERT_GE(server, 0);
+  ASSERT_EQ(1, write(client, "y", 1));
+  char c;
+  ASSERT_EQ(1, read(server, &c, 1));
+  EXPECT_EQ('y', c);
+  ::close(server);
+  ::close(client);
+  ::close(listener);
+  unlink(path.c_str());
+
+  EXPECT_THROW(adverbs::handover_connect(path), std::runtime_error);
+}
@@ -0,0 +1,63 @@
+#include "idle_strategy.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+TEST(pause_backoff, doubles_up_to_max) {
+  adverbs::pause_backoff backoff(8);
+  EXPECT_EQ(1, backoff.spins());
+  backoff.idle();
+  backoff.idle();
+  EXPECT_EQ(4, backoff.spins());
+  EXPECT_FALSE(backoff.saturated());
+  backoff.idle();
+  backoff.idle();
+  backoff.idle();
+  EXPECT_EQ(8, backoff.spins());
+  EXPECT_TRUE(backoff.saturated());
+  backoff.reset();
+  EXPECT_EQ(1, backoff.spins());
+}
+
+TEST(idle_strategy, mode_follows_cpu_support) {
+  adverbs::idle_strategy idle;
+  EXPECT_EQ(
+      adverbs::cpu_has_waitpkg() ? adverbs::idle_mode::waitpkg
+                                 : adverbs::idle_mode::pause,
+      idle.mode());
+
+  adverbs::idle_strategy pause_only({.use_waitpkg = false});
+  EXPECT_EQ(adverbs::idle_mode::pause, pause_only.mode());
+}
+
+TEST(idle_strategy, sleeps_are_bounded) {
+  adverbs::idle_strategy idle({.max_spins = 4, .max_wait_cycles = 1000});
+  uint64_t flag = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 1000; ++i) {
+    idle.idle();
+    idle.idle(&flag, [&]() { return flag != 0; });
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_LT(elapsed, std::chrono::seconds(1));
+}
+
+TEST(idle_strategy, wakes_on_write) {
+  adverbs::idle_strategy idle({.max_spins = 2});
+  alignas(64) std::atomic<uint64_t> flag = 0;
+
+  std::thread writer([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    flag.store(1, std::memory_order_release);
+  });
+  while (flag.load(std::memory_order_acquire) == 0) {
+    idle.idle(&flag, [&]() { return flag.load() != 0; });
+  }
+  idle.reset();
+  writer.join();
+  EXPECT_EQ(1, flag.load());
+}
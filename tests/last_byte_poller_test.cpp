@@ -0,0 +1,130 @@
+#include "last_byte_poller.h"
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+struct aligned_ring {
+  aligned_ring(size_t slot_size, size_t num_slots)
+      : slot_size(slot_size),
+        num_slots(num_slots),
+        memory(
+            static_cast<std::byte*>(
+                std::aligned_alloc(64, slot_size * num_slots)),
+            std::free) {
+    std::memset(memory.get(), 0, slot_size * num_slots);
+  }
+
+  // Simulates the RDMA WRITE of message n into the ring.
+  void deliver(uint64_t n, const std::string& payload) {
+    std::vector<std::byte> staging(slot_size);
+    auto extent = adverbs::last_byte_poller::encode(
+        staging,
+        std::as_bytes(std::span(payload)),
+        n + 1);
+    size_t offset = extent.data() - staging.data();
+    std::memcpy(
+        memory.get() + (n % num_slots) * slot_size + offset,
+        extent.data(),
+        extent.size());
+  }
+
+  size_t slot_size;
+  size_t num_slots;
+  std::unique_ptr<std::byte, decltype(&std::free)> memory;
+};
+
+std::string as_string(const adverbs::last_byte_poller::message& msg) {
+  return {reinterpret_cast<const char*>(msg.data), msg.length};
+}
+
+}  // namespace
+
+TEST(last_byte_poller, rejects_bad_geometry) {
+  aligned_ring ring(128, 4);
+  EXPECT_THROW(
+      adverbs::last_byte_poller(ring.memory.get() + 8, 128, 4),
+      std::invalid_argument);
+  EXPECT_THROW(
+      adverbs::last_byte_poller(ring.memory.get(), 100, 4),
+      std::invalid_argument);
+  EXPECT_THROW(
+      adverbs::last_byte_poller(ring.memory.get(), 128, 0),
+      std::invalid_argument);
+
+  std::vector<std::byte> slot(64);
+  std::vector<std::byte> payload(64);
+  EXPECT_THROW(
+      adverbs::last_byte_poller::encode(slot, payload, 1),
+      std::invalid_argument);
+}
+
+TEST(last_byte_poller, poll_and_release) {
+  aligned_ring ring(128, 4);
+  adverbs::last_byte_poller rx(ring.memory.get(), 128, 4);
+
+  adverbs::last_byte_poller::message msg{};
+  EXPECT_FALSE(rx.poll(msg));
+
+  ring.deliver(0, "hello");
+  ASSERT_TRUE(rx.poll(msg));
+  EXPECT_EQ("hello", as_string(msg));
+  EXPECT_EQ(1, msg.seq);
+
+  // Until released, the head does not move.
+  ASSERT_TRUE(rx.poll(msg));
+  rx.release();
+  EXPECT_FALSE(rx.poll(msg));
+
+  ring.deliver(1, "");
+  msg = rx.wait();
+  EXPECT_EQ(0, msg.length);
+  rx.release();
+  EXPECT_EQ(2, rx.head());
+}
+
+TEST(last_byte_poller, stale_lap_is_not_ready) {
+  aligned_ring ring(64, 2);
+  adverbs::last_byte_poller rx(ring.memory.get(), 64, 2);
+
+  ring.deliver(0, "a");
+  ring.deliver(1, "b");
+  EXPECT_EQ(2, rx.scan(16));
+  rx.release(2);
+
+  // Slot 0 still holds message 0, which must not be mistaken for message 2.
+  adverbs::last_byte_poller::message msg{};
+  EXPECT_FALSE(rx.poll(msg));
+  ring.deliver(2, "c");
+  ASSERT_TRUE(rx.poll(msg));
+  EXPECT_EQ("c", as_string(msg));
+}
+
+TEST(last_byte_poller, scan_counts_ready_prefix) {
+  aligned_ring ring(64, 32);
+  adverbs::last_byte_poller rx(ring.memory.get(), 64, 32);
+
+  EXPECT_EQ(0, rx.scan(32));
+
+  for (uint64_t n = 0; n < 11; ++n) {
+    ring.deliver(n, std::to_string(n));
+  }
+  // A gap at 11 hides the later message.
+  ring.deliver(12, "12");
+
+  size_t ready = rx.scan(32);
+  ASSERT_EQ(11, ready);
+  for (size_t i = 0; i < ready; ++i) {
+    EXPECT_EQ(std::to_string(i), as_string(rx.peek(i)));
+  }
+  EXPECT_EQ(5, rx.scan(5));
+
+  rx.release(ready);
+  EXPECT_EQ(0, rx.scan(32));
+  ring.deliver(11, "11");
+  EXPECT_EQ(2, rx.scan(32));
+}
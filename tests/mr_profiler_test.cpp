@@ -0,0 +1,155 @@
+#include "mr_profiler.h"
+
+#include <infiniband/verbs.h>
+
+#include <sstream>
+
+#include "fake_verbs.h"
+#include "gtest/gtest.h"
+#include "wr_template.h"
+
+namespace {
+
+struct ibv_context device_a;
+struct ibv_context device_b;
+
+void register_from_a(
+    uint32_t lkey,
+    size_t length,
+    const struct ibv_context* context = &device_a) {
+  adverbs::mr_profiler::track(
+      context,
+      nullptr,
+      length,
+      IBV_ACCESS_LOCAL_WRITE,
+      lkey,
+      lkey + 1000);
+}
+
+void __attribute__((noinline)) register_from_b(uint32_t lkey, size_t length) {
+  adverbs::mr_profiler::track(
+      &device_a,
+      nullptr,
+      length,
+      IBV_ACCESS_REMOTE_READ,
+      lkey,
+      lkey + 1000);
+}
+
+}  // namespace
+
+TEST(mr_profiler, disabled_records_nothing) {
+  adverbs::mr_profiler::disable();
+  register_from_a(1, 4096);
+  EXPECT_TRUE(adverbs::mr_profiler::live().empty());
+}
+
+TEST(mr_profiler, tracks_live_registrations) {
+  adverbs::mr_profiler::enable();
+  register_from_a(1, 4096);
+  register_from_a(2, 4096);
+  register_from_b(3, 1 << 20);
+
+  auto live = adverbs::mr_profiler::live();
+  ASSERT_EQ(3, live.size());
+  EXPECT_EQ(1, live[0].lkey);
+  EXPECT_EQ(1001, live[0].rkey);
+  EXPECT_EQ(IBV_ACCESS_LOCAL_WRITE, live[0].access);
+
+  adverbs::mr_profiler::untrack(&device_a, 2);
+  EXPECT_EQ(2, adverbs::mr_profiler::live().size());
+
+  adverbs::mr_profiler::disable();
+  EXPECT_TRUE(adverbs::mr_profiler::live().empty());
+}
+
+TEST(mr_profiler, lkeys_are_per_device) {
+  adverbs::mr_profiler::enable();
+  register_from_a(1, 100, &device_a);
+  register_from_a(1, 200, &device_b);
+  ASSERT_EQ(2, adverbs::mr_profiler::live().size());
+
+  adverbs::mr_profiler::note_use(&device_b, 1);
+  auto unused = adverbs::mr_profiler::never_used();
+  ASSERT_EQ(1, unused.size());
+  EXPECT_EQ(&device_a, unused[0].context);
+
+  adverbs::mr_profiler::untrack(&device_a, 1);
+  auto live = adverbs::mr_profiler::live();
+  ASSERT_EQ(1, live.size());
+  EXPECT_EQ(&device_b, live[0].context);
+  EXPECT_EQ(200, live[0].length);
+  adverbs::mr_profiler::disable();
+}
+
+TEST(mr_profiler, pinned_by_callsite) {
+  adverbs::mr_profiler::enable();
+  for (uint32_t lkey = 1; lkey <= 4; ++lkey) register_from_a(lkey, 100);
+  register_from_b(10, 1000);
+
+  auto usage = adverbs::mr_profiler::pinned_by_callsite();
+  ASSERT_EQ(2, usage.size());
+  EXPECT_EQ(1000, usage[0].pinned_bytes);
+  EXPECT_EQ(1, usage[0].registrations);
+  EXPECT_EQ(400, usage[1].pinned_bytes);
+  EXPECT_EQ(4, usage[1].registrations);
+  EXPECT_FALSE(usage[0].frames.empty());
+  adverbs::mr_profiler::disable();
+}
+
+TEST(mr_profiler, never_used_and_long_lived) {
+  adverbs::mr_profiler::enable();
+  register_from_a(1, 100);
+  register_from_a(2, 100);
+  adverbs::mr_profiler::note_use(&device_a, 2);
+  adverbs::mr_profiler::note_use(&device_a, 99);
+  adverbs::mr_profiler::note_use(&device_b, 1);
+
+  auto unused = adverbs::mr_profiler::never_used();
+  ASSERT_EQ(1, unused.size());
+  EXPECT_EQ(1, unused[0].lkey);
+
+  EXPECT_EQ(2, adverbs::mr_profiler::long_lived({}).size());
+  EXPECT_TRUE(adverbs::mr_profiler::long_lived(std::chrono::hours(1)).empty());
+
+  std::stringstream report;
+  adverbs::mr_profiler::report(report, {});
+  EXPECT_NE(
+      std::string::npos,
+      report.str().find("2 live registrations, 200 bytes pinned"));
+  EXPECT_NE(std::string::npos, report.str().find("lkey 1: 100 bytes"));
+  EXPECT_NE(std::string::npos, report.str().find("access 0x1,"));
+  adverbs::mr_profiler::disable();
+}
+
+TEST(mr_profiler, unknown_access) {
+  adverbs::mr_profiler::enable();
+  adverbs::mr_profiler::track(&device_a, nullptr, 100, -1, 1, 2);
+  std::stringstream report;
+  adverbs::mr_profiler::report(report, {});
+  EXPECT_NE(std::string::npos, report.str().find("access unknown,"));
+  adverbs::mr_profiler::disable();
+}
+
+TEST(mr_profiler, posting_helpers_note_use) {
+  adverbs_test::fake_verbs fake;
+  adverbs::mr_profiler::enable();
+  char local[64];
+  for (uint32_t lkey : {5, 7}) {
+    adverbs::mr_profiler::track(
+        &fake.context,
+        local,
+        sizeof(local),
+        IBV_ACCESS_LOCAL_WRITE,
+        lkey,
+        lkey + 1000);
+  }
+
+  adverbs::send_template write(
+      fake.make_qp(1), IBV_WR_RDMA_WRITE, local, 5, 0x10000, 22);
+  write.post(1, 0, 0, sizeof(local));
+  auto unused = adverbs::mr_profiler::never_used();
+  ASSERT_EQ(1, unused.size());
+  EXPECT_EQ(7, unused[0].lkey);
+  adverbs::mr_profiler::disable();
+}
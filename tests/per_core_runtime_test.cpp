@@ -0,0 +1,97 @@
+#include "per_core_runtime.h"
+
+#include <infiniband/verbs.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "adverbs.h"
+#include "gtest/gtest.h"
+
+TEST(per_core_runtime, shard_for_key_is_balanced) {
+  constexpr size_t shards = 8;
+  std::vector<int> counts(shards);
+  for (uint64_t key = 0; key < 80000; ++key) {
+    unsigned shard = adverbs::shard_for_key(key, shards);
+    ASSERT_LT(shard, shards);
+    ++counts[shard];
+  }
+  for (int count : counts) {
+    EXPECT_GT(count, 9000);
+    EXPECT_LT(count, 11000);
+  }
+  EXPECT_EQ(0, adverbs::shard_for_key(12345, 1));
+}
+
+TEST(per_core_runtime, mesh_routes_by_pair) {
+  adverbs::core_mesh mesh(3, 4);
+
+  EXPECT_TRUE(mesh.send(0, 2, {.kind = 1, .arg = 10}));
+  EXPECT_TRUE(mesh.send(1, 2, {.kind = 2, .arg = 20}));
+  EXPECT_TRUE(mesh.send(2, 0, {.kind = 3, .arg = 30}));
+
+  std::vector<adverbs::core_message> received;
+  auto collect = [&](const adverbs::core_message& msg) {
+    received.push_back(msg);
+  };
+
+  EXPECT_EQ(0, mesh.drain(1, collect));
+  EXPECT_EQ(2, mesh.drain(2, collect));
+  ASSERT_EQ(2, received.size());
+  EXPECT_EQ(0, received[0].source);
+  EXPECT_EQ(10, received[0].arg);
+  EXPECT_EQ(1, received[1].source);
+  EXPECT_EQ(20, received[1].arg);
+
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(mesh.send(1, 0, {}));
+  }
+  EXPECT_FALSE(mesh.send(1, 0, {}));
+
+  received.clear();
+  EXPECT_EQ(3, mesh.drain(0, collect, 3));
+  EXPECT_EQ(2, mesh.drain(0, collect));
+}
+
+TEST(per_core_runtime, mesh_drain_resumes_after_last_source) {
+  adverbs::core_mesh mesh(3, 8);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(mesh.send(1, 0, {}));
+    EXPECT_TRUE(mesh.send(2, 0, {}));
+  }
+
+  std::vector<uint32_t> sources;
+  auto collect = [&](const adverbs::core_message& msg) {
+    sources.push_back(msg.source);
+  };
+  while (mesh.drain(0, collect, 2)) {
+  }
+  EXPECT_EQ(sources, (std::vector<uint32_t>{1, 1, 2, 2, 1, 1, 2, 2}));
+}
+
+TEST(per_core_runtime, shards) {
+  adverbs::scoped_device_list device_list;
+
+  for (auto& dev : device_list) {
+    adverbs::per_core_runtime runtime(dev, {.cpus = {0}, .cq_depth = 16});
+    ASSERT_EQ(1, runtime.size());
+    EXPECT_EQ(0, runtime.shard_for(42));
+
+    std::atomic<int> delivered = 0;
+    runtime.start(
+        [](adverbs::core_shard& shard) {
+          struct ibv_wc wc[4];
+          return ibv_poll_cq(shard.cq().get(), 4, wc);
+        },
+        [&](adverbs::core_shard&, const adverbs::core_message&) {
+          ++delivered;
+        });
+    runtime.stop();
+
+    // A failed poll stops the shard and is reported by stop().
+    runtime.start([](adverbs::core_shard&) { return -1; }, nullptr);
+    EXPECT_THROW(runtime.stop(), std::runtime_error);
+    runtime.stop();
+  }
+}
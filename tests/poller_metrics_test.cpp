@@ -0,0 +1,96 @@
+#include "poller_metrics.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+TEST(poller_metrics, buckets) {
+  EXPECT_EQ(0, adverbs::poller_metrics::bucket(0));
+  EXPECT_EQ(1, adverbs::poller_metrics::bucket(1));
+  EXPECT_EQ(2, adverbs::poller_metrics::bucket(2));
+  EXPECT_EQ(2, adverbs::poller_metrics::bucket(3));
+  EXPECT_EQ(11, adverbs::poller_metrics::bucket(1024));
+  EXPECT_EQ(63, adverbs::poller_metrics::bucket(UINT64_MAX));
+}
+
+TEST(poller_metrics, utilization) {
+  adverbs::poller_metrics metrics;
+  EXPECT_EQ(0.0, metrics.snapshot().empty_fraction());
+
+  metrics.record_poll(0);
+  metrics.record_poll(0);
+  metrics.record_poll(0);
+  metrics.record_poll(4);
+  metrics.record_poll(8);
+  metrics.record_iteration(100);
+  metrics.record_iteration(100);
+  metrics.record_iteration(800);
+  metrics.record_callback(250);
+
+  auto s = metrics.snapshot();
+  EXPECT_EQ(5, s.polls);
+  EXPECT_EQ(3, s.empty_polls);
+  EXPECT_EQ(2, s.productive_polls());
+  EXPECT_DOUBLE_EQ(0.6, s.empty_fraction());
+  EXPECT_DOUBLE_EQ(6.0, s.completions_per_productive_poll());
+  EXPECT_DOUBLE_EQ(0.25, s.callback_fraction());
+
+  EXPECT_EQ(128, s.iteration_quantile_ns(0.5));
+  EXPECT_EQ(1024, s.iteration_quantile_ns(1.0));
+}
+
+TEST(poller_metrics, scoped_timers) {
+  adverbs::poller_metrics metrics;
+  {
+    auto iteration = metrics.time_iteration();
+    auto callback = metrics.time_callback();
+  }
+  auto s = metrics.snapshot();
+  EXPECT_EQ(1, s.iterations);
+  EXPECT_EQ(1, s.callbacks);
+  EXPECT_LE(s.callback_ns, s.loop_ns);
+}
+
+TEST(poller_metrics, counters) {
+  adverbs::poller_metrics metrics;
+  metrics.record_poll(0);
+  metrics.record_poll(3);
+  metrics.record_iteration(5);
+  metrics.record_iteration(6);
+  metrics.record_iteration(100);
+
+  std::map<std::string, uint64_t> counters;
+  for (const auto& [name, value] : metrics.snapshot().counters()) {
+    counters[name] = value;
+  }
+  EXPECT_EQ(2, counters["polls_total"]);
+  EXPECT_EQ(1, counters["empty_polls_total"]);
+  EXPECT_EQ(3, counters["completions_total"]);
+  EXPECT_EQ(0, counters["iteration_ns_bucket{le=\"0\"}"]);
+  EXPECT_EQ(0, counters["iteration_ns_bucket{le=\"3\"}"]);
+  EXPECT_EQ(2, counters["iteration_ns_bucket{le=\"7\"}"]);
+  EXPECT_EQ(2, counters["iteration_ns_bucket{le=\"63\"}"]);
+  EXPECT_EQ(3, counters["iteration_ns_bucket{le=\"127\"}"]);
+  EXPECT_EQ(3, counters["iteration_ns_bucket{le=\"+Inf\"}"]);
+  EXPECT_EQ(111, counters["iteration_ns_sum"]);
+  EXPECT_EQ(3, counters["iteration_ns_count"]);
+
+  // Every bucket is present, in order, and never decreases.
+  std::vector<uint64_t> buckets;
+  for (const auto& [name, value] : metrics.snapshot().counters()) {
+    if (name.starts_with("iteration_ns_bucket")) buckets.push_back(value);
+  }
+  ASSERT_EQ(adverbs::poller_metrics_snapshot::num_buckets, buckets.size());
+  EXPECT_TRUE(std::is_sorted(buckets.begin(), buckets.end()));
+
+  // A duration of exactly 2^i ns is above the le="2^i - 1" bucket.
+  metrics.record_iteration(8);
+  counters.clear();
+  for (const auto& [name, value] : metrics.snapshot().counters()) {
+    counters[name] = value;
+  }
+  EXPECT_EQ(2, counters["iteration_ns_bucket{le=\"7\"}"]);
+  EXPECT_EQ(3, counters["iteration_ns_bucket{le=\"15\"}"]);
+}
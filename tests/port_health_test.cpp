@@ -0,0 +1,159 @@
+#include "port_health.h"
+
+#include <stdlib.h>
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+adverbs::port_counters with_symbol_errors(uint64_t n) {
+  adverbs::port_counters c;
+  c.symbol_error = n;
+  return c;
+}
+
+TEST(port_health, first_sample_is_a_baseline) {
+  adverbs::port_health_monitor monitor;
+  monitor.add_port("unused");
+  monitor.update(0, with_symbol_errors(1000), 1);
+  EXPECT_EQ(monitor.health(0).state, adverbs::link_state::healthy);
+  EXPECT_EQ(monitor.health(0).score, 1);
+  monitor.update(0, with_symbol_errors(1000), 1);
+  EXPECT_EQ(monitor.health(0).fast_rate, 0);
+  EXPECT_EQ(monitor.health(0).samples, 2u);
+  EXPECT_THROW(monitor.update(1, {}, 1), std::out_of_range);
+}
+
+TEST(port_health, detects_climbing_errors_early) {
+  adverbs::port_health_monitor monitor;
+  monitor.add_port("unused");
+  uint64_t errors = 0;
+  // A long clean run with the odd error sets a low slow rate.
+  for (int i = 0; i < 100; ++i) {
+    if (i % 50 == 0) ++errors;
+    monitor.update(0, with_symbol_errors(errors), 1);
+  }
+  EXPECT_EQ(monitor.health(0).state, adverbs::link_state::healthy);
+
+  // Two errors a second in a row: below degrade_rate for the first
+  // samples, but well above the long-run rate.
+  errors += 2;
+  monitor.update(0, with_symbol_errors(errors), 1);
+  const auto& h = monitor.health(0);
+  EXPECT_LT(h.fast_rate, 1);
+  EXPECT_EQ(h.state, adverbs::link_state::degrading);
+  EXPECT_LT(h.score, 1);
+
+  // Errors stop; the port recovers.
+  for (int i = 0; i < 20; ++i) monitor.update(0, with_symbol_errors(errors), 1);
+  EXPECT_EQ(monitor.health(0).state, adverbs::link_state::healthy);
+  EXPECT_GT(monitor.health(0).score, 0.9);
+}
+
+TEST(port_health, link_down_is_failing) {
+  adverbs::port_health_monitor monitor;
+  monitor.add_port("unused");
+  adverbs::port_counters c;
+  monitor.update(0, c, 1);
+  monitor.update(0, c, 1);
+  c.link_downed = 1;
+  monitor.update(0, c, 1);
+  EXPECT_EQ(monitor.health(0).state, adverbs::link_state::failing);
+  EXPECT_STREQ(adverbs::link_state_name(monitor.health(0).state), "failing");
+}
+
+TEST(port_health, counter_reset_is_not_an_error) {
+  adverbs::port_health_monitor monitor;
+  monitor.add_port("unused");
+  monitor.update(0, with_symbol_errors(5000), 1);
+  monitor.update(0, with_symbol_errors(0), 1);
+  EXPECT_EQ(monitor.health(0).fast_rate, 0);
+  EXPECT_EQ(monitor.health(0).state, adverbs::link_state::healthy);
+}
+
+TEST(port_health, saturated_counter_is_degrading) {
+  adverbs::port_health_monitor monitor;
+  monitor.add_port("unused");
+  adverbs::port_counters c;
+  c.local_link_integrity_errors = 14;
+  monitor.update(0, c, 1);
+  monitor.update(0, c, 1);
+  EXPECT_EQ(monitor.health(0).state, adverbs::link_state::healthy);
+
+  // Pinned at 4 bits: further errors are invisible.
+  c.local_link_integrity_errors = 15;
+  for (int i = 0; i < 20; ++i) monitor.update(0, c, 1);
+  EXPECT_TRUE(monitor.health(0).saturated);
+  EXPECT_EQ(monitor.health(0).state, adverbs::link_state::degrading);
+  EXPECT_LE(monitor.health(0).score, 0.5);
+
+  // Cleared counters read as a reset, and the port recovers.
+  c.local_link_integrity_errors = 0;
+  for (int i = 0; i < 20; ++i) monitor.update(0, c, 1);
+  EXPECT_FALSE(monitor.health(0).saturated);
+  EXPECT_EQ(monitor.health(0).state, adverbs::link_state::healthy);
+
+  adverbs::port_health_monitor fresh;
+  fresh.add_port("unused");
+  c.link_downed = 255;
+  fresh.update(0, c, 1);
+  EXPECT_EQ(fresh.health(0).state, adverbs::link_state::degrading);
+}
+
+TEST(port_health, steers_traffic_off_degrading_ports) {
+  adverbs::port_health_monitor monitor;
+  for (int i = 0; i < 3; ++i) monitor.add_port("unused");
+  for (size_t p = 0; p < 3; ++p) monitor.update(p, {}, 1);
+  monitor.update(0, with_symbol_errors(10), 1);
+  monitor.update(1, {}, 1);
+  monitor.update(2, {}, 1);
+
+  EXPECT_EQ(monitor.health(0).state, adverbs::link_state::degrading);
+  EXPECT_EQ(monitor.best_port(), 1u);
+  auto weights = monitor.traffic_weights();
+  EXPECT_EQ(weights[0], 0);
+  EXPECT_DOUBLE_EQ(weights[1], 0.5);
+  EXPECT_DOUBLE_EQ(weights[2], 0.5);
+
+  // With every port degrading, traffic follows the scores.
+  monitor.update(1, with_symbol_errors(2), 1);
+  monitor.update(2, with_symbol_errors(4), 1);
+  weights = monitor.traffic_weights();
+  EXPECT_EQ(monitor.best_port(), 1u);
+  EXPECT_GT(weights[1], weights[2]);
+  EXPECT_GT(weights[2], weights[0]);
+  EXPECT_DOUBLE_EQ(weights[0] + weights[1] + weights[2], 1);
+}
+
+TEST(port_health, samples_sysfs_counters) {
+  std::string pattern = (fs::temp_directory_path() / "countersXXXXXX").string();
+  fs::path root = mkdtemp(pattern.data());
+  fs::path dir = adverbs::port_counters::path(root.string(), 1);
+  EXPECT_EQ(dir, root / "ports/1/counters");
+  fs::create_directories(dir);
+  auto write = [&](const char* name, int value) {
+    std::ofstream(dir / name) << value << "\n";
+  };
+  write("symbol_error", 3);
+  write("link_downed", 0);
+
+  adverbs::port_health_monitor monitor;
+  monitor.add_port(dir.string());
+  monitor.sample();
+  EXPECT_EQ(monitor.health(0).last.symbol_error, 3u);
+  EXPECT_EQ(monitor.health(0).last.port_rcv_errors, 0u);
+
+  write("link_downed", 1);
+  monitor.sample();
+  EXPECT_EQ(monitor.health(0).state, adverbs::link_state::failing);
+  fs::remove_all(root);
+}
+
+}  // namespace
@@ -0,0 +1,57 @@
+#include "prefault.h"
+
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "adverbs.h"
+#include "gtest/gtest.h"
+
+TEST(prefault, parse_cpu_list) {
+  EXPECT_EQ(adverbs::parse_cpu_list("0-3,8,10-11\n"),
+            (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_EQ(adverbs::parse_cpu_list("5"), (std::vector<int>{5}));
+  EXPECT_TRUE(adverbs::parse_cpu_list("").empty());
+  EXPECT_THROW(adverbs::parse_cpu_list("3-1"), std::invalid_argument);
+  EXPECT_THROW(adverbs::parse_cpu_list("a-b"), std::invalid_argument);
+}
+
+TEST(prefault, keeps_contents) {
+  // Deliberately unaligned at both ends.
+  size_t length = 3 * 4096 * 7 + 123;
+  auto memory = std::make_unique<unsigned char[]>(length + 11);
+  unsigned char* data = memory.get() + 11;
+  for (size_t i = 0; i < length; ++i) data[i] = (unsigned char)(i * 31);
+
+  adverbs::prefault(data, length, {.threads = 4});
+
+  for (size_t i = 0; i < length; ++i) {
+    ASSERT_EQ(data[i], (unsigned char)(i * 31)) << i;
+  }
+}
+
+TEST(prefault, prefaulted_buffer) {
+  for (bool populate : {false, true}) {
+    adverbs::prefaulted_buffer buffer(1 << 20, {.threads = 2}, populate);
+    ASSERT_NE(buffer.data(), nullptr);
+    EXPECT_EQ(buffer.length(), 1u << 20);
+    // Anonymous mappings start zeroed, and stay so after prefaulting.
+    auto* bytes = static_cast<unsigned char*>(buffer.data());
+    EXPECT_EQ(bytes[0], 0);
+    EXPECT_EQ(bytes[(1 << 20) - 1], 0);
+    std::memset(buffer.data(), 0xab, buffer.length());
+  }
+}
+
+TEST(prefault, device_numa_node) {
+  adverbs::scoped_device_list device_list;
+
+  for (auto& dev : device_list) {
+    int node = adverbs::device_numa_node(dev);
+    EXPECT_GE(node, -1);
+    if (node >= 0) {
+      EXPECT_FALSE(adverbs::numa_node_cpus(node).empty());
+    }
+  }
+}
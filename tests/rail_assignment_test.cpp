@@ -0,0 +1,168 @@
+#include "rail_assignment.h"
+
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// A scratch directory, removed with its contents.
+struct temp_dir {
+  fs::path path;
+
+  temp_dir() {
+    std::string pattern = (fs::temp_directory_path() / "railsXXXXXX").string();
+    path = mkdtemp(pattern.data());
+  }
+
+  ~temp_dir() {
+    fs::remove_all(path);
+  }
+};
+
+void write_file(const fs::path& path, const std::string& contents) {
+  fs::create_directories(path.parent_path());
+  std::ofstream(path) << contents;
+}
+
+// Two sockets with four single-port NICs each.
+std::vector<adverbs::nic_rail> two_socket_rails() {
+  std::vector<adverbs::nic_rail> rails;
+  for (int i = 0; i < 8; ++i) {
+    rails.push_back({"mlx5_" + std::to_string(i), 1, i / 4});
+  }
+  return rails;
+}
+
+TEST(rail_assignment, choose_rail_spreads_then_localizes) {
+  auto rails = two_socket_rails();
+  std::vector<uint32_t> load(rails.size());
+
+  // Eight ranks, alternating sockets: each gets its own local NIC.
+  for (int rank = 0; rank < 8; ++rank) {
+    int node = rank % 2;
+    size_t i = adverbs::choose_rail(rails, load, node);
+    EXPECT_EQ(load[i], 0u) << rank;
+    EXPECT_EQ(rails[i].numa_node, node) << rank;
+    load[i]++;
+  }
+  // A ninth shares a NIC on its own socket.
+  size_t i = adverbs::choose_rail(rails, load, 1);
+  EXPECT_EQ(rails[i].numa_node, 1);
+}
+
+TEST(rail_assignment, choose_rail_prefers_spreading_to_locality) {
+  auto rails = two_socket_rails();
+  std::vector<uint32_t> load = {1, 1, 1, 1, 0, 0, 0, 0};
+  EXPECT_EQ(adverbs::choose_rail(rails, load, 0), 4u);
+  // Without a preference, the lowest index among the least loaded.
+  load = {1, 0, 0, 1, 1, 1, 1, 1};
+  EXPECT_EQ(adverbs::choose_rail(rails, load, -1), 1u);
+
+  EXPECT_THROW(adverbs::choose_rail({}, {}, 0), std::invalid_argument);
+  EXPECT_THROW(
+      adverbs::choose_rail(rails, std::vector<uint32_t>(3), 0),
+      std::invalid_argument);
+}
+
+TEST(rail_assignment, discover_rails_from_sysfs) {
+  temp_dir sysfs;
+  write_file(sysfs.path / "mlx5_0/device/numa_node", "1\n");
+  write_file(sysfs.path / "mlx5_0/ports/1/state", "4: ACTIVE\n");
+  write_file(sysfs.path / "mlx5_0/ports/2/state", "1: DOWN\n");
+  write_file(sysfs.path / "mlx5_1/device/numa_node", "-1\n");
+  write_file(sysfs.path / "mlx5_1/ports/2/state", "4: ACTIVE\n");
+  write_file(sysfs.path / "mlx5_1/ports/1/state", "4: ACTIVE\n");
+
+  auto rails = adverbs::discover_rails(std::vector<std::string>{
+      (sysfs.path / "mlx5_0").string(),
+      (sysfs.path / "mlx5_1").string(),
+      (sysfs.path / "missing").string()});
+  ASSERT_EQ(rails.size(), 3u);
+  EXPECT_EQ(rails[0].device, "mlx5_0");
+  EXPECT_EQ(rails[0].port, 1);
+  EXPECT_EQ(rails[0].numa_node, 1);
+  EXPECT_EQ(rails[1].device, "mlx5_1");
+  EXPECT_EQ(rails[1].port, 1);
+  EXPECT_EQ(rails[1].numa_node, -1);
+  EXPECT_EQ(rails[2].port, 2);
+}
+
+TEST(rail_assignment, leases_are_distinct_and_released) {
+  temp_dir dir;
+  std::string table = (dir.path / "job.rails").string();
+  auto rails = two_socket_rails();
+  rails.resize(2);
+
+  {
+    adverbs::rail_lease a(table, rails, 0);
+    adverbs::rail_lease b(table, rails, 0);
+    EXPECT_NE(a.index(), b.index());
+    adverbs::rail_lease moved(std::move(a));
+    adverbs::rail_lease c(table, rails, 0);
+    EXPECT_EQ(c.rail().device, rails[0].device);
+  }
+  // All released: the first rail is free again.
+  adverbs::rail_lease d(table, rails, 0);
+  EXPECT_EQ(d.index(), 0u);
+}
+
+TEST(rail_assignment, lease_numa_preference) {
+  temp_dir dir;
+  int here = adverbs::current_numa_node();
+  std::vector<adverbs::nic_rail> rails = {
+      {"mlx5_0", 1, here + 1},
+      {"mlx5_1", 1, here}};
+
+  // -1 prefers nothing: the lowest index.
+  {
+    adverbs::rail_lease lease((dir.path / "a.rails").string(), rails, -1);
+    EXPECT_EQ(lease.index(), 0u);
+  }
+  adverbs::rail_lease lease((dir.path / "b.rails").string(), rails);
+  EXPECT_EQ(lease.index(), here >= 0 ? 1u : 0u);
+}
+
+TEST(rail_assignment, dead_claims_are_dropped) {
+  temp_dir dir;
+  std::string table = (dir.path / "job.rails").string();
+  auto rails = two_socket_rails();
+  rails.resize(2);
+
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    // Claim rail 0 and die holding it.
+    adverbs::rail_lease lease(table, rails, 0);
+    _exit(lease.index() == 0 ? 0 : 1);
+  }
+  int status = 0;
+  ASSERT_EQ(waitpid(child, &status, 0), child);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+
+  adverbs::rail_lease lease(table, rails, 0);
+  EXPECT_EQ(lease.index(), 0u);
+}
+
+TEST(rail_assignment, rejects_foreign_files) {
+  temp_dir dir;
+  std::string table = (dir.path / "not_a_table").string();
+  write_file(table, "hello");
+  EXPECT_THROW(
+      adverbs::rail_lease(table, two_socket_rails(), 0),
+      std::runtime_error);
+  EXPECT_THROW(adverbs::rail_lease(table, {}, 0), std::invalid_argument);
+}
+
+}  // namespace
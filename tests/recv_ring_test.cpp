@@ -0,0 +1,136 @@
+#include "recv_ring.h"
+
+#include <infiniband/verbs.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "fake_verbs.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(recv_ring, fill_posts_in_batches) {
+  adverbs_test::fake_verbs fake;
+  std::vector<std::byte> slab(100 * 256);
+  adverbs::recv_ring ring(
+      fake.make_qp(1),
+      slab.data(),
+      slab.size(),
+      7,
+      {.depth = 100, .buffer_size = 256, .batch = 32});
+  ring.fill();
+
+  EXPECT_EQ(fake.post_recv_calls, 4);
+  ASSERT_EQ(fake.recvs.size(), 100u);
+  EXPECT_EQ(ring.posted(), 100u);
+  EXPECT_EQ(ring.pending(), 0u);
+  for (size_t i = 0; i < 100; ++i) {
+    const auto& recv = fake.recvs[i];
+    EXPECT_EQ(recv.wr.wr_id, i);
+    ASSERT_EQ(recv.sges.size(), 1u);
+    EXPECT_EQ(recv.sges[0].addr, (uint64_t)(uintptr_t)(slab.data() + i * 256));
+    EXPECT_EQ(recv.sges[0].length, 256u);
+    EXPECT_EQ(recv.sges[0].lkey, 7u);
+  }
+  EXPECT_EQ(ring.buffer(3).data(), slab.data() + 3 * 256);
+  EXPECT_EQ(ring.buffer(3).size(), 256u);
+
+  // Already full.
+  ring.fill();
+  EXPECT_EQ(fake.post_recv_calls, 4);
+}
+
+TEST(recv_ring, reposts_released_receives_as_one_chain) {
+  adverbs_test::fake_verbs fake;
+  std::vector<std::byte> slab(64 * 64);
+  adverbs::recv_ring ring(
+      fake.make_qp(1),
+      slab.data(),
+      slab.size(),
+      7,
+      {.depth = 64, .buffer_size = 64, .batch = 16});
+  ring.fill();
+  int calls = fake.post_recv_calls;
+  fake.recvs.clear();
+
+  // Completions arrive out of order; 15 releases post nothing.
+  for (uint64_t id = 40; id < 55; ++id) ring.release(id);
+  EXPECT_EQ(fake.post_recv_calls, calls);
+  EXPECT_EQ(ring.pending(), 15u);
+  EXPECT_EQ(ring.posted(), 49u);
+
+  // The 16th reposts all of them in one call, in release order.
+  ring.release(2);
+  EXPECT_EQ(fake.post_recv_calls, calls + 1);
+  ASSERT_EQ(fake.recvs.size(), 16u);
+  EXPECT_EQ(fake.recvs[0].wr.wr_id, 40u);
+  EXPECT_EQ(fake.recvs[15].wr.wr_id, 2u);
+  EXPECT_EQ(
+      fake.recvs[15].sges[0].addr, (uint64_t)(uintptr_t)(slab.data() + 128));
+  EXPECT_EQ(ring.posted(), 64u);
+
+  ring.release(5);
+  ring.flush();
+  EXPECT_EQ(fake.post_recv_calls, calls + 2);
+  EXPECT_EQ(fake.recvs.back().wr.wr_id, 5u);
+  ring.flush();
+  EXPECT_EQ(fake.post_recv_calls, calls + 2);
+}
+
+TEST(recv_ring, rejects_bad_releases) {
+  adverbs_test::fake_verbs fake;
+  std::vector<std::byte> slab(8 * 64);
+  adverbs::recv_ring ring(
+      fake.make_qp(1),
+      slab.data(),
+      slab.size(),
+      7,
+      {.depth = 8, .buffer_size = 64, .batch = 4});
+  EXPECT_THROW(ring.release(0), std::invalid_argument);
+  ring.fill();
+  EXPECT_THROW(ring.release(8), std::out_of_range);
+  ring.release(1);
+  EXPECT_THROW(ring.release(1), std::invalid_argument);
+}
+
+TEST(recv_ring, keeps_unposted_receives_pending) {
+  adverbs_test::fake_verbs fake;
+  std::vector<std::byte> slab(8 * 64);
+  adverbs::recv_ring ring(
+      fake.make_qp(1),
+      slab.data(),
+      slab.size(),
+      7,
+      {.depth = 8, .buffer_size = 64, .batch = 8});
+  fake.fail_recv_at = 5;
+  EXPECT_THROW(ring.fill(), std::runtime_error);
+  EXPECT_EQ(ring.posted(), 5u);
+  EXPECT_EQ(ring.pending(), 3u);
+
+  fake.fail_recv_at = -1;
+  ring.flush();
+  EXPECT_EQ(ring.posted(), 8u);
+  EXPECT_EQ(ring.pending(), 0u);
+  ASSERT_EQ(fake.recvs.size(), 8u);
+  EXPECT_EQ(fake.recvs[5].wr.wr_id, 5u);
+  EXPECT_EQ(fake.recvs[7].wr.wr_id, 7u);
+}
+
+TEST(recv_ring, validates_geometry) {
+  std::vector<std::byte> slab(1024);
+  EXPECT_THROW(
+      adverbs::recv_ring(
+          (ibv_qp*)nullptr,
+          slab.data(),
+          slab.size(),
+          0,
+          {.depth = 8, .buffer_size = 256}),
+      std::invalid_argument);
+  EXPECT_THROW(
+      adverbs::recv_ring(
+          (ibv_qp*)nullptr, slab.data(), slab.size(), 0, {.batch = 0}),
+      std::invalid_argument);
+}
+
+}  // namespace
@@ -0,0 +1,173 @@
+#include "remote_allocator.h"
+
+#include <new>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// The pool is never dereferenced; any aligned address range will do.
+constexpr uint64_t pool_base = 0x40000000;
+constexpr size_t chunk_size = 4096;
+
+void* pool_addr() { return reinterpret_cast<void*>((uintptr_t)pool_base); }
+
+}  // namespace
+
+TEST(chunk_server, allocate_and_release) {
+  adverbs::chunk_server server(
+      pool_addr(),
+      3 * chunk_size + 100,
+      5,
+      chunk_size);
+  EXPECT_EQ(3, server.total_chunks());
+
+  adverbs::chunk_request request;
+  request.op = adverbs::chunk_op::allocate;
+  request.count = 2;
+  auto reply = server.handle(request);
+  EXPECT_EQ(adverbs::chunk_status::ok, reply.status);
+  EXPECT_EQ(2, reply.count);
+  EXPECT_EQ(5, reply.rkey);
+  EXPECT_EQ(chunk_size, reply.chunk_size);
+  EXPECT_EQ(pool_base, reply.chunks[0]);
+  EXPECT_EQ(pool_base + chunk_size, reply.chunks[1]);
+
+  // Partial grant, then exhaustion.
+  EXPECT_EQ(1, server.handle(request).count);
+  EXPECT_EQ(adverbs::chunk_status::exhausted, server.handle(request).status);
+  EXPECT_EQ(0, server.free_chunks());
+
+  adverbs::chunk_request release;
+  release.op = adverbs::chunk_op::release;
+  release.count = 2;
+  release.chunks[0] = reply.chunks[1];
+  release.chunks[1] = pool_base + 7;  // Not a chunk.
+  auto released = server.handle(release);
+  EXPECT_EQ(adverbs::chunk_status::invalid, released.status);
+  EXPECT_EQ(1, released.count);
+  EXPECT_EQ(1, server.free_chunks());
+
+  // Double release.
+  release.count = 1;
+  EXPECT_EQ(adverbs::chunk_status::invalid, server.handle(release).status);
+
+  EXPECT_THROW(
+      adverbs::chunk_server(pool_addr(), chunk_size, 5, 100),
+      std::invalid_argument);
+}
+
+TEST(remote_allocator, sub_allocates_locally) {
+  adverbs::chunk_server server(pool_addr(), 16 * chunk_size, 5, chunk_size);
+  adverbs::remote_allocator alloc(
+      [&](const adverbs::chunk_request& r) { return server.handle(r); },
+      {.refill_chunks = 2});
+
+  std::set<uint64_t> addrs;
+  std::vector<adverbs::remote_ptr> ptrs;
+  // 2 chunks of 4096 hold 128 allocations of 64 bytes.
+  for (int i = 0; i < 128; ++i) {
+    auto ptr = alloc.allocate(64);
+    EXPECT_EQ(5, ptr.rkey);
+    EXPECT_GE(ptr.addr, pool_base);
+    EXPECT_LT(ptr.addr, pool_base + 16 * chunk_size);
+    EXPECT_TRUE(addrs.insert(ptr.addr).second);
+    ptrs.push_back(ptr);
+  }
+  EXPECT_EQ(1, alloc.rpcs());
+  EXPECT_EQ(2, alloc.chunks());
+  EXPECT_EQ(14, server.free_chunks());
+
+  alloc.allocate(64);
+  EXPECT_EQ(2, alloc.rpcs());
+  EXPECT_EQ(4, alloc.chunks());
+
+  EXPECT_THROW(alloc.allocate(chunk_size + 1), std::invalid_argument);
+  EXPECT_THROW(alloc.deallocate({0x10, 5}, 64), std::invalid_argument);
+}
+
+TEST(remote_allocator, returns_empty_chunks_in_batches) {
+  adverbs::chunk_server server(pool_addr(), 16 * chunk_size, 5, chunk_size);
+  std::vector<adverbs::chunk_op> ops;
+  adverbs::remote_allocator alloc(
+      [&](const adverbs::chunk_request& r) {
+        ops.push_back(r.op);
+        return server.handle(r);
+      },
+      {.refill_chunks = 4, .release_batch = 2, .spare_chunks = 1});
+
+  std::vector<adverbs::remote_ptr> ptrs;
+  for (int i = 0; i < 4; ++i) ptrs.push_back(alloc.allocate(chunk_size));
+  EXPECT_EQ(12, server.free_chunks());
+
+  // The first emptied chunk is kept as a spare; the next two go back
+  // together.
+  alloc.deallocate(ptrs[0], chunk_size);
+  alloc.deallocate(ptrs[1], chunk_size);
+  EXPECT_EQ(12, server.free_chunks());
+  alloc.deallocate(ptrs[2], chunk_size);
+  EXPECT_EQ(14, server.free_chunks());
+  EXPECT_EQ(2, alloc.chunks());
+  ASSERT_EQ(2, ops.size());
+  EXPECT_EQ(adverbs::chunk_op::release, ops[1]);
+
+  // Allocation reuses the spare without an RPC.
+  alloc.allocate(100);
+  EXPECT_EQ(2, ops.size());
+
+  // Freeing again into the emptied spare is caught.
+  alloc.deallocate(ptrs[3], chunk_size);
+  EXPECT_THROW(alloc.deallocate(ptrs[3], chunk_size), std::invalid_argument);
+}
+
+TEST(remote_allocator, rejects_malformed_replies) {
+  adverbs::remote_allocator alloc([](const adverbs::chunk_request&) {
+    adverbs::chunk_reply reply;
+    reply.count = adverbs::chunk_request::max_chunks + 1;
+    reply.chunk_size = chunk_size;
+    return reply;
+  });
+  EXPECT_THROW(alloc.allocate(64), std::runtime_error);
+  EXPECT_EQ(0, alloc.chunks());
+}
+
+TEST(remote_allocator, failed_release_is_retried) {
+  adverbs::chunk_server server(pool_addr(), 4 * chunk_size, 5, chunk_size);
+  bool fail = false;
+  adverbs::remote_allocator alloc(
+      [&](const adverbs::chunk_request& r) {
+        if (fail && r.op == adverbs::chunk_op::release) {
+          throw std::runtime_error("connection lost");
+        }
+        return server.handle(r);
+      },
+      {.refill_chunks = 2, .release_batch = 2, .spare_chunks = 0});
+
+  auto a = alloc.allocate(chunk_size);
+  auto b = alloc.allocate(chunk_size);
+  EXPECT_EQ(2, server.free_chunks());
+  alloc.deallocate(a, chunk_size);
+  fail = true;
+  EXPECT_THROW(alloc.deallocate(b, chunk_size), std::runtime_error);
+  EXPECT_EQ(2, server.free_chunks());
+
+  fail = false;
+  alloc.flush();
+  EXPECT_EQ(4, server.free_chunks());
+}
+
+TEST(remote_allocator, exhaustion_and_teardown) {
+  adverbs::chunk_server server(pool_addr(), 2 * chunk_size, 5, chunk_size);
+  {
+    adverbs::remote_allocator alloc(
+        [&](const adverbs::chunk_request& r) { return server.handle(r); });
+    alloc.allocate(chunk_size);
+    alloc.allocate(chunk_size);
+    EXPECT_THROW(alloc.allocate(1), std::bad_alloc);
+    EXPECT_EQ(0, server.free_chunks());
+  }
+  EXPECT_EQ(2, server.free_chunks());
+}
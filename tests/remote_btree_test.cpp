@@ -0,0 +1,359 @@
+#include "remote_btree.h"
+
+#include <infiniband/verbs.h>
+
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "fake_verbs.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Serves reads from nodes in local memory, addressed by pointer.
+struct local_reader : adverbs::btree_reader {
+  void read(
+      std::span<const uint64_t> addrs,
+      std::span<adverbs::btree_node> out) override {
+    calls++;
+    for (size_t i = 0; i < addrs.size(); ++i) {
+      reads[addrs[i]]++;
+      std::memcpy(
+          &out[i],
+          (const void*)(uintptr_t)addrs[i],
+          sizeof(adverbs::btree_node));
+    }
+  }
+
+  int calls = 0;
+  std::map<uint64_t, int> reads;
+};
+
+// A three-level tree: leaves of 4 even keys (value = key * 10), five
+// leaves per level-1 node, one root.
+struct test_tree {
+  explicit test_tree(uint64_t num_keys) {
+    std::vector<adverbs::btree_node*> level;
+    for (uint64_t k = 0; k < num_keys; k += 4) {
+      auto* leaf = node(0);
+      for (uint64_t i = k; i < std::min(num_keys, k + 4); ++i) {
+        leaf->keys[leaf->count] = i * 2;
+        leaf->values[leaf->count++] = i * 20;
+      }
+      leaf->low_key = k * 2;
+      if (!level.empty()) {
+        level.back()->high_key = leaf->low_key;
+        level.back()->next = addr(leaf);
+      }
+      level.push_back(leaf);
+    }
+    for (uint32_t height = 1; level.size() > 1 || height == 1; ++height) {
+      std::vector<adverbs::btree_node*> up;
+      for (size_t i = 0; i < level.size(); i += 5) {
+        auto* inner = node(height);
+        for (size_t j = i; j < std::min(level.size(), i + 5); ++j) {
+          inner->keys[inner->count] = level[j]->low_key;
+          inner->values[inner->count++] = addr(level[j]);
+        }
+        inner->low_key = level[i]->low_key;
+        if (!up.empty()) up.back()->high_key = inner->low_key;
+        up.push_back(inner);
+      }
+      level = up;
+    }
+    root = level[0];
+    root->low_key = 0;
+  }
+
+  adverbs::btree_node* node(uint32_t level) {
+    auto& n = nodes.emplace_back();
+    n.level = level;
+    return &n;
+  }
+
+  static uint64_t addr(adverbs::btree_node* n) {
+    return (uint64_t)(uintptr_t)n;
+  }
+
+  adverbs::btree_node* leaf_for(uint64_t key) {
+    adverbs::btree_node* n = root;
+    while (!n->is_leaf()) {
+      n = (adverbs::btree_node*)(uintptr_t)n->values[n->index_of(key)];
+    }
+    return n;
+  }
+
+  std::deque<adverbs::btree_node> nodes;
+  adverbs::btree_node* root = nullptr;
+};
+
+adverbs::btree_fallback server(int& calls) {
+  return {
+      [&](uint64_t key) -> std::optional<uint64_t> {
+        calls++;
+        return key * 10;
+      },
+      [&](uint64_t low, uint64_t high, size_t limit) {
+        calls++;
+        std::vector<std::pair<uint64_t, uint64_t>> out;
+        for (uint64_t k = (low + 1) & ~1ull; k < high && out.size() < limit;
+             k += 2) {
+          out.emplace_back(k, k * 10);
+        }
+        return out;
+      }};
+}
+
+}  // namespace
+
+TEST(remote_btree, lookup_with_cache) {
+  test_tree t(200);
+  local_reader reader;
+  int server_calls = 0;
+  adverbs::remote_btree tree(
+      reader,
+      test_tree::addr(t.root),
+      server(server_calls));
+
+  EXPECT_EQ(1000, tree.lookup(100));
+  EXPECT_EQ(std::nullopt, tree.lookup(101));
+  EXPECT_EQ(std::nullopt, tree.lookup(10000));
+  EXPECT_EQ(0, tree.lookup(0));
+  EXPECT_EQ(3980, tree.lookup(398));
+
+  // Inner nodes are now cached: one read (the leaf) per lookup.
+  int before = reader.calls;
+  EXPECT_EQ(1000, tree.lookup(100));
+  EXPECT_EQ(1, reader.calls - before);
+  EXPECT_GT(tree.stats().cache_hits, 0);
+  EXPECT_GT(tree.cached_nodes(), 0);
+  EXPECT_EQ(0, server_calls);
+
+  tree.invalidate();
+  EXPECT_EQ(0, tree.cached_nodes());
+}
+
+TEST(remote_btree, full_cache_keeps_the_root) {
+  test_tree t(200);
+  local_reader reader;
+  int server_calls = 0;
+  adverbs::remote_btree tree(
+      reader,
+      test_tree::addr(t.root),
+      server(server_calls),
+      {.cache_capacity = 3});
+
+  // Every lookup lands under a different level-1 node.
+  for (int round = 0; round < 2; ++round) {
+    for (uint64_t key = 0; key < 400; key += 40) {
+      EXPECT_EQ(key * 10, tree.lookup(key));
+    }
+  }
+  EXPECT_EQ(3, tree.cached_nodes());
+  EXPECT_EQ(1, reader.reads[test_tree::addr(t.root)]);
+
+  // The least recently used node goes first: the level-2 node on the
+  // path just walked survives the next lookup under it.
+  uint64_t level2 = t.root->values[t.root->index_of(398)];
+  int before = reader.reads[level2];
+  tree.lookup(362);
+  EXPECT_EQ(before, reader.reads[level2]);
+}
+
+TEST(remote_btree, stale_cache_is_revalidated) {
+  test_tree t(40);
+  local_reader reader;
+  int server_calls = 0;
+  adverbs::remote_btree tree(
+      reader,
+      test_tree::addr(t.root),
+      server(server_calls));
+  EXPECT_EQ(140, tree.lookup(14));
+
+  // Split the leaf holding [8, 16) on the server: 12 and 14 move right.
+  adverbs::btree_node* old_leaf = t.leaf_for(14);
+  adverbs::btree_node* parent = nullptr;
+  for (auto& n : t.nodes) {
+    if (n.level == 1 && n.covers(14)) parent = &n;
+  }
+  adverbs::btree_node* right = t.node(0);
+  old_leaf->begin_update();
+  parent->begin_update();
+  right->low_key = 12;
+  right->high_key = old_leaf->high_key;
+  right->next = old_leaf->next;
+  right->keys[0] = 12;
+  right->values[0] = 120;
+  right->keys[1] = 14;
+  right->values[1] = 141;  // Changed, to tell the leaves apart.
+  right->count = 2;
+  old_leaf->count = 2;
+  old_leaf->high_key = 12;
+  old_leaf->next = test_tree::addr(right);
+  size_t slot = parent->index_of(12) + 1;
+  for (size_t i = parent->count; i > slot; --i) {
+    parent->keys[i] = parent->keys[i - 1];
+    parent->values[i] = parent->values[i - 1];
+  }
+  parent->keys[slot] = 12;
+  parent->values[slot] = test_tree::addr(right);
+  parent->count++;
+  parent->end_update();
+  old_leaf->end_update();
+
+  EXPECT_EQ(141, tree.lookup(14));
+  EXPECT_EQ(1, tree.stats().retries);
+  EXPECT_EQ(0, server_calls);
+  EXPECT_EQ(80, tree.lookup(8));
+
+  auto rows = tree.scan(8, 18);
+  ASSERT_EQ(5, rows.size());
+  EXPECT_EQ(14, rows[3].first);
+  EXPECT_EQ(141, rows[3].second);
+}
+
+TEST(remote_btree, falls_back_on_torn_nodes) {
+  test_tree t(40);
+  local_reader reader;
+  int server_calls = 0;
+  adverbs::remote_btree tree(
+      reader,
+      test_tree::addr(t.root),
+      server(server_calls),
+      {.max_retries = 2});
+
+  // A writer stuck mid-update.
+  t.leaf_for(20)->begin_update();
+  EXPECT_EQ(200, tree.lookup(20));
+  EXPECT_EQ(1, server_calls);
+  EXPECT_EQ(1, tree.stats().fallbacks);
+  EXPECT_EQ(2, tree.stats().retries);
+
+  // Other leaves are unaffected.
+  EXPECT_EQ(100, tree.lookup(10));
+  EXPECT_EQ(1, server_calls);
+}
+
+TEST(remote_btree, scan) {
+  test_tree t(200);
+  local_reader reader;
+  int server_calls = 0;
+  adverbs::remote_btree tree(
+      reader,
+      test_tree::addr(t.root),
+      server(server_calls),
+      {.scan_pipeline = 2});
+
+  auto rows = tree.scan(33, 101);
+  ASSERT_EQ(34, rows.size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    EXPECT_EQ(34 + 2 * i, rows[i].first);
+    EXPECT_EQ(rows[i].first * 10, rows[i].second);
+  }
+
+  EXPECT_EQ(5, tree.scan(0, 1000, 5).size());
+  auto all = tree.scan(0, adverbs::btree_node::max_key);
+  EXPECT_EQ(200, all.size());
+  EXPECT_TRUE(tree.scan(50, 50).empty());
+  EXPECT_EQ(0, server_calls);
+}
+
+TEST(remote_btree, scan_follows_links_past_a_stale_parent) {
+  test_tree t(40);
+  local_reader reader;
+  int server_calls = 0;
+  adverbs::remote_btree tree(
+      reader,
+      test_tree::addr(t.root),
+      server(server_calls));
+
+  // Split the leaf holding [8, 16) without updating its parent: [12, 16)
+  // is only reachable through the left leaf's link.
+  adverbs::btree_node* left = t.leaf_for(8);
+  adverbs::btree_node* right = t.node(0);
+  right->low_key = 12;
+  right->high_key = left->high_key;
+  right->next = left->next;
+  right->keys[0] = 12;
+  right->values[0] = 120;
+  right->keys[1] = 14;
+  right->values[1] = 140;
+  right->count = 2;
+  left->begin_update();
+  left->count = 2;
+  left->high_key = 12;
+  left->next = test_tree::addr(right);
+  left->end_update();
+
+  auto rows = tree.scan(0, 40);
+  ASSERT_EQ(20, rows.size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    EXPECT_EQ(2 * i, rows[i].first);
+    EXPECT_EQ(rows[i].first * 10, rows[i].second);
+  }
+  EXPECT_EQ(0, tree.stats().retries);
+  EXPECT_EQ(0, server_calls);
+}
+
+TEST(remote_btree, scan_falls_back_on_torn_leaves) {
+  test_tree t(200);
+  local_reader reader;
+  int server_calls = 0;
+  adverbs::remote_btree tree(
+      reader,
+      test_tree::addr(t.root),
+      server(server_calls),
+      {.max_retries = 1});
+
+  t.leaf_for(60)->begin_update();
+  auto rows = tree.scan(40, 80);
+  ASSERT_EQ(20, rows.size());
+  for (size_t i = 0; i < rows.size(); ++i) EXPECT_EQ(40 + 2 * i, rows[i].first);
+  EXPECT_EQ(1, server_calls);
+}
+
+TEST(remote_btree, rdma_reader) {
+  adverbs_test::fake_verbs fake;
+  struct ibv_cq* cq = fake.make_cq();
+  std::vector<adverbs::btree_node> staging(2);
+  adverbs::rdma_btree_reader reader(
+      fake.make_qp(1),
+      cq,
+      9,
+      staging.data(),
+      staging.size(),
+      8);
+
+  // Each chain waits for its signaled (last) READ, passing others.
+  fake.complete(cq, {.wr_id = 7, .status = IBV_WC_SUCCESS});
+  fake.complete(cq, {.wr_id = 1, .status = IBV_WC_SUCCESS});
+  fake.complete(cq, {.wr_id = 2, .status = IBV_WC_SUCCESS});
+  std::vector<uint64_t> addrs = {0x1000, 0x2000, 0x3000};
+  std::vector<adverbs::btree_node> out(3);
+  reader.read(addrs, out);
+
+  EXPECT_EQ(2, fake.post_send_calls);
+  ASSERT_EQ(3, fake.sends.size());
+  for (size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(IBV_WR_RDMA_READ, fake.sends[i].wr.opcode);
+    EXPECT_EQ(addrs[i], fake.sends[i].wr.wr.rdma.remote_addr);
+    EXPECT_EQ(9, fake.sends[i].wr.wr.rdma.rkey);
+    EXPECT_EQ(sizeof(adverbs::btree_node), fake.sends[i].sges[0].length);
+    EXPECT_EQ(8, fake.sends[i].sges[0].lkey);
+  }
+  EXPECT_FALSE(fake.sends[0].wr.send_flags & IBV_SEND_SIGNALED);
+  EXPECT_TRUE(fake.sends[1].wr.send_flags & IBV_SEND_SIGNALED);
+  EXPECT_TRUE(fake.sends[2].wr.send_flags & IBV_SEND_SIGNALED);
+
+  EXPECT_TRUE(fake.completions[cq].empty());
+
+  // An unsignaled READ's error fails the chain.
+  fake.complete(cq, {.wr_id = 0, .status = IBV_WC_REM_ACCESS_ERR});
+  fake.complete(cq, {.wr_id = 1, .status = IBV_WC_WR_FLUSH_ERR});
+  EXPECT_THROW(
+      reader.read({addrs.data(), 2}, {out.data(), 2}),
+      std::runtime_error);
+}
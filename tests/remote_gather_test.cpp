@@ -0,0 +1,148 @@
+#include "remote_gather.h"
+
+#include <infiniband/verbs.h>
+
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "fake_verbs.h"
+#include "gtest/gtest.h"
+
+TEST(remote_gather, plan_coalesces_nearby_ranges) {
+  std::vector<adverbs::gather_item> items = {
+      {1000, 16},
+      {100, 8},
+      {120, 8},  // 12-byte gap after the previous: merged.
+      {1010, 4},  // Inside the first item: merged, no extra staging.
+      {500, 8},  // Far away: its own read.
+  };
+  auto plan = adverbs::plan_gather(items, {.max_gap = 16});
+
+  ASSERT_EQ(3, plan.reads.size());
+  EXPECT_EQ(100, plan.reads[0].remote_addr);
+  EXPECT_EQ(28, plan.reads[0].length);
+  EXPECT_EQ(0, plan.reads[0].staging_offset);
+  EXPECT_EQ(500, plan.reads[1].remote_addr);
+  EXPECT_EQ(8, plan.reads[1].length);
+  EXPECT_EQ(28, plan.reads[1].staging_offset);
+  EXPECT_EQ(1000, plan.reads[2].remote_addr);
+  EXPECT_EQ(16, plan.reads[2].length);
+  EXPECT_EQ(36, plan.reads[2].staging_offset);
+  EXPECT_EQ(52, plan.staging_bytes);
+  EXPECT_EQ(44, plan.dense_bytes);
+  EXPECT_EQ(5, plan.copies.size());
+}
+
+TEST(remote_gather, plan_splits_long_ranges) {
+  std::vector<adverbs::gather_item> items = {{0, 250}, {250, 10}};
+  auto plan = adverbs::plan_gather(items, {.max_gap = 0, .max_read = 100});
+
+  ASSERT_EQ(3, plan.reads.size());
+  for (const auto& read : plan.reads) EXPECT_LE(read.length, 100);
+  EXPECT_EQ(260, plan.staging_bytes);
+  EXPECT_EQ(200, plan.reads[2].remote_addr);
+  EXPECT_EQ(60, plan.reads[2].length);
+
+  EXPECT_THROW(
+      adverbs::plan_gather(items, {.max_read = 0}),
+      std::invalid_argument);
+}
+
+TEST(remote_gather, post_and_scatter) {
+  adverbs_test::fake_verbs fake;
+
+  // The "remote" table is local memory; the fake READ copies from it.
+  std::vector<unsigned char> table(64 * 1024);
+  std::iota(table.begin(), table.end(), 0);
+  auto remote = [&](size_t offset) {
+    return (uint64_t)(uintptr_t)table.data() + offset;
+  };
+
+  std::vector<adverbs::gather_item> items;
+  for (size_t row : {900, 3, 4, 5, 700, 40, 41, 1000}) {
+    items.push_back({remote(row * 32), 24});
+  }
+  adverbs::gather_options options = {.max_gap = 8, .max_chain = 2};
+  auto plan = adverbs::plan_gather(items, options);
+  // Rows 3-5 and 40-41 are each one read.
+  EXPECT_EQ(5, plan.reads.size());
+
+  std::vector<std::byte> staging(plan.staging_bytes);
+  adverbs::remote_gather gather(
+      fake.make_qp(1),
+      55,
+      staging.data(),
+      staging.size(),
+      66,
+      options);
+  EXPECT_EQ(3, gather.post(plan, 9));
+  EXPECT_EQ(3, fake.post_send_calls);
+  ASSERT_EQ(5, fake.sends.size());
+
+  for (size_t i = 0; i < fake.sends.size(); ++i) {
+    const auto& send = fake.sends[i];
+    EXPECT_EQ(IBV_WR_RDMA_READ, send.wr.opcode);
+    EXPECT_EQ(9, send.wr.wr_id);
+    EXPECT_EQ(55, send.wr.wr.rdma.rkey);
+    EXPECT_EQ(66, send.sges[0].lkey);
+    // The last READ of each chain of two is signaled.
+    EXPECT_EQ(
+        i % 2 == 1 || i == 4,
+        (send.wr.send_flags & IBV_SEND_SIGNALED) != 0);
+    std::memcpy(
+        (void*)(uintptr_t)send.sges[0].addr,
+        (const void*)(uintptr_t)send.wr.wr.rdma.remote_addr,
+        send.sges[0].length);
+  }
+
+  std::vector<unsigned char> dense(plan.dense_bytes);
+  gather.scatter(plan, dense.data());
+  for (size_t i = 0; i < items.size(); ++i) {
+    EXPECT_EQ(
+        0,
+        std::memcmp(
+            dense.data() + i * 24,
+            (const void*)(uintptr_t)items[i].remote_addr,
+            24))
+        << i;
+  }
+}
+
+TEST(remote_gather, failed_post_reports_posted_chains) {
+  adverbs_test::fake_verbs fake;
+  std::vector<adverbs::gather_item> items;
+  for (uint64_t i = 0; i < 5; ++i) items.push_back({i * 4096, 64});
+  adverbs::gather_options options = {.max_chain = 2};
+  auto plan = adverbs::plan_gather(items, options);
+  ASSERT_EQ(5, plan.reads.size());
+
+  std::vector<std::byte> staging(plan.staging_bytes);
+  adverbs::remote_gather gather(
+      fake.make_qp(1),
+      1,
+      staging.data(),
+      staging.size(),
+      2,
+      options);
+  // The second chain fails at its second READ.
+  fake.fail_send_at = 3;
+  try {
+    gather.post(plan, 0);
+    FAIL() << "post succeeded";
+  } catch (const adverbs::gather_post_error& e) {
+    EXPECT_EQ(1, e.signaled());
+  }
+  EXPECT_EQ(2, fake.post_send_calls);
+}
+
+TEST(remote_gather, staging_too_small) {
+  adverbs_test::fake_verbs fake;
+  std::vector<adverbs::gather_item> items = {{0, 64}};
+  auto plan = adverbs::plan_gather(items);
+  std::byte staging[32];
+  adverbs::remote_gather gather(fake.make_qp(1), 1, staging, 32, 2);
+  EXPECT_THROW(gather.post(plan, 0), std::invalid_argument);
+  EXPECT_EQ(0, fake.post_send_calls);
+}
@@ -0,0 +1,230 @@
+#include "remote_queue.h"
+
+#include <infiniband/verbs.h>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "fake_verbs.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Executes the one-sided operations on local memory, one at a time.
+struct local_transport : adverbs::queue_transport {
+  uint64_t fetch_add(uint64_t remote_addr, uint64_t add) override {
+    std::lock_guard lock(mutex);
+    ops++;
+    auto* word = (uint64_t*)(uintptr_t)remote_addr;
+    uint64_t prior = *word;
+    *word += add;
+    return prior;
+  }
+
+  void read(uint64_t remote_addr, std::span<std::byte> dst) override {
+    {
+      std::lock_guard lock(mutex);
+      ops++;
+      std::memcpy(dst.data(), (const void*)(uintptr_t)remote_addr, dst.size());
+    }
+    std::this_thread::yield();
+  }
+
+  void write(uint64_t remote_addr, std::span<const std::byte> src) override {
+    std::lock_guard lock(mutex);
+    ops++;
+    std::memcpy((void*)(uintptr_t)remote_addr, src.data(), src.size());
+  }
+
+  std::mutex mutex;
+  int ops = 0;
+};
+
+// Places each WRITE's footer at once but the rest of it only after the
+// next READ, like an HCA placing a WRITE's bytes out of order while a
+// READ of the same slot is served.
+struct reordering_transport : local_transport {
+  void read(uint64_t remote_addr, std::span<std::byte> dst) override {
+    local_transport::read(remote_addr, dst);
+    for (auto& [addr, bytes] : pending) {
+      local_transport::write(addr, bytes);
+    }
+    pending.clear();
+  }
+
+  void write(uint64_t remote_addr, std::span<const std::byte> src) override {
+    size_t footer = std::min(src.size(), sizeof(adverbs::slot_footer));
+    size_t head = src.size() - footer;
+    local_transport::write(remote_addr + head, src.subspan(head));
+    if (head) {
+      pending.emplace_back(
+          remote_addr,
+          std::vector<std::byte>(src.begin(), src.begin() + head));
+    }
+  }
+
+  std::vector<std::pair<uint64_t, std::vector<std::byte>>> pending;
+};
+
+struct hosted_queue {
+  explicit hosted_queue(adverbs::remote_queue_layout layout)
+      : layout(layout), memory(layout.bytes() / 8 + 8) {
+    adverbs::remote_mpmc_queue::format(memory.data(), layout);
+  }
+
+  uint64_t addr() { return (uint64_t)(uintptr_t)memory.data(); }
+
+  adverbs::remote_queue_layout layout;
+  std::vector<uint64_t> memory;
+  local_transport transport;
+};
+
+std::span<const std::byte> bytes_of(const std::string& s) {
+  return std::as_bytes(std::span(s));
+}
+
+}  // namespace
+
+TEST(remote_mpmc_queue, fifo) {
+  hosted_queue host({.capacity = 4, .slot_size = 64});
+  adverbs::remote_mpmc_queue queue(host.transport, host.addr(), host.layout);
+  EXPECT_EQ(48, host.layout.max_payload());
+
+  // Several laps around the ring.
+  std::vector<std::byte> out(host.layout.max_payload());
+  for (int lap = 0; lap < 3; ++lap) {
+    for (int i = 0; i < 4; ++i) {
+      std::string msg = "msg-" + std::to_string(lap * 4 + i);
+      EXPECT_EQ(lap * 4 + i, queue.enqueue(bytes_of(msg)));
+    }
+    for (int i = 0; i < 4; ++i) {
+      uint64_t ticket;
+      size_t length = queue.dequeue(out, &ticket);
+      EXPECT_EQ(lap * 4 + i, ticket);
+      EXPECT_EQ(
+          "msg-" + std::to_string(lap * 4 + i),
+          std::string((const char*)out.data(), length));
+    }
+  }
+
+  std::string too_big(49, 'x');
+  EXPECT_THROW(queue.enqueue(bytes_of(too_big)), std::invalid_argument);
+  std::vector<std::byte> small(10);
+  EXPECT_THROW(queue.dequeue(small), std::invalid_argument);
+  EXPECT_THROW(
+      adverbs::remote_mpmc_queue(host.transport, 0, {.slot_size = 100}),
+      std::invalid_argument);
+  EXPECT_THROW(
+      adverbs::remote_mpmc_queue(host.transport, 0, {.capacity = 1}),
+      std::invalid_argument);
+}
+
+TEST(remote_mpmc_queue, concurrent_producers_and_consumers) {
+  hosted_queue host({.capacity = 8, .slot_size = 64});
+  constexpr int threads = 3;
+  constexpr int per_thread = 200;
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::vector<int> received;
+  for (int p = 0; p < threads; ++p) {
+    workers.emplace_back([&, p]() {
+      adverbs::remote_mpmc_queue queue(
+          host.transport,
+          host.addr(),
+          host.layout);
+      for (int i = 0; i < per_thread; ++i) {
+        int value = p * per_thread + i;
+        queue.enqueue(std::as_bytes(std::span(&value, 1)));
+      }
+    });
+    workers.emplace_back([&]() {
+      adverbs::remote_mpmc_queue queue(
+          host.transport,
+          host.addr(),
+          host.layout);
+      std::vector<std::byte> out(host.layout.max_payload());
+      for (int i = 0; i < per_thread; ++i) {
+        EXPECT_EQ(sizeof(int), queue.dequeue(out));
+        int value;
+        std::memcpy(&value, out.data(), sizeof(value));
+        std::lock_guard lock(mutex);
+        received.push_back(value);
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+
+  std::sort(received.begin(), received.end());
+  ASSERT_EQ(threads * per_thread, received.size());
+  for (int i = 0; i < threads * per_thread; ++i) EXPECT_EQ(i, received[i]);
+}
+
+TEST(remote_mpmc_queue, rdma_transport) {
+  adverbs_test::fake_verbs fake;
+  struct ibv_cq* cq = fake.make_cq();
+  alignas(8) std::byte scratch[64];
+  adverbs::rdma_queue_transport transport(
+      fake.make_qp(1),
+      cq,
+      7,
+      scratch,
+      sizeof(scratch),
+      3);
+
+  struct ibv_wc wc = {};
+  wc.status = IBV_WC_SUCCESS;
+  for (int i = 0; i < 3; ++i) fake.complete(cq, wc);
+
+  uint64_t prior = 41;
+  std::memcpy(scratch, &prior, sizeof(prior));
+  EXPECT_EQ(41, transport.fetch_add(0x1000, 1));
+  std::byte buf[16] = {};
+  transport.write(0x2000, buf);
+  transport.read(0x3000, buf);
+
+  ASSERT_EQ(3, fake.sends.size());
+  EXPECT_EQ(IBV_WR_ATOMIC_FETCH_AND_ADD, fake.sends[0].wr.opcode);
+  EXPECT_EQ(0x1000, fake.sends[0].wr.wr.atomic.remote_addr);
+  EXPECT_EQ(1, fake.sends[0].wr.wr.atomic.compare_add);
+  EXPECT_EQ(7, fake.sends[0].wr.wr.atomic.rkey);
+  EXPECT_EQ(IBV_WR_RDMA_WRITE, fake.sends[1].wr.opcode);
+  EXPECT_EQ(16, fake.sends[1].sges[0].length);
+  EXPECT_EQ(IBV_WR_RDMA_READ, fake.sends[2].wr.opcode);
+  EXPECT_EQ(0x3000, fake.sends[2].wr.wr.rdma.remote_addr);
+  for (const auto& send : fake.sends) {
+    EXPECT_TRUE(send.wr.send_flags & IBV_SEND_SIGNALED);
+    EXPECT_EQ(3, send.sges[0].lkey);
+  }
+
+  std::byte big[65];
+  EXPECT_THROW(transport.read(0, big), std::invalid_argument);
+  wc.status = IBV_WC_REM_ACCESS_ERR;
+  fake.complete(cq, wc);
+  EXPECT_THROW(transport.fetch_add(0, 1), std::runtime_error);
+}
+
+TEST(remote_mpmc_queue, payload_read_after_footer) {
+  adverbs::remote_queue_layout layout{.capacity = 2, .slot_size = 64};
+  std::vector<uint64_t> memory(layout.bytes() / 8);
+  adverbs::remote_mpmc_queue::format(memory.data(), layout);
+  reordering_transport transport;
+  adverbs::remote_mpmc_queue queue(
+      transport,
+      (uint64_t)(uintptr_t)memory.data(),
+      layout);
+
+  std::vector<std::byte> out(layout.max_payload());
+  for (int i = 0; i < 4; ++i) {
+    std::string msg = "entry-" + std::to_string(i);
+    queue.enqueue(bytes_of(msg));
+    size_t length = queue.dequeue(out);
+    EXPECT_EQ(msg, std::string((const char*)out.data(), length));
+  }
+}
@@ -0,0 +1,114 @@
+#include "shared_buffer.h"
+
+#include <infiniband/verbs.h>
+
+#include <vector>
+
+#include "fake_verbs.h"
+#include "gtest/gtest.h"
+
+TEST(shared_buffer, refcount) {
+  char payload[16] = "hello";
+  int released = 0;
+  adverbs::shared_buffer buffer(
+      payload,
+      5,
+      42,
+      [&](adverbs::shared_buffer*) { ++released; });
+
+  EXPECT_EQ(1, buffer.refs());
+  auto sge = buffer.sge();
+  EXPECT_EQ((uint64_t)(uintptr_t)payload, sge.addr);
+  EXPECT_EQ(5, sge.length);
+  EXPECT_EQ(42, sge.lkey);
+  EXPECT_EQ(&buffer, adverbs::shared_buffer::from_wr_id(buffer.wr_id()));
+
+  buffer.retain(3);
+  buffer.release();
+  buffer.release(2);
+  EXPECT_EQ(0, released);
+  buffer.release();
+  EXPECT_EQ(1, released);
+}
+
+TEST(shared_buffer, releaser_batches_per_buffer) {
+  char payload[8] = {};
+  std::vector<int> released;
+  adverbs::shared_buffer a(payload, 8, 1, [&](auto*) { released.push_back(1); });
+  adverbs::shared_buffer b(payload, 8, 1, [&](auto*) { released.push_back(2); });
+  a.retain(3);
+  b.retain(2);
+
+  {
+    adverbs::completion_releaser releaser;
+    releaser.add(a.wr_id());
+    releaser.add(a.wr_id());
+    releaser.add(b.wr_id());
+    releaser.add(a.wr_id());
+    EXPECT_EQ(2, releaser.pending());
+    releaser.flush();
+    EXPECT_EQ(0, releaser.pending());
+    EXPECT_TRUE(released.empty());
+    EXPECT_EQ(1, a.refs());
+    EXPECT_EQ(2, b.refs());
+
+    releaser.add(b.wr_id());
+  }
+  // The destructor flushes.
+  EXPECT_EQ(1, b.refs());
+
+  a.release();
+  b.release();
+  EXPECT_EQ((std::vector<int>{1, 2}), released);
+}
+
+TEST(shared_buffer, post_fan_out) {
+  adverbs_test::fake_verbs verbs;
+  std::vector<struct ibv_qp*> qps = {
+      verbs.make_qp(1),
+      verbs.make_qp(2),
+      verbs.make_qp(3)};
+
+  char payload[32] = "fan-out";
+  int released = 0;
+  adverbs::shared_buffer buffer(payload, 7, 9, [&](auto*) { ++released; });
+
+  adverbs::post_fan_out(buffer, qps, IBV_SEND_SOLICITED);
+  EXPECT_EQ(4, buffer.refs());
+  ASSERT_EQ(3, verbs.sends.size());
+  for (const auto& send : verbs.sends) {
+    EXPECT_EQ(buffer.wr_id(), send.wr.wr_id);
+    EXPECT_EQ(IBV_WR_SEND, send.wr.opcode);
+    EXPECT_EQ(IBV_SEND_SIGNALED | IBV_SEND_SOLICITED, send.wr.send_flags);
+    ASSERT_EQ(1, send.sges.size());
+    EXPECT_EQ((uint64_t)(uintptr_t)payload, send.sges[0].addr);
+  }
+
+  buffer.release();
+  adverbs::completion_releaser releaser;
+  for (const auto& send : verbs.sends) releaser.add(send.wr.wr_id);
+  releaser.flush();
+  EXPECT_EQ(1, released);
+}
+
+TEST(shared_buffer, post_fan_out_failure_drops_unposted_refs) {
+  adverbs_test::fake_verbs verbs;
+  std::vector<struct ibv_qp*> qps = {
+      verbs.make_qp(1),
+      verbs.make_qp(2),
+      verbs.make_qp(3)};
+  verbs.fail_send_at = 1;
+
+  char payload[8] = {};
+  adverbs::shared_buffer buffer(payload, 8, 1, nullptr);
+  try {
+    adverbs::post_fan_out(buffer, qps);
+    FAIL() << "post succeeded";
+  } catch (const adverbs::fan_out_error& e) {
+    // The first QP got the payload; the middle one failed.
+    EXPECT_EQ(1, e.posted());
+  }
+  ASSERT_EQ(1, verbs.sends.size());
+  // The creator's reference plus the one send that was posted.
+  EXPECT_EQ(2, buffer.refs());
+}
@@ -0,0 +1,52 @@
+#include "spsc_queue.h"
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+TEST(spsc_queue, capacity_rounds_up) {
+  adverbs::spsc_queue<int> queue(5);
+  EXPECT_EQ(8, queue.capacity());
+  EXPECT_THROW(adverbs::spsc_queue<int>(0), std::invalid_argument);
+}
+
+TEST(spsc_queue, full_and_empty) {
+  adverbs::spsc_queue<int> queue(4);
+  int value = 0;
+  EXPECT_FALSE(queue.try_pop(value));
+
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.try_push(i));
+  }
+  EXPECT_FALSE(queue.try_push(4));
+  EXPECT_EQ(4, queue.size_approx());
+
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queue.try_pop(value));
+    EXPECT_EQ(i, value);
+  }
+  EXPECT_FALSE(queue.try_pop(value));
+  EXPECT_TRUE(queue.try_push(5));
+}
+
+TEST(spsc_queue, two_threads_preserve_order) {
+  constexpr uint64_t count = 200000;
+  adverbs::spsc_queue<uint64_t> queue(64);
+
+  std::thread producer([&]() {
+    for (uint64_t i = 0; i < count; ++i) {
+      while (!queue.try_push(i)) {
+      }
+    }
+  });
+
+  uint64_t expected = 0;
+  uint64_t value;
+  while (expected < count) {
+    if (queue.try_pop(value)) {
+      ASSERT_EQ(expected, value);
+      ++expected;
+    }
+  }
+  producer.join();
+}
@@ -0,0 +1,158 @@
+#include "symmetric_heap.h"
+
+#include <infiniband/verbs.h>
+
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#include "fake_verbs.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+constexpr uint64_t peer_base = 0x100000;
+constexpr uint32_t peer_rkey = 77;
+
+struct two_ranks {
+  two_ranks()
+      : heap(
+            memory,
+            sizeof(memory),
+            11,
+            12,
+            0,
+            {fake.make_qp(1), fake.make_qp(2)},
+            [](const adverbs::heap_segment& mine) {
+              return std::vector<adverbs::heap_segment>{
+                  mine,
+                  {peer_base, sizeof(memory), peer_rkey}};
+            }) {}
+
+  adverbs_test::fake_verbs fake;
+  alignas(8) std::byte memory[4096] = {};
+  adverbs::symmetric_heap heap;
+};
+
+}  // namespace
+
+TEST(symmetric_heap, allocate) {
+  two_ranks t;
+  EXPECT_EQ(2, t.heap.size());
+  EXPECT_EQ(0, t.heap.rank());
+  EXPECT_EQ(0, t.heap.allocate(3));
+  EXPECT_EQ(8, t.heap.allocate(8));
+  EXPECT_EQ(64, t.heap.allocate(100, 64));
+  EXPECT_THROW(t.heap.allocate(4096), std::bad_alloc);
+  EXPECT_EQ(t.memory + 64, t.heap.local(64));
+}
+
+TEST(symmetric_heap, put_get) {
+  two_ranks t;
+  size_t obj = t.heap.allocate(256);
+
+  t.heap.put(1, obj, 256, 5);
+  t.heap.get(1, obj + 16, 32, 6);
+  char scratch[8];
+  t.heap.put(0, obj, scratch, sizeof(scratch), 99);
+
+  ASSERT_EQ(3, t.fake.sends.size());
+  const auto& put = t.fake.sends[0];
+  EXPECT_EQ(IBV_WR_RDMA_WRITE, put.wr.opcode);
+  EXPECT_EQ(5, put.wr.wr_id);
+  EXPECT_EQ(peer_base + obj, put.wr.wr.rdma.remote_addr);
+  EXPECT_EQ(peer_rkey, put.wr.wr.rdma.rkey);
+  EXPECT_EQ((uint64_t)(uintptr_t)t.heap.local(obj), put.sges[0].addr);
+  EXPECT_EQ(256, put.sges[0].length);
+  EXPECT_EQ(11, put.sges[0].lkey);
+  EXPECT_TRUE(put.wr.send_flags & IBV_SEND_SIGNALED);
+
+  const auto& get = t.fake.sends[1];
+  EXPECT_EQ(IBV_WR_RDMA_READ, get.wr.opcode);
+  EXPECT_EQ(peer_base + obj + 16, get.wr.wr.rdma.remote_addr);
+  EXPECT_EQ((uint64_t)(uintptr_t)t.heap.local(obj + 16), get.sges[0].addr);
+
+  // Rank 0 is this process: its own segment.
+  const auto& self = t.fake.sends[2];
+  EXPECT_EQ((uint64_t)(uintptr_t)t.memory + obj, self.wr.wr.rdma.remote_addr);
+  EXPECT_EQ(12, self.wr.wr.rdma.rkey);
+  EXPECT_EQ(99, self.sges[0].lkey);
+
+  EXPECT_THROW(t.heap.put(1, 4000, 200), std::out_of_range);
+}
+
+TEST(symmetric_heap, atomics) {
+  two_ranks t;
+  size_t counter = t.heap.allocate(8);
+  size_t result = t.heap.allocate(8);
+
+  t.heap.atomic_add(1, counter, 3, result);
+  t.heap.compare_swap(1, counter, 3, 9, result);
+
+  ASSERT_EQ(2, t.fake.sends.size());
+  const auto& add = t.fake.sends[0];
+  EXPECT_EQ(IBV_WR_ATOMIC_FETCH_AND_ADD, add.wr.opcode);
+  EXPECT_EQ(peer_base + counter, add.wr.wr.atomic.remote_addr);
+  EXPECT_EQ(peer_rkey, add.wr.wr.atomic.rkey);
+  EXPECT_EQ(3, add.wr.wr.atomic.compare_add);
+  EXPECT_EQ((uint64_t)(uintptr_t)t.heap.local(result), add.sges[0].addr);
+  EXPECT_EQ(8, add.sges[0].length);
+
+  const auto& cas = t.fake.sends[1];
+  EXPECT_EQ(IBV_WR_ATOMIC_CMP_AND_SWP, cas.wr.opcode);
+  EXPECT_EQ(3, cas.wr.wr.atomic.compare_add);
+  EXPECT_EQ(9, cas.wr.wr.atomic.swap);
+
+  EXPECT_THROW(
+      t.heap.atomic_add(1, counter + 4, 1, result),
+      std::invalid_argument);
+}
+
+TEST(symmetric_heap, mismatched_heaps) {
+  adverbs_test::fake_verbs fake;
+  alignas(8) std::byte memory[64];
+  auto construct = [&](std::vector<adverbs::heap_segment> segments) {
+    adverbs::symmetric_heap heap(
+        memory,
+        sizeof(memory),
+        1,
+        2,
+        0,
+        {fake.make_qp(1), fake.make_qp(2)},
+        [&](const adverbs::heap_segment&) { return segments; });
+  };
+  EXPECT_THROW(
+      construct({{0, 64, 1}, {0, 128, 1}}),
+      std::invalid_argument);
+  EXPECT_THROW(construct({{0, 64, 1}}), std::invalid_argument);
+}
+
+TEST(symmetric_heap, rejects_bad_ranks_and_lengths) {
+  adverbs_test::fake_verbs fake;
+  // Never dereferenced: operations are only posted.
+  auto* base = (void*)(uintptr_t)0x10000000;
+  size_t length = 8ull << 30;
+  adverbs::symmetric_heap heap(
+      base,
+      length,
+      1,
+      2,
+      0,
+      {nullptr, fake.make_qp(2)},
+      [&](const adverbs::heap_segment& mine) {
+        return std::vector<adverbs::heap_segment>{mine, mine};
+      });
+
+  EXPECT_THROW(heap.put(2, 0, 8), std::out_of_range);
+  EXPECT_THROW(heap.get(-1, 0, 8), std::out_of_range);
+  EXPECT_THROW(heap.atomic_add(5, 0, 1, 8), std::out_of_range);
+  // This rank has no loopback QP.
+  EXPECT_THROW(heap.put(0, 0, 8), std::invalid_argument);
+  EXPECT_THROW(heap.compare_swap(0, 0, 1, 2, 8), std::invalid_argument);
+  EXPECT_THROW(heap.get(1, 0, 5ull << 30), std::invalid_argument);
+  EXPECT_TRUE(fake.sends.empty());
+
+  heap.put(1, 0, UINT32_MAX);
+  ASSERT_EQ(1, fake.sends.size());
+  EXPECT_EQ(UINT32_MAX, fake.sends[0].sges[0].length);
+}
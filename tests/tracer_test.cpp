@@ -0,0 +1,121 @@
+#include "tracer.h"
+
+#include <infiniband/verbs.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string read_file(const std::string& path) {
+  std::ifstream in(path);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+size_t count(const std::string& haystack, const std::string& needle) {
+  size_t n = 0;
+  for (size_t pos = haystack.find(needle); pos != std::string::npos;
+       pos = haystack.find(needle, pos + 1)) {
+    ++n;
+  }
+  return n;
+}
+
+}  // namespace
+
+TEST(tracer, disabled_is_noop) {
+  EXPECT_FALSE(adverbs::tracer::enabled());
+  adverbs::trace_post(1, 2, IBV_WR_RDMA_WRITE);
+  adverbs::trace_instant("connect", 1);
+  adverbs::tracer::stop();
+}
+
+TEST(tracer, writes_chrome_trace) {
+  std::string path =
+      "/tmp/adverbs_tracer_test." + std::to_string(getpid()) + ".json";
+  adverbs::tracer::start(path);
+  EXPECT_TRUE(adverbs::tracer::enabled());
+
+  adverbs::trace_instant("RTS", 7);
+  std::thread poster([]() {
+    for (uint64_t i = 0; i < 100; ++i) {
+      adverbs::trace_post(7, i, IBV_WR_RDMA_WRITE);
+    }
+  });
+  poster.join();
+
+  struct ibv_wc wc = {};
+  wc.qp_num = 7;
+  wc.opcode = IBV_WC_RDMA_WRITE;
+  for (uint64_t i = 0; i < 100; ++i) {
+    wc.wr_id = i;
+    adverbs::trace_completion(wc);
+  }
+  adverbs::tracer::stop();
+  EXPECT_FALSE(adverbs::tracer::enabled());
+  EXPECT_EQ(0, adverbs::tracer::dropped());
+
+  std::string trace = read_file(path);
+  std::remove(path.c_str());
+
+  EXPECT_EQ(0, trace.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+  EXPECT_EQ(trace.size() - 4, trace.rfind("\n]}\n"));
+  EXPECT_EQ(100, count(trace, "\"name\":\"RDMA_WRITE\",\"cat\":\"qp7\",\"ph\":\"b\""));
+  EXPECT_EQ(100, count(trace, "\"name\":\"RDMA_WRITE\",\"cat\":\"qp7\",\"ph\":\"e\""));
+  EXPECT_EQ(100, count(trace, "\"status\":\"success\""));
+  EXPECT_EQ(1, count(trace, "\"name\":\"RTS\""));
+}
+
+TEST(tracer, escapes_names_and_names_failed_completions) {
+  std::string path =
+      "/tmp/adverbs_tracer_escape." + std::to_string(getpid()) + ".json";
+  adverbs::tracer::start(path);
+  adverbs::trace_instant("say \"hi\"\\\n", 3);
+
+  // A failed completion's opcode is undefined, however plausible.
+  struct ibv_wc wc = {};
+  wc.qp_num = 3;
+  wc.wr_id = 1;
+  wc.opcode = IBV_WC_RDMA_READ;
+  wc.status = IBV_WC_REM_ACCESS_ERR;
+  adverbs::trace_completion(wc);
+  adverbs::tracer::stop();
+
+  std::string trace = read_file(path);
+  std::remove(path.c_str());
+  EXPECT_EQ(1, count(trace, "\"name\":\"say \\\"hi\\\"\\\\\\u000a\""));
+  EXPECT_EQ(1, count(trace, "\"name\":\"error\",\"cat\":\"qp3\",\"ph\":\"e\""));
+  EXPECT_EQ(0, count(trace, "RDMA_READ"));
+}
+
+TEST(tracer, drops_on_overflow) {
+  std::string path =
+      "/tmp/adverbs_tracer_drop." + std::to_string(getpid()) + ".json";
+  adverbs::tracer::start(
+      path,
+      {.buffer_capacity = 4, .flush_interval = std::chrono::hours(1)});
+  for (uint64_t i = 0; i < 10; ++i) {
+    adverbs::trace_recv_posted(1, i);
+  }
+  EXPECT_EQ(6, adverbs::tracer::dropped());
+  adverbs::tracer::stop();
+  std::remove(path.c_str());
+}
+
+TEST(tracer, span_names_match) {
+  EXPECT_STREQ(
+      adverbs::opcode_name(IBV_WR_RDMA_READ),
+      adverbs::completion_name(IBV_WC_RDMA_READ));
+  EXPECT_STREQ(
+      adverbs::opcode_name(IBV_WR_SEND_WITH_IMM),
+      adverbs::completion_name(IBV_WC_SEND));
+  EXPECT_STREQ(
+      adverbs::opcode_name(IBV_WR_ATOMIC_FETCH_AND_ADD),
+      adverbs::completion_name(IBV_WC_FETCH_ADD));
+}
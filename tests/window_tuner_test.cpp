@@ -0,0 +1,117 @@
+#include "window_tuner.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Completions from a saturated link: each op of bytes finishes
+// bytes / bytes_per_ns after the previous, latency_ns after it was posted.
+struct simulated_link {
+  adverbs::window_tuner& tuner;
+  uint64_t now = 1'000'000;
+
+  void run(int ops, size_t bytes, uint64_t interval_ns, uint64_t latency_ns) {
+    for (int i = 0; i < ops; ++i) {
+      now += interval_ns;
+      tuner.on_completion(bytes, latency_ns, now);
+    }
+  }
+};
+
+TEST(window_tuner, initial_window_until_measured) {
+  adverbs::window_tuner tuner;
+  auto window = tuner.current();
+  EXPECT_EQ(window.chunk, 64u * 1024);
+  EXPECT_EQ(window.depth, 8u);
+  EXPECT_EQ(tuner.bandwidth(), 0);
+  EXPECT_EQ(tuner.bdp(), 0);
+
+  adverbs::window_tuner shallow({.max_read_depth = 2});
+  EXPECT_EQ(shallow.current(true).depth, 2u);
+  EXPECT_EQ(shallow.current(false).depth, 8u);
+}
+
+TEST(window_tuner, sizes_window_to_bdp) {
+  adverbs::window_tuner tuner;
+  simulated_link link{tuner};
+  // 10 GB/s, 5us base RTT: a 64 KiB op takes 6554 ns on the wire.
+  link.run(1000, 65536, 6554, 5000 + 6554);
+
+  EXPECT_EQ(tuner.min_rtt_ns(), 11554u);
+  EXPECT_NEAR(tuner.bandwidth(), 10, 0.01);
+  EXPECT_NEAR(tuner.bdp(), 115'540, 200);
+
+  // 1.5 x BDP over ~8 ops: 32 KiB chunks, 6 deep.
+  auto window = tuner.current();
+  EXPECT_EQ(window.chunk, 32768u);
+  EXPECT_EQ(window.depth, 6u);
+  EXPECT_GE(window.bytes(), tuner.bdp());
+  EXPECT_LE(window.bytes(), 2 * tuner.bdp());
+}
+
+TEST(window_tuner, read_depth_bound_grows_chunks) {
+  adverbs::window_tuner tuner({.max_read_depth = 2});
+  simulated_link link{tuner};
+  link.run(1000, 65536, 6554, 5000 + 6554);
+
+  auto window = tuner.current(true);
+  EXPECT_EQ(window.depth, 2u);
+  EXPECT_EQ(window.chunk, 131072u);
+  EXPECT_GE(window.bytes(), tuner.bdp());
+}
+
+TEST(window_tuner, respects_chunk_and_depth_bounds) {
+  adverbs::window_tuner tuner(
+      {.max_depth = 4, .max_read_depth = 4, .max_chunk = 65536});
+  simulated_link link{tuner};
+  // 10 GB/s over 1 ms: a 10 MB BDP, far beyond 4 x 64 KiB.
+  link.run(1000, 65536, 6554, 1'000'000);
+  auto window = tuner.current();
+  EXPECT_EQ(window.chunk, 65536u);
+  EXPECT_EQ(window.depth, 4u);
+}
+
+TEST(window_tuner, ignores_queueing_but_follows_route_changes) {
+  adverbs::window_tuner tuner({}, {.rtt_window = 64});
+  simulated_link link{tuner};
+  link.run(500, 65536, 6554, 11554);
+  auto before = tuner.current();
+
+  // Queueing delay on some ops doesn't move the minimum.
+  link.run(32, 65536, 6554, 40'000);
+  EXPECT_EQ(tuner.min_rtt_ns(), 11554u);
+  EXPECT_EQ(tuner.current().bytes(), before.bytes());
+
+  // A longer route for a whole window does.
+  link.run(64, 65536, 6554, 100'000);
+  EXPECT_EQ(tuner.min_rtt_ns(), 100'000u);
+  EXPECT_GT(tuner.current().bytes(), 5 * before.bytes());
+}
+
+TEST(window_tuner, zero_windows_act_as_one) {
+  adverbs::window_tuner tuner({}, {.rtt_window = 0, .bandwidth_window = 0});
+  simulated_link link{tuner};
+  link.run(100, 65536, 6554, 20'000);
+  link.run(1, 65536, 6554, 11554);
+  // Only the latest completion counts.
+  EXPECT_EQ(tuner.min_rtt_ns(), 11554u);
+  link.run(1, 65536, 6554, 30'000);
+  EXPECT_EQ(tuner.min_rtt_ns(), 30'000u);
+  EXPECT_GT(tuner.bandwidth(), 0);
+}
+
+TEST(window_tuner, limits_from_device_caps) {
+  adverbs::device_caps caps;
+  caps.max_qp_wr = 16384;
+  caps.max_qp_rd_atom = 16;
+  caps.max_qp_init_rd_atom = 8;
+  auto limits = adverbs::window_limits::from(caps);
+  EXPECT_EQ(limits.max_depth, 16384u);
+  EXPECT_EQ(limits.max_read_depth, 8u);
+
+  auto defaults = adverbs::window_limits::from({});
+  EXPECT_EQ(defaults.max_depth, 128u);
+  EXPECT_EQ(defaults.max_read_depth, 16u);
+}
+
+}  // namespace
@@ -0,0 +1,172 @@
+#include "wr_template.h"
+
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "fake_verbs.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(send_template, patches_varying_fields) {
+  adverbs_test::fake_verbs fake;
+  auto* qp = fake.make_qp(1);
+  std::vector<char> local(4096);
+
+  adverbs::send_template write(
+      qp, IBV_WR_RDMA_WRITE_WITH_IMM, local.data(), 11, 0x10000, 22);
+  write.post(1, 0, 0, 64);
+  write.post(2, 128, 4096, 256, 0xdeadbeef);
+  write.post(3, 0, 0, 64);
+
+  ASSERT_EQ(fake.sends.size(), 3u);
+  for (const auto& sent : fake.sends) {
+    EXPECT_EQ(sent.wr.opcode, IBV_WR_RDMA_WRITE_WITH_IMM);
+    EXPECT_EQ(sent.wr.send_flags, (unsigned)IBV_SEND_SIGNALED);
+    EXPECT_EQ(sent.wr.wr.rdma.rkey, 22u);
+    EXPECT_EQ(sent.wr.next, nullptr);
+    ASSERT_EQ(sent.sges.size(), 1u);
+    EXPECT_EQ(sent.sges[0].lkey, 11u);
+  }
+  EXPECT_EQ(fake.sends[0].wr.wr_id, 1u);
+  EXPECT_EQ(fake.sends[0].sges[0].addr, (uint64_t)(uintptr_t)local.data());
+  EXPECT_EQ(fake.sends[0].sges[0].length, 64u);
+  EXPECT_EQ(fake.sends[0].wr.wr.rdma.remote_addr, 0x10000u);
+
+  EXPECT_EQ(fake.sends[1].wr.wr_id, 2u);
+  EXPECT_EQ(
+      fake.sends[1].sges[0].addr, (uint64_t)(uintptr_t)(local.data() + 128));
+  EXPECT_EQ(fake.sends[1].sges[0].length, 256u);
+  EXPECT_EQ(fake.sends[1].wr.wr.rdma.remote_addr, 0x11000u);
+  EXPECT_EQ(ntohl(fake.sends[1].wr.imm_data), 0xdeadbeef);
+  // The previous post's immediate isn't carried over.
+  EXPECT_EQ(fake.sends[2].wr.imm_data, 0u);
+}
+
+TEST(send_template, sends_keep_the_ud_address) {
+  adverbs_test::fake_verbs fake;
+  char local[256];
+  auto* ah = reinterpret_cast<struct ibv_ah*>(0x1000);
+  adverbs::send_template send(
+      fake.make_qp(1), IBV_WR_SEND, local, 1, 0x10000, 2);
+  struct ibv_send_wr& wr = send.prepare(0, 0, 0, 0);
+  wr.wr.ud.ah = ah;
+  wr.wr.ud.remote_qpn = 7;
+  wr.wr.ud.remote_qkey = 0x11111111;
+  send.post(1, 0, 64, 64);
+
+  adverbs::send_batch batch(send, 2);
+  batch.add(2, 64, 128, 64);
+  batch.add(3, 128, 192, 64);
+  batch.post();
+
+  ASSERT_EQ(fake.sends.size(), 3u);
+  for (const auto& sent : fake.sends) {
+    EXPECT_EQ(sent.wr.wr.ud.ah, ah);
+    EXPECT_EQ(sent.wr.wr.ud.remote_qpn, 7u);
+    EXPECT_EQ(sent.wr.wr.ud.remote_qkey, 0x11111111u);
+  }
+}
+
+TEST(send_template, rejects_atomics) {
+  char local[8];
+  EXPECT_THROW(
+      adverbs::send_template(
+          nullptr, IBV_WR_ATOMIC_FETCH_AND_ADD, local, 1, 0, 2),
+      std::invalid_argument);
+}
+
+TEST(send_template, reports_post_failure) {
+  adverbs_test::fake_verbs fake;
+  fake.fail_send_at = 0;
+  char local[64];
+  adverbs::send_template send(fake.make_qp(1), IBV_WR_SEND, local, 1, 0, 0);
+  EXPECT_THROW(send.post(1, 0, 0, 64), std::runtime_error);
+}
+
+TEST(send_batch, posts_one_chain) {
+  adverbs_test::fake_verbs fake;
+  std::vector<char> local(4096);
+  adverbs::send_template write(
+      fake.make_qp(1), IBV_WR_RDMA_WRITE, local.data(), 11, 0x10000, 22);
+  adverbs::send_batch batch(write, 4, true);
+
+  batch.post();
+  EXPECT_EQ(fake.post_send_calls, 0);
+
+  for (uint64_t i = 0; i < 3; ++i) batch.add(i, i * 64, i * 128, 64);
+  EXPECT_EQ(batch.size(), 3u);
+  EXPECT_FALSE(batch.full());
+  batch.post();
+  EXPECT_EQ(batch.size(), 0u);
+  EXPECT_EQ(fake.post_send_calls, 1);
+  ASSERT_EQ(fake.sends.size(), 3u);
+  for (uint64_t i = 0; i < 3; ++i) {
+    const auto& sent = fake.sends[i];
+    EXPECT_EQ(sent.wr.wr_id, i);
+    EXPECT_EQ(sent.sges[0].addr, (uint64_t)(uintptr_t)(local.data() + i * 64));
+    EXPECT_EQ(sent.wr.wr.rdma.remote_addr, 0x10000 + i * 128);
+    // Only the last is signaled.
+    EXPECT_EQ((bool)(sent.wr.send_flags & IBV_SEND_SIGNALED), i == 2) << i;
+  }
+
+  // A full batch, reusing the chain.
+  for (uint64_t i = 0; i < 4; ++i) batch.add(10 + i, 0, 0, 8);
+  EXPECT_TRUE(batch.full());
+  EXPECT_THROW(batch.add(99, 0, 0, 8), std::length_error);
+  batch.post();
+  EXPECT_EQ(fake.post_send_calls, 2);
+  ASSERT_EQ(fake.sends.size(), 7u);
+  EXPECT_EQ(fake.sends[6].wr.wr_id, 13u);
+  EXPECT_TRUE(fake.sends[6].wr.send_flags & IBV_SEND_SIGNALED);
+  EXPECT_FALSE(fake.sends[5].wr.send_flags & IBV_SEND_SIGNALED);
+}
+
+TEST(send_batch, reports_partial_post) {
+  adverbs_test::fake_verbs fake;
+  std::vector<char> local(4096);
+  adverbs::send_template write(
+      fake.make_qp(1), IBV_WR_RDMA_WRITE, local.data(), 11, 0x10000, 22);
+  adverbs::send_batch batch(write, 4);
+
+  for (uint64_t i = 0; i < 4; ++i) batch.add(i, 0, 0, 8);
+  fake.fail_send_at = 2;
+  try {
+    batch.post();
+    FAIL() << "post succeeded";
+  } catch (const adverbs::batch_post_error& e) {
+    EXPECT_EQ(e.posted(), 2u);
+  }
+  EXPECT_EQ(batch.size(), 0u);
+  EXPECT_EQ(fake.sends.size(), 2u);
+
+  // The chain is intact for the next batch.
+  fake.fail_send_at = -1;
+  for (uint64_t i = 0; i < 4; ++i) batch.add(10 + i, 0, 0, 8);
+  batch.post();
+  ASSERT_EQ(fake.sends.size(), 6u);
+  EXPECT_EQ(fake.sends[5].wr.wr_id, 13u);
+}
+
+TEST(send_batch, solicits_only_its_last_send) {
+  adverbs_test::fake_verbs fake;
+  char local[256];
+  adverbs::send_template send(
+      fake.make_qp(1), IBV_WR_SEND, local, 1, 0, 0, 0);
+  adverbs::send_batch batch(send, 4);
+  for (uint64_t i = 0; i < 3; ++i) batch.add(i, i * 64, 0, 64);
+  batch.post(true);
+  for (uint64_t i = 0; i < 2; ++i) batch.add(i, i * 64, 0, 64);
+  batch.post();
+
+  ASSERT_EQ(fake.sends.size(), 5u);
+  for (size_t i = 0; i < 5; ++i) {
+    EXPECT_EQ((bool)(fake.sends[i].wr.send_flags & IBV_SEND_SOLICITED), i == 2)
+        << i;
+  }
+}
+
+}  // namespace